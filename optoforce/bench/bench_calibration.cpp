@@ -0,0 +1,119 @@
+/**
+ * @file   bench_calibration.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Cost of the conversion of raw OptoPackage6D counts into calibrated values:
+ *        previous sample per sample path vs. the batch kernels.
+ *        No device needed.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <boost/chrono.hpp>
+#include "omd/optopackage6d.h"
+#include "optoforce/optoforce_calibration.hpp"
+
+static const size_t NB_SAMPLES_TOTAL = 4000000;
+
+// conversion as done in OptoForceDriver::getData before the batch kernels
+void calibrateSampleBySample(const OptoPackage6D * packages, size_t nb_samples,
+                             const std::vector<float> & factor,
+                             std::vector< std::vector<float> > & val)
+{
+  val.clear();
+  for (size_t i = 0; i < nb_samples; i++)
+  {
+    std::vector<float> data;
+    data.push_back(packages[i].Fx * factor[0]);
+    data.push_back(packages[i].Fy * factor[1]);
+    data.push_back(packages[i].Fz * factor[2]);
+    data.push_back(packages[i].Tx * factor[3]);
+    data.push_back(packages[i].Ty * factor[4]);
+    data.push_back(packages[i].Tz * factor[5]);
+    val.push_back(data);
+  }
+}
+
+double nsPerSample(boost::chrono::steady_clock::time_point start, size_t nb_samples)
+{
+  boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - start;
+  return (double) elapsed.count() / nb_samples;
+}
+
+int main()
+{
+  const size_t batch_sizes[] = {1, 16, 256};
+  const size_t max_batch = 256;
+
+  OptoPackage6D * packages = new OptoPackage6D[max_batch];
+  for (size_t i = 0; i < max_batch; ++i)
+  {
+    packages[i].Fx = rand() % 20000 - 10000;
+    packages[i].Fy = rand() % 20000 - 10000;
+    packages[i].Fz = rand() % 20000 - 10000;
+    packages[i].Tx = rand() % 20000 - 10000;
+    packages[i].Ty = rand() % 20000 - 10000;
+    packages[i].Tz = rand() % 20000 - 10000;
+  }
+  std::vector<float> factor(6);
+  for (size_t i = 0; i < 6; ++i)
+    factor[i] = 1.0f / (90.0f + i);
+
+  std::vector<float> values[6];
+  float * output[6];
+  for (size_t a = 0; a < 6; ++a)
+  {
+    values[a].resize(max_batch);
+    output[a] = &values[a][0];
+  }
+  std::vector< std::vector<float> > val;
+
+  std::cout << "default kernel: " << getCalibrationKernelName(getCalibrationKernel()) << std::endl;
+  std::cout << std::setw(8) << "batch" << std::setw(18) << "sample by sample";
+  for (int k = kernel_scalar; k <= kernel_avx2; ++k)
+    std::cout << std::setw(12) << getCalibrationKernelName((calibration_kernel) k);
+  std::cout << "   (ns per sample)" << std::endl;
+
+  volatile float sink = 0.0;
+  for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++b)
+  {
+    size_t batch = batch_sizes[b];
+    size_t nb_iterations = NB_SAMPLES_TOTAL / batch;
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    for (size_t it = 0; it < nb_iterations; ++it)
+    {
+      calibrateSampleBySample(packages, batch, factor, val);
+      sink = sink + val[0][0];
+    }
+    std::cout << std::setw(8) << batch << std::setw(18) << std::fixed << std::setprecision(2)
+              << nsPerSample(start, nb_iterations * batch);
+
+    for (int k = kernel_scalar; k <= kernel_avx2; ++k)
+    {
+      if (!isCalibrationKernelSupported((calibration_kernel) k))
+      {
+        std::cout << std::setw(12) << "n/a";
+        continue;
+      }
+      start = boost::chrono::steady_clock::now();
+      for (size_t it = 0; it < nb_iterations; ++it)
+      {
+        calibrateCounts((calibration_kernel) k, &packages[0].Fx, sizeof(OptoPackage6D) / sizeof(int),
+                        batch, &factor[0], 6, output);
+        sink = sink + values[0][0];
+      }
+      std::cout << std::setw(12) << nsPerSample(start, nb_iterations * batch);
+    }
+    std::cout << std::endl;
+  }
+
+  delete[] packages;
+  return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file   bench_driver_alloc.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Number of heap allocations per sample read, with the vector based getData
+ *        and with the one filling a caller-provided array.
+ *        Requires one connected device.
+ */
+
+#include <iostream>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <unistd.h>
+#include "optoforce/optoforce_driver.hpp"
+#include "optoforce/optoforce_array_driver.hpp"
+
+// all the allocations of the process go through these operators (the OMD library included)
+static unsigned long nb_allocations = 0;
+
+void * operator new(std::size_t size)
+{
+  ++nb_allocations;
+  void * ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == NULL)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void * operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+//! result of one polling session
+struct BenchResult
+{
+  unsigned long nb_samples;
+  unsigned long nb_allocations;
+};
+
+static const int POLL_PERIOD_MS = 10;
+
+BenchResult pollVector(OptoForceDriver & device, int nb_polls)
+{
+  std::vector< std::vector<float> > data;
+  BenchResult result = {0, 0};
+
+  unsigned long start = nb_allocations;
+  for (int i = 0; i < nb_polls; ++i)
+  {
+    if (device.getData(data))
+      result.nb_samples += data.size();
+    usleep(POLL_PERIOD_MS * 1000);
+  }
+  result.nb_allocations = nb_allocations - start;
+  return result;
+}
+
+BenchResult pollArray(OptoForceDriver & device, int nb_polls)
+{
+  Wrench6 data[256];
+  BenchResult result = {0, 0};
+
+  unsigned long start = nb_allocations;
+  for (int i = 0; i < nb_polls; ++i)
+  {
+    int nb_read;
+    while ((nb_read = device.getData(data, 256)) > 0)
+      result.nb_samples += nb_read;
+    usleep(POLL_PERIOD_MS * 1000);
+  }
+  result.nb_allocations = nb_allocations - start;
+  return result;
+}
+
+void display(const std::string & name, const BenchResult & result)
+{
+  std::cout << name << ": " << result.nb_samples << " samples, "
+            << result.nb_allocations << " allocations, "
+            << (result.nb_samples ? (double)result.nb_allocations / result.nb_samples : 0.0)
+            << " allocations per sample" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  int nb_polls = 500;
+  if (argc == 2)
+    nb_polls = atoi(argv[1]);
+
+  OptoForceArrayDriver enumerator(1);
+  if (!enumerator.WaitUntilPortsFound(500))
+  {
+    std::cerr << "Could not find the connected DAQ in time" << std::endl;
+    return -1;
+  }
+  std::vector<OPort> ports = enumerator.GetPorts();
+
+  OptoForceDriver device;
+  if (!device.openDevice(ports[0]))
+  {
+    std::cerr << "Failed to open device" << std::endl;
+    return -1;
+  }
+  device.setFrequency(speed_1000hz);
+
+  // first reading to flush the internal buffers
+  std::vector< std::vector<float> > data;
+  device.getData(data);
+
+  display("vector getData", pollVector(device, nb_polls));
+
+  device.resetAllocationStats();
+  display("array getData ", pollArray(device, nb_polls));
+
+  // the part of the allocations due to the driver staging buffers
+  OptoForceDriver::AllocationStats stats = device.getAllocationStats();
+  std::cout << "driver staging: " << stats.nb_allocations << " allocations, "
+            << stats.allocations_per_second << " allocations/s, "
+            << stats.bytes_per_second << " bytes/s" << std::endl;
+  return 0;
+}
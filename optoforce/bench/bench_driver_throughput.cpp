@@ -0,0 +1,146 @@
+/**
+ * @file   bench_driver_throughput.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Number of samples received per channel with the bulk read,
+ *        compared to the number expected from the sensor speed.
+ *        Runs on a simulated 4-channel 3D daq, whose counter values are also checked,
+ *        or on one connected device, set to 1kHz, with "hw" as third argument.
+ *        Returns 1 if a check fails.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <boost/chrono.hpp>
+#include "optoforce/optoforce_driver.hpp"
+#include "optoforce/optoforce_array_driver.hpp"
+#include "optoforce/optoforce_simulated_backend.hpp"
+
+static const int CAPACITY = 512;
+static const double SENSOR_FREQ = 1000.0;
+static const int BURST_SIZE = 8;
+static const double JITTER = 0.002;
+
+// index of a sample of the simulated counter (see signal_counter), -1 if not such a sample
+static long getCounterIndex(const Force3 & sample, int channel)
+{
+  long value = (long) sample.fx;
+  if ((value % 64 != channel * 8) || ((long) sample.fy != value + 1) || ((long) sample.fz != value + 2))
+    return -1;
+  return value / 64;
+}
+
+int main(int argc, char* argv[])
+{
+  double duration_s = 10.0;
+  int poll_period_ms = 10;
+  if (argc >= 2)
+    duration_s = atof(argv[1]);
+  if (argc >= 3)
+    poll_period_ms = atoi(argv[2]);
+  bool is_simulated = !((argc >= 4) && (std::strcmp(argv[3], "hw") == 0));
+
+  // simulated daq delivering bursts of 8 samples, with up to 2ms of delay
+  SimulatedDeviceConfig config;
+  config.is_3D_sensor = true;
+  config.nb_channels = 4;
+  config.burst_size = BURST_SIZE;
+  config.jitter = JITTER;
+  config.signal = signal_counter;
+  SimulatedBackend backend;
+  backend.addDevice(config);
+
+  OptoForceArrayDriver enumerator(1, is_simulated ? backend.createPortEnumerator() : NULL);
+  if (!enumerator.WaitUntilPortsFound(500))
+  {
+    std::cerr << "Could not find the connected DAQ in time" << std::endl;
+    return -1;
+  }
+  std::vector<OPort> ports = enumerator.GetPorts();
+
+  OptoForceDriver device(is_simulated ? backend.createDaq() : NULL);
+  if (!device.openDevice(ports[0]))
+  {
+    std::cerr << "Failed to open device" << std::endl;
+    return -1;
+  }
+  device.setFrequency(speed_1000hz);
+
+  int nb_channels = device.getNumberChannels();
+  std::vector<Force3> samples(nb_channels * CAPACITY);
+  std::vector<int> nb_read(nb_channels);
+  std::vector<unsigned long> nb_received(nb_channels, 0);
+  // counter index expected next, per channel (-1: any, at the first sample)
+  std::vector<long> next_index(nb_channels, -1);
+  std::vector<unsigned long> nb_wrong(nb_channels, 0);
+
+  // first reading to flush the internal buffers
+  while (device.getDataAllChannels(&samples[0], CAPACITY, &nb_read[0]) > 0)
+    ;
+
+  boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+  double elapsed_s = 0.0;
+  while (elapsed_s < duration_s)
+  {
+    usleep(poll_period_ms * 1000);
+    // measured before reading: all the samples delivered so far are then received
+    elapsed_s = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+    while (device.getDataAllChannels(&samples[0], CAPACITY, &nb_read[0]) > 0)
+    {
+      for (int c = 0; c < nb_channels; ++c)
+      {
+        nb_received[c] += nb_read[c];
+        // a sample lost, repeated or taken from another channel breaks the counter sequence
+        for (int j = 0; is_simulated && (j < nb_read[c]); ++j)
+        {
+          long index = getCounterIndex(samples[c * CAPACITY + j], c);
+          if ((index < 0) || ((next_index[c] >= 0) && (index != next_index[c])))
+            ++nb_wrong[c];
+          next_index[c] = (index < 0) ? -1 : (index + 1) % 65536;
+        }
+      }
+    }
+  }
+
+  // the last burst may not be delivered yet, the first one may be partly read by the flush
+  double nb_expected = elapsed_s * SENSOR_FREQ;
+  double tolerance = BURST_SIZE + JITTER * SENSOR_FREQ;
+  bool is_ok = true;
+  std::cout << "elapsed time: " << elapsed_s << " s, poll period " << poll_period_ms << " ms" << std::endl;
+  for (int c = 0; c < nb_channels; ++c)
+  {
+    std::cout << "channel " << c << ": " << nb_received[c] << " samples received, "
+              << nb_expected << " expected ("
+              << nb_received[c] / elapsed_s << " samples/s)";
+    if (is_simulated)
+      std::cout << ", " << nb_wrong[c] << " out of sequence";
+    std::cout << std::endl;
+    if ((std::fabs(nb_received[c] - nb_expected) > tolerance) || (nb_wrong[c] > 0))
+    {
+      std::cerr << "channel " << c << ": check failed" << std::endl;
+      is_ok = false;
+    }
+  }
+
+  SimulatedDeviceStats stats;
+  if (is_simulated && backend.getDeviceStats(device.getSerialNumber(), stats))
+  {
+    std::cout << "simulated daq: " << stats.nb_delivered << " delivered, "
+              << stats.nb_read << " read, " << stats.nb_lost << " lost, in "
+              << stats.nb_reads << " reads" << std::endl;
+    if (stats.nb_lost != 0)
+    {
+      std::cerr << "samples lost by the simulated daq" << std::endl;
+      is_ok = false;
+    }
+  }
+  return is_ok ? 0 : 1;
+}
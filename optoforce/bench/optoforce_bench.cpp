@@ -0,0 +1,1816 @@
+/**
+ * @file   optoforce_bench.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Benchmark suite of the acquisition hot paths, run on simulated daq:
+ *        driver getData cost per sample, acquisition loop cost vs device count,
+ *        getData contention from consumer threads, storeData throughput, recording append latency,
+ *        and latency skew / loss of the serial polling vs reader threads.
+ *        Results are printed in JSON, to follow them from one release to the other.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <boost/program_options.hpp>
+#include "optoforce/optoforce_driver.hpp"
+#include "optoforce/optoforce_acquisition.hpp"
+#include "optoforce/optoforce_chunk_queue.hpp"
+#include "optoforce/optoforce_csv.hpp"
+#include "optoforce/optoforce_codec.hpp"
+#include "optoforce/optoforce_recording_map.hpp"
+#include "optoforce/optoforce_replay_backend.hpp"
+#include "optoforce/optoforce_shm.hpp"
+#include "optoforce/optoforce_stream.hpp"
+#include "optoforce/optoforce_simulated_backend.hpp"
+
+namespace po = boost::program_options;
+typedef boost::chrono::steady_clock bench_clock;
+
+//! parameters shared by the scenarios
+struct BenchConfig
+{
+  //! duration of each measurement, in s
+  double duration;
+  //! largest number of devices handled by the acquisition
+  int max_devices;
+  //! largest number of threads reading the latest samples
+  int max_consumers;
+  //! largest number of devices for the reader threads comparison
+  int max_reader_devices;
+  //! frequency of the acquisition loop, in Hz
+  int loop_frequency;
+  //! acceleration of the simulated daq used for the driver and storage measurements
+  double time_scale;
+};
+
+//! JSON object built field after field
+class JsonObject
+{
+public:
+  JsonObject() : is_empty_(true) {}
+
+  JsonObject & add(const std::string & key, const std::string & value)
+  {
+    return addRaw(key, "\"" + value + "\"");
+  }
+  JsonObject & add(const std::string & key, double value)
+  {
+    std::ostringstream oss;
+    oss << value;
+    return addRaw(key, oss.str());
+  }
+  JsonObject & addRaw(const std::string & key, const std::string & value)
+  {
+    oss_ << (is_empty_ ? "" : ", ") << "\"" << key << "\": " << value;
+    is_empty_ = false;
+    return *this;
+  }
+  std::string str() const { return "{" + oss_.str() + "}"; }
+
+private:
+  std::ostringstream oss_;
+  bool is_empty_;
+};
+
+static std::string toJsonArray(const std::vector<std::string> & items)
+{
+  std::string result = "[";
+  for (size_t i = 0; i < items.size(); ++i)
+    result += (i ? ",\n    " : "\n    ") + items[i];
+  return result + (items.empty() ? "]" : "\n  ]");
+}
+
+static double elapsedSince(bench_clock::time_point start)
+{
+  return boost::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static SimulatedDeviceConfig getDeviceConfig(bool is_3D_sensor, double time_scale)
+{
+  SimulatedDeviceConfig config;
+  config.is_3D_sensor = is_3D_sensor;
+  config.nb_channels = is_3D_sensor ? 4 : 1;
+  config.time_scale = time_scale;
+  config.buffer_size = 100000;
+  config.overflow = overflow_drop_oldest;
+  return config;
+}
+
+/*
+ * Driver read cost, per sample, for each interface.
+ * The daq is read every ms, the time spent in the calls being accumulated.
+ * The simulated daq read alone is given as reference, as included in the driver figures.
+ */
+static std::vector<std::string> benchDriverGetData(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  const char * apis[] = {"daq_read", "vector", "array"};
+
+  for (int is_3D = 0; is_3D < 2; ++is_3D)
+  {
+    for (int api = 0; api < 3; ++api)
+    {
+      SimulatedBackend backend;
+      backend.addDevice(getDeviceConfig(is_3D, config.time_scale));
+      OptoForcePortEnumerator * enumerator = backend.createPortEnumerator();
+      OPort port = enumerator->listPorts()[0];
+      delete enumerator;
+
+      OptoForceDaq * daq = backend.createDaq();
+      OptoForceDriver * driver = NULL;
+      if (api == 0)
+        daq->open(port);
+      else
+      {
+        driver = new OptoForceDriver(daq);
+        driver->openDevice(port);
+      }
+
+      int nb_channels = is_3D ? 4 : 1;
+      std::vector< std::vector<float> > values;
+      std::vector<Wrench6> wrenches(100000);
+      std::vector<Force3> forces(nb_channels * 100000);
+      std::vector<int> nb_read(nb_channels);
+      RawCounts counts;
+      unsigned long nb_samples = 0;
+      boost::chrono::nanoseconds busy(0);
+
+      bench_clock::time_point start = bench_clock::now();
+      while (elapsedSince(start) < config.duration)
+      {
+        usleep(1000);
+        bench_clock::time_point call_start = bench_clock::now();
+        if (api == 0)
+        {
+          int n = daq->readAll(counts);
+          nb_samples += (n > 0) ? n * nb_channels : 0;
+        }
+        else if (api == 1)
+        {
+          for (int c = 0; c < nb_channels; ++c)
+          {
+            if (driver->getData(values, c))
+              nb_samples += values.size();
+          }
+        }
+        else if (is_3D)
+        {
+          if (driver->getDataAllChannels(&forces[0], 100000, &nb_read[0]) > 0)
+          {
+            for (int c = 0; c < nb_channels; ++c)
+              nb_samples += nb_read[c];
+          }
+        }
+        else
+        {
+          int n = driver->getData(&wrenches[0], wrenches.size());
+          nb_samples += (n > 0) ? n : 0;
+        }
+        busy += bench_clock::now() - call_start;
+      }
+
+      if (driver != NULL)
+        delete driver;
+      else
+        delete daq;
+
+      JsonObject result;
+      result.add("api", apis[api])
+        .add("sensor", is_3D ? "3D" : "6D")
+        .add("channels", nb_channels)
+        .add("samples", nb_samples)
+        .add("ns_per_sample", nb_samples ? busy.count() / (double) nb_samples : 0.0);
+      results.push_back(result.str());
+    }
+  }
+  return results;
+}
+
+/*
+ * Acquisition loop cost (sleep excluded) and wakeup jitter, for an increasing number of 6D devices at 1kHz.
+ */
+static std::vector<std::string> benchAcquisitionLoop(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  for (int nb_devices = 1; nb_devices <= config.max_devices; nb_devices *= 2)
+  {
+    SimulatedBackend backend;
+    for (int i = 0; i < nb_devices; ++i)
+      backend.addDevice(getDeviceConfig(false, 1.0));
+
+    OptoforceAcquisition acquisition;
+    if (!acquisition.initDevices(nb_devices, &backend))
+    {
+      std::cerr << "could not connect to the " << nb_devices << " simulated devices" << std::endl;
+      continue;
+    }
+    acquisition.setAcquisitionFrequency(config.loop_frequency);
+    acquisition.startReading();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+    OptoforceAcquisition::LoopStats stats = acquisition.getLoopStats();
+    SchedulerStats wakeups = acquisition.getSchedulerStats();
+    acquisition.stopReading();
+
+    JsonObject result;
+    result.add("devices", nb_devices)
+      .add("frequency", config.loop_frequency)
+      .add("iterations", stats.nb_iterations)
+      .add("mean_us", stats.nb_iterations ? stats.busy_time.count() * 1e-3 / stats.nb_iterations : 0.0)
+      .add("max_us", stats.max_busy_time.count() * 1e-3)
+      .add("wakeups", wakeups.nb_wakeups)
+      .add("missed_deadlines", wakeups.nb_missed)
+      .add("mean_lateness_us", wakeups.mean_lateness.count() * 1e-3)
+      .add("max_lateness_us", wakeups.max_lateness.count() * 1e-3);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! consumer of the latest samples, as a control loop would do, through getData or getLatestSamples
+static void consumeLatest(OptoforceAcquisition * acquisition, bool is_fixed, boost::atomic<bool> * is_running,
+                          unsigned long * nb_calls, boost::chrono::nanoseconds * busy,
+                          boost::chrono::nanoseconds * max_call)
+{
+  std::vector< std::vector<float> > latest;
+  std::vector<OptoforceAcquisition::LatestSample> latest_fixed(64);
+  while (is_running->load())
+  {
+    bench_clock::time_point start = bench_clock::now();
+    if (is_fixed)
+      acquisition->getLatestSamples(&latest_fixed[0], latest_fixed.size());
+    else
+      acquisition->getData(latest);
+    boost::chrono::nanoseconds duration = bench_clock::now() - start;
+    *busy += duration;
+    *max_call = std::max(*max_call, duration);
+    ++(*nb_calls);
+  }
+}
+
+/*
+ * Latest samples read continuously by an increasing number of threads, while the acquisition
+ * loop runs on the largest device set: through getData (a vector per device, reused from one
+ * call to the other), and getLatestSamples (fixed-size samples).
+ */
+static std::vector<std::string> benchGetDataContention(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  int nb_devices = config.max_devices;
+
+  SimulatedBackend backend;
+  for (int i = 0; i < nb_devices; ++i)
+    backend.addDevice(getDeviceConfig(false, 1.0));
+
+  OptoforceAcquisition acquisition;
+  if (!acquisition.initDevices(nb_devices, &backend))
+  {
+    std::cerr << "could not connect to the " << nb_devices << " simulated devices" << std::endl;
+    return results;
+  }
+  acquisition.setAcquisitionFrequency(1000);
+
+  for (int is_fixed = 0; is_fixed < 2; ++is_fixed)
+  for (int nb_consumers = is_fixed; nb_consumers <= config.max_consumers; nb_consumers = nb_consumers ? nb_consumers * 2 : 1)
+  {
+    boost::atomic<bool> is_running(true);
+    std::vector<unsigned long> nb_calls(nb_consumers, 0);
+    std::vector<boost::chrono::nanoseconds> busy(nb_consumers, boost::chrono::nanoseconds(0));
+    std::vector<boost::chrono::nanoseconds> max_call(nb_consumers, boost::chrono::nanoseconds(0));
+    boost::thread_group consumers;
+
+    acquisition.startReading();
+    for (int i = 0; i < nb_consumers; ++i)
+      consumers.create_thread(boost::bind(&consumeLatest, &acquisition, is_fixed != 0, &is_running,
+                                          &nb_calls[i], &busy[i], &max_call[i]));
+
+    bench_clock::time_point start = bench_clock::now();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+    OptoforceAcquisition::LoopStats stats = acquisition.getLoopStats();
+    is_running = false;
+    consumers.join_all();
+    double elapsed = elapsedSince(start);
+    acquisition.stopReading();
+
+    unsigned long total_calls = 0;
+    boost::chrono::nanoseconds total_busy(0);
+    boost::chrono::nanoseconds total_max(0);
+    for (int i = 0; i < nb_consumers; ++i)
+    {
+      total_calls += nb_calls[i];
+      total_busy += busy[i];
+      total_max = std::max(total_max, max_call[i]);
+    }
+
+    JsonObject result;
+    result.add("devices", nb_devices)
+      .add("api", is_fixed ? "getLatestSamples" : "getData")
+      .add("consumers", nb_consumers)
+      .add("calls_per_s", total_calls / elapsed)
+      .add("ns_per_call", total_calls ? total_busy.count() / (double) total_calls : 0.0)
+      .add("max_us_per_call", total_max.count() * 1e-3)
+      .add("loop_iterations", stats.nb_iterations)
+      .add("loop_mean_us", stats.nb_iterations ? stats.busy_time.count() * 1e-3 / stats.nb_iterations : 0.0)
+      .add("loop_max_us", stats.max_busy_time.count() * 1e-3);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! subscriber counting the samples delivered, and their delay since their stamp
+struct BatchCounter
+{
+  explicit BatchCounter(int consume_us) : nb_samples(0), nb_missed(0), nb_delays(0), delay_sum(0.0),
+                                          max_delay(0.0), consume_us(consume_us) {}
+
+  void operator()(const SampleBatch & batch)
+  {
+    if (batch.nb_samples > 0)
+    {
+      double delay = boost::chrono::duration<double>(boost::chrono::high_resolution_clock::now() -
+                                                     batch.samples[batch.nb_samples - 1].acq_time).count();
+      delay_sum += delay;
+      max_delay = std::max(max_delay, delay);
+      ++nb_delays;
+    }
+    nb_samples += batch.nb_samples;
+    nb_missed += batch.nb_missed;
+    // a slow consumer
+    if (consume_us > 0)
+      boost::this_thread::sleep_for(boost::chrono::microseconds(consume_us));
+  }
+
+  unsigned long nb_samples;
+  unsigned long nb_missed;
+  unsigned long nb_delays;
+  double delay_sum;
+  double max_delay;
+  int consume_us;
+};
+
+//! latest samples polled at 1 kHz, counting the distinct ones got
+static void pollLatest(OptoforceAcquisition * acquisition, boost::atomic<bool> * is_running, unsigned long * nb_samples)
+{
+  std::vector<OptoforceAcquisition::LatestSample> latest(64);
+  std::vector<int64_t> last_read(latest.size(), 0);
+  while (is_running->load())
+  {
+    size_t nb_devices = acquisition->getLatestSamples(&latest[0], latest.size());
+    for (size_t i = 0; i < nb_devices; ++i)
+    {
+      if ((latest[i].nb_values > 0) && (latest[i].read_time_ns != last_read[i]))
+        ++(*nb_samples);
+      last_read[i] = latest[i].read_time_ns;
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  }
+}
+
+/*
+ * Samples got by a consumer of all devices, the daq buffering 8 samples: polling the latest samples at 1 kHz,
+ * or subscribed inline, through the executor, and through the executor while taking 5 ms per batch
+ * with a queue of 256 samples. The delay goes from the sample stamp to its delivery.
+ */
+static std::vector<std::string> benchSubscribe(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  const char * consumers[] = {"polling", "inline", "executor", "slow_executor"};
+
+  for (size_t c = 0; c < 4; ++c)
+  {
+    SimulatedBackend backend;
+    SimulatedDeviceConfig device_config = getDeviceConfig(false, 1.0);
+    device_config.buffer_size = 8;
+    for (int i = 0; i < config.max_devices; ++i)
+      backend.addDevice(device_config);
+
+    OptoforceAcquisition acquisition;
+    if (!acquisition.initDevices(config.max_devices, &backend))
+    {
+      std::cerr << "could not connect to the " << config.max_devices << " simulated devices" << std::endl;
+      continue;
+    }
+    acquisition.setAcquisitionFrequency(config.loop_frequency);
+
+    BatchCounter counter((c == 3) ? 5000 : 0);
+    unsigned long nb_polled = 0;
+    boost::atomic<bool> is_running(true);
+    boost::thread_group pollers;
+    int id = -1;
+    if (c == 0)
+      pollers.create_thread(boost::bind(&pollLatest, &acquisition, &is_running, &nb_polled));
+    else
+      id = acquisition.subscribe(boost::ref(counter), -1, (c == 1) ? dispatch_inline : dispatch_executor,
+                                 (c == 3) ? 256 : SUBSCRIPTION_QUEUE_SIZE);
+
+    acquisition.startReading();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+    OptoforceAcquisition::LoopStats stats = acquisition.getLoopStats();
+    acquisition.stopReading();
+    is_running = false;
+    pollers.join_all();
+    unsigned long nb_overruns = acquisition.getNumberOverruns(id);
+    acquisition.unsubscribe(id);
+
+    std::vector<std::string> serial_numbers;
+    acquisition.getSerialNumbers(serial_numbers);
+    unsigned long nb_read = 0;
+    for (size_t i = 0; i < serial_numbers.size(); ++i)
+    {
+      SimulatedDeviceStats device_stats;
+      backend.getDeviceStats(serial_numbers[i], device_stats);
+      nb_read += device_stats.nb_read;
+    }
+
+    JsonObject result;
+    result.add("consumer", consumers[c])
+      .add("devices", config.max_devices)
+      .add("samples_read", nb_read)
+      .add("samples_received", (c == 0) ? nb_polled : counter.nb_samples)
+      .add("samples_missed", counter.nb_missed)
+      .add("overruns", nb_overruns)
+      .add("mean_delay_us", counter.nb_delays ? counter.delay_sum * 1e6 / counter.nb_delays : 0.0)
+      .add("max_delay_us", counter.max_delay * 1e6)
+      .add("loop_mean_us", stats.nb_iterations ? stats.busy_time.count() * 1e-3 / stats.nb_iterations : 0.0)
+      .add("loop_max_us", stats.max_busy_time.count() * 1e-3);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! total size of the files of a directory, removing them
+static unsigned long removeFiles(const std::string & directory)
+{
+  unsigned long nb_bytes = 0;
+  DIR * dir = opendir(directory.c_str());
+  if (dir == NULL)
+    return 0;
+
+  struct dirent * entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    std::string path = directory + "/" + entry->d_name;
+    struct stat info;
+    if ((stat(path.c_str(), &info) == 0) && S_ISREG(info.st_mode))
+    {
+      nb_bytes += info.st_size;
+      std::remove(path.c_str());
+    }
+  }
+  closedir(dir);
+  return nb_bytes;
+}
+
+/*
+ * storeData throughput, for each file format, the recording being done on accelerated 6D devices.
+ */
+static std::vector<std::string> benchStoreData(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  char directory[] = "/tmp/optoforce_bench_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+  {
+    std::cerr << "could not create the storage directory" << std::endl;
+    return results;
+  }
+
+  // segmented: binary split into preallocated segments of 4 MB,
+  // merged: a single csv file of all devices, aligned on a 1 ms timeline
+  const recording_format formats[] = {recording_csv, recording_binary, recording_binary, recording_csv};
+  const char * format_names[] = {"csv", "binary", "segmented", "merged"};
+
+  for (int nb_devices = 1; nb_devices <= config.max_devices; nb_devices *= 2)
+  {
+    for (int f = 0; f < 4; ++f)
+    {
+      SimulatedBackend backend;
+      for (int i = 0; i < nb_devices; ++i)
+        backend.addDevice(getDeviceConfig(false, config.time_scale));
+
+      OptoforceAcquisition acquisition;
+      if (!acquisition.initDevices(nb_devices, &backend))
+      {
+        std::cerr << "could not connect to the " << nb_devices << " simulated devices" << std::endl;
+        continue;
+      }
+      acquisition.setAcquisitionFrequency(1000);
+      acquisition.setAutoStore(false);
+      acquisition.setFilename(std::string(directory) + "/bench");
+      acquisition.setRecordingFormat(formats[f]);
+      if (f == 2)
+        acquisition.setSegmentation(0.0, 4 << 20);
+      if (f == 3)
+        acquisition.setMergedOutput(merge_nearest, 1.0);
+
+      acquisition.startRecording();
+      boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+      acquisition.stopRecording();
+
+      bench_clock::time_point start = bench_clock::now();
+      bool is_stored = acquisition.storeData();
+      double elapsed = elapsedSince(start);
+      acquisition.stopReading();
+      unsigned long nb_bytes = removeFiles(directory);
+
+      JsonObject result;
+      result.add("devices", nb_devices)
+        .add("format", format_names[f])
+        .addRaw("stored", is_stored ? "true" : "false")
+        .add("bytes", nb_bytes)
+        .add("seconds", elapsed)
+        .add("mb_per_s", elapsed > 0.0 ? nb_bytes / elapsed * 1e-6 : 0.0);
+      results.push_back(result.str());
+    }
+  }
+  rmdir(directory);
+  return results;
+}
+
+/*
+ * Worst-case append latency of the in-memory recording, over one hour simulated at 1kHz
+ * (3.6M samples pushed one by one, as fast as possible): the growing vector of former versions,
+ * whose reallocations copy everything recorded so far, against the chunked buffer, with its pool
+ * reserved for one minute as at startRecording.
+ */
+static std::vector<std::string> benchAppend(const BenchConfig &)
+{
+  std::vector<std::string> results;
+  const size_t nb_samples = 3600 * 1000;
+
+  StampedSample sample;
+  sample.acq_time = boost::chrono::high_resolution_clock::now();
+  sample.wrench.fx = sample.wrench.fy = sample.wrench.fz = 1.0f;
+  sample.wrench.tx = sample.wrench.ty = sample.wrench.tz = 0.1f;
+
+  for (int is_chunked = 0; is_chunked < 2; ++is_chunked)
+  {
+    std::vector<StampedSample> vector_store;
+    boost::shared_ptr< SpscChunkQueue<StampedSample> > chunk_store;
+    if (is_chunked)
+    {
+      chunk_store.reset(new SpscChunkQueue<StampedSample>(0, 4096));
+      chunk_store->reserve(64 * 1024);
+    }
+
+    // latency histogram by powers of 2 of ns, to get the percentiles
+    std::vector<unsigned long> histogram(64, 0);
+    double max_latency = 0.0;
+    double total_latency = 0.0;
+    unsigned long nb_reallocations = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (size_t i = 0; i < nb_samples; ++i)
+    {
+      sample.acq_time += boost::chrono::milliseconds(1);
+      bench_clock::time_point push_start = bench_clock::now();
+      if (is_chunked)
+        chunk_store->push(sample);
+      else
+      {
+        nb_reallocations += (vector_store.size() == vector_store.capacity()) ? 1 : 0;
+        vector_store.push_back(sample);
+      }
+      double latency = boost::chrono::duration<double>(bench_clock::now() - push_start).count();
+
+      total_latency += latency;
+      max_latency = std::max(max_latency, latency);
+      size_t bin = 0;
+      for (double ns = latency * 1e9; ns >= 1.0; ns /= 2.0)
+        ++bin;
+      ++histogram[std::min(bin, histogram.size() - 1)];
+    }
+    double elapsed = elapsedSince(start);
+
+    // upper bounds of the bins holding the 99.9th and 99.99th percentiles
+    double percentiles_us[2];
+    const size_t nb_above[2] = {nb_samples / 1000, nb_samples / 10000};
+    for (int p = 0; p < 2; ++p)
+    {
+      unsigned long nb_counted = 0;
+      size_t bin = 0;
+      while ((bin < histogram.size()) && (nb_counted < nb_samples - nb_above[p]))
+        nb_counted += histogram[bin++];
+      percentiles_us[p] = std::ldexp(1.0, (int) bin) * 1e-3;
+    }
+
+    JsonObject result;
+    result.add("store", is_chunked ? "chunks" : "vector")
+      .add("samples", (unsigned long) nb_samples)
+      .add("seconds", elapsed)
+      .add("mean_append_ns", total_latency / nb_samples * 1e9)
+      .add("p999_append_us", percentiles_us[0])
+      .add("p9999_append_us", percentiles_us[1])
+      .add("max_append_ms", max_latency * 1e3)
+      .add("allocations", is_chunked ? chunk_store->getNumberAllocations() : nb_reallocations);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+/*
+ * Csv formatting throughput on a 300k samples 6D recording (5 min at 1kHz), written to a file:
+ * the stringstream formatting of former versions compared to the CsvWriter one.
+ */
+static std::vector<std::string> benchCsv(const BenchConfig &)
+{
+  std::vector<std::string> results;
+
+  char directory[] = "/tmp/optoforce_bench_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+  {
+    std::cerr << "could not create the storage directory" << std::endl;
+    return results;
+  }
+
+  // slowly varying forces, as a sensor at rest would give
+  const size_t nb_samples = 300000;
+  std::vector<StampedSample> samples(nb_samples);
+  boost::chrono::high_resolution_clock::time_point time_zero = boost::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    samples[i].acq_time = time_zero + boost::chrono::microseconds(i * 1000 + (i * 7) % 13);
+    float * wrench = &samples[i].wrench.fx;
+    for (size_t k = 0; k < 6; ++k)
+      wrench[k] = (float) (std::sin(i * 1e-3 + k) * (k < 3 ? 20.0 : 0.5));
+  }
+  std::string path = std::string(directory) + "/bench.csv";
+
+  for (int is_writer = 0; is_writer < 2; ++is_writer)
+  {
+    bench_clock::time_point start = bench_clock::now();
+    if (is_writer)
+    {
+      CsvWriter writer;
+      writer.open(path, 6);
+      writer.append(&samples[0], nb_samples, time_zero);
+      writer.close();
+    }
+    else
+    {
+      std::ofstream file_handler(path.c_str());
+      std::stringstream oss;
+      oss << "#t_ms;f_x;f_y;f_z;t_x;t_y;t_z;";
+      file_handler << oss.str() << std::endl;
+      for (size_t j = 0; j < nb_samples; ++j)
+      {
+        oss.str("");
+        boost::chrono::nanoseconds rel_time_ms = samples[j].acq_time - time_zero;
+        oss << rel_time_ms.count() * 1e-6 << ";";
+        const float * wrench = &samples[j].wrench.fx;
+        for (size_t k = 0 ; k < 6; ++k)
+          oss << wrench[k] << ";";
+        oss << std::endl;
+        file_handler << oss.str();
+      }
+    }
+    double elapsed = elapsedSince(start);
+    unsigned long nb_bytes = removeFiles(directory);
+
+    JsonObject result;
+    result.add("formatter", is_writer ? "csv_writer" : "stringstream")
+      .add("samples", (unsigned long) nb_samples)
+      .add("bytes", nb_bytes)
+      .add("seconds", elapsed)
+      .add("mb_per_s", elapsed > 0.0 ? nb_bytes / elapsed * 1e-6 : 0.0)
+      .add("samples_per_s", elapsed > 0.0 ? nb_samples / elapsed : 0.0);
+    results.push_back(result.str());
+  }
+  rmdir(directory);
+  return results;
+}
+
+/*
+ * Lossless compression of a 300k samples 6D recording (5 min at 1kHz) of calibrated counts,
+ * slowly varying with some sensor noise, and stamped with a small jitter.
+ * Speeds are given in MB/s of 32 bytes records.
+ */
+static std::vector<std::string> benchCodec(const BenchConfig &)
+{
+  std::vector<std::string> results;
+
+  const size_t nb_samples = 300000;
+  const float calibration[6] = {92.6f, 93.6f, 20.12f, 5054.3f, 5085.4f, 6912.5f};
+  std::vector<RecordingSample> samples(nb_samples);
+  unsigned int seed = 12345;
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    samples[i].time_ns = i * 1000000LL + (seed >> 16) % 400;
+    for (size_t k = 0; k < 6; ++k)
+    {
+      seed = seed * 1103515245 + 12345;
+      int count = (int) (std::sin(i * 1e-3 + k) * 2000.0) + (int) ((seed >> 16) % 7) - 3;
+      samples[i].wrench[k] = (float) count * (float) (1.0 / calibration[k]);
+    }
+  }
+
+  SampleEncoder encoder;
+  encoder.setCalibration(6, calibration);
+  std::vector<unsigned char> encoded(nb_samples * SampleCodec::MAX_ENCODED_SIZE);
+
+  // blocks of 4096 samples, as in the files
+  const size_t block_size = 4096;
+  std::vector<size_t> block_ends;
+  bench_clock::time_point start = bench_clock::now();
+  unsigned char * output = &encoded[0];
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    if (i % block_size == 0)
+      encoder.reset();
+    output = encoder.encode(samples[i], output);
+    if ((i % block_size == block_size - 1) || (i == nb_samples - 1))
+      block_ends.push_back(output - &encoded[0]);
+  }
+  double encode_time = elapsedSince(start);
+  size_t nb_bytes = output - &encoded[0];
+
+  SampleDecoder decoder;
+  decoder.setCalibration(6, calibration);
+  std::vector<RecordingSample> decoded(nb_samples);
+  start = bench_clock::now();
+  const unsigned char * input = &encoded[0];
+  for (size_t i = 0; (i < nb_samples) && (input != NULL); ++i)
+  {
+    if (i % block_size == 0)
+      decoder.reset();
+    input = decoder.decode(input, &encoded[0] + block_ends[i / block_size], decoded[i]);
+  }
+  double decode_time = elapsedSince(start);
+
+  bool is_lossless = (input != NULL) &&
+    (std::memcmp(&samples[0], &decoded[0], nb_samples * sizeof(RecordingSample)) == 0);
+  double nb_raw_bytes = nb_samples * sizeof(RecordingSample);
+
+  JsonObject result;
+  result.add("samples", (unsigned long) nb_samples)
+    .add("raw_bytes", nb_raw_bytes)
+    .add("encoded_bytes", (unsigned long) nb_bytes)
+    .add("ratio", nb_raw_bytes / nb_bytes)
+    .add("escaped", encoder.getNumberEscaped())
+    .add("encode_mb_per_s", encode_time > 0.0 ? nb_raw_bytes / encode_time * 1e-6 : 0.0)
+    .add("decode_mb_per_s", decode_time > 0.0 ? nb_raw_bytes / decode_time * 1e-6 : 0.0)
+    .addRaw("lossless", is_lossless ? "true" : "false");
+  results.push_back(result.str());
+  return results;
+}
+
+//! calibration of the recordings written by the benchmarks
+static const float BENCH_CALIBRATION[6] = {92.6f, 93.6f, 20.12f, 5054.3f, 5085.4f, 6912.5f};
+
+/*!
+  \brief write a recording of a 6D device at 1 kHz, with a 200 ms contact on f_z every minute
+  \param filename file created
+  \param encoding recording_encoding of the file
+  \param nb_samples number of samples
+ */
+static void writeBenchRecording(const std::string & filename, uint32_t encoding, size_t nb_samples)
+{
+  RecordingHeader header;
+  initRecordingHeader(header);
+  header.sample_frequency = 1000.0;
+  header.encoding = encoding;
+  std::copy(BENCH_CALIBRATION, BENCH_CALIBRATION + 6, header.calibration);
+
+  RecordingWriter writer;
+  writer.open(filename, header);
+  std::vector<RecordingSample> block(4096);
+  unsigned int seed = 12345;
+  for (size_t i = 0; i < nb_samples; )
+  {
+    size_t nb_block = std::min(block.size(), nb_samples - i);
+    for (size_t j = 0; j < nb_block; ++j, ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      block[j].time_ns = i * 1000000LL + (seed >> 16) % 400;
+      for (size_t k = 0; k < 6; ++k)
+      {
+        int count = (int) (std::sin(i * 1e-3 + k) * 2000.0) + (((k == 2) && (i % 60000 < 200)) ? 3000 : 0);
+        block[j].wrench[k] = (float) count * (float) (1.0 / BENCH_CALIBRATION[k]);
+      }
+    }
+    writer.append(&block[0], nb_block);
+  }
+  writer.close();
+}
+
+/*
+ * Time window of a long recording, in each binary encoding: the indexed
+ * seek of the mapped file against a scan of the whole file by the reader.
+ * Then a threshold query on f_z, exceeded by a short contact every minute,
+ * which the chunk statistics of the columnar layout answer reading a few chunks.
+ */
+static std::vector<std::string> benchSeek(const BenchConfig &)
+{
+  std::vector<std::string> results;
+
+  char directory[] = "/tmp/optoforce_bench_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+  {
+    std::cerr << "could not create the recording directory" << std::endl;
+    return results;
+  }
+
+  // an hour at 1 kHz
+  const size_t nb_samples = 3600000;
+  const int64_t window_ns = 100000000LL;
+  const size_t nb_windows = 1000;
+
+  const char * encoding_names[] = {"records", "delta_varint", "columnar"};
+  const float threshold = 120.0f;
+  for (int encoding = encoding_records; encoding <= encoding_columnar; ++encoding)
+  {
+    std::string filename = std::string(directory) + "/recording.opto";
+    writeBenchRecording(filename, encoding, nb_samples);
+    unsigned int seed = 12345;
+
+    bench_clock::time_point start = bench_clock::now();
+    RecordingMap map;
+    map.open(filename);
+    double open_time = elapsedSince(start);
+
+    std::vector<int64_t> starts(nb_windows);
+    for (size_t i = 0; i < nb_windows; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      starts[i] = (int64_t) ((seed >> 8) % (nb_samples - 1000)) * 1000000LL;
+    }
+
+    std::vector<RecordingSample> window;
+    unsigned long nb_read = 0;
+    start = bench_clock::now();
+    for (size_t i = 0; i < nb_windows; ++i)
+      nb_read += map.readWindow(starts[i], starts[i] + window_ns, window);
+    double seek_time = elapsedSince(start) / nb_windows;
+
+    // the same window, read by a scan of the file
+    std::vector<RecordingSample> scanned;
+    std::vector<RecordingSample> records(4096);
+    const int64_t scan_start = starts[0];
+    start = bench_clock::now();
+    RecordingReader reader;
+    reader.open(filename);
+    size_t nb_records;
+    while ((nb_records = reader.read(&records[0], records.size())) > 0)
+    {
+      for (size_t j = 0; j < nb_records; ++j)
+        if ((records[j].time_ns >= scan_start) && (records[j].time_ns < scan_start + window_ns))
+          scanned.push_back(records[j]);
+    }
+    double scan_time = elapsedSince(start);
+
+    map.readWindow(scan_start, scan_start + window_ns, window);
+    bool is_same = (window.size() == scanned.size()) && !window.empty() &&
+      (std::memcmp(&window[0], &scanned[0], window.size() * sizeof(RecordingSample)) == 0);
+
+    std::vector<RecordingSample> found;
+    start = bench_clock::now();
+    size_t nb_blocks_read = map.findAbove(2, threshold, found);
+    double query_time = elapsedSince(start);
+
+    map.close();
+    unsigned long nb_bytes = removeFiles(directory);
+
+    JsonObject result;
+    result.add("encoding", encoding_names[encoding])
+      .add("samples", (unsigned long) nb_samples)
+      .add("file_bytes", nb_bytes)
+      .add("window_ms", window_ns * 1e-6)
+      .add("mean_window_samples", (double) nb_read / nb_windows)
+      .add("open_ms", open_time * 1e3)
+      .add("seek_us", seek_time * 1e6)
+      .add("scan_ms", scan_time * 1e3)
+      .add("speedup", seek_time > 0.0 ? scan_time / seek_time : 0.0)
+      .addRaw("same_window", is_same ? "true" : "false")
+      .add("query_found", (unsigned long) found.size())
+      .add("query_blocks_read", (unsigned long) nb_blocks_read)
+      .add("query_ms", query_time * 1e3);
+    results.push_back(result.str());
+  }
+
+  rmdir(directory);
+  return results;
+}
+
+/*
+ * Replay of a recording through the drivers and the acquisition: samples per second
+ * replayed as fast as possible by 1 to max_devices devices, the values being to come
+ * back unchanged, then the samples delivered by an accelerated replay, in bursts of 8.
+ */
+static std::vector<std::string> benchReplay(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  char directory[] = "/tmp/optoforce_bench_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+  {
+    std::cerr << "could not create the recording directory" << std::endl;
+    return results;
+  }
+  std::string filename = std::string(directory) + "/recording.opto";
+  const size_t nb_samples = 60000;
+  writeBenchRecording(filename, encoding_records, nb_samples);
+
+  std::vector<RecordingSample> records(nb_samples);
+  RecordingReader reader;
+  reader.open(filename);
+  records.resize(reader.read(&records[0], records.size()));
+  reader.close();
+
+  for (int nb_devices = 1; nb_devices <= config.max_devices; nb_devices *= 2)
+  {
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+      ReplayBackend backend;
+      ReplayDeviceConfig device_config;
+      device_config.filename = filename;
+      device_config.time_scale = accelerated ? config.time_scale : 0.0;
+      device_config.burst_size = accelerated ? 8 : 1;
+      for (int i = 0; i < nb_devices; ++i)
+        backend.addDevice(device_config);
+
+      OptoforceAcquisition acquisition;
+      if (!acquisition.initDevices(nb_devices, &backend))
+      {
+        std::cerr << "could not connect to the replayed devices" << std::endl;
+        continue;
+      }
+      std::vector<std::string> serial_numbers;
+      acquisition.getSerialNumbers(serial_numbers);
+      std::vector<float> calibration(BENCH_CALIBRATION, BENCH_CALIBRATION + 6);
+      for (size_t i = 0; i < serial_numbers.size(); ++i)
+        acquisition.setDeviceCalibration(serial_numbers[i], calibration);
+      acquisition.setAcquisitionFrequency(config.loop_frequency);
+      acquisition.setAutoStore(false);
+      acquisition.setDesiredNumberSamples(nb_samples + 1000);
+
+      // as fast as possible: until all the recordings are delivered, accelerated: for the duration
+      bench_clock::time_point start = bench_clock::now();
+      acquisition.startRecording();
+      bool is_finished = false;
+      while (!is_finished && (elapsedSince(start) < (accelerated ? config.duration : 60.0)))
+      {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        is_finished = !accelerated;
+        for (size_t i = 0; i < serial_numbers.size(); ++i)
+        {
+          ReplayDeviceStats stats;
+          is_finished = is_finished && backend.getDeviceStats(serial_numbers[i], stats) && stats.is_finished;
+        }
+      }
+      double replay_time = elapsedSince(start);
+      acquisition.stopRecording();
+
+      std::vector<StampedSample> samples(acquisition.getRecordCapacity());
+      size_t nb_replayed = acquisition.readRecordedSamples(0, &samples[0], samples.size());
+      acquisition.stopReading();
+
+      // the acquisition drops the samples of its first read, flushing the daq buffer
+      size_t offset = 0;
+      while ((offset < std::min(records.size(), (size_t) 4096)) && (nb_replayed > 0) &&
+             (std::memcmp(&samples[0].wrench.fx, records[offset].wrench, sizeof(records[0].wrench)) != 0))
+        ++offset;
+      bool is_same = (nb_replayed > 0) && (offset + nb_replayed <= records.size());
+      for (size_t i = 0; is_same && (i < nb_replayed); ++i)
+        is_same = (std::memcmp(&samples[i].wrench.fx, records[offset + i].wrench, sizeof(records[0].wrench)) == 0);
+
+      JsonObject result;
+      result.add("devices", nb_devices)
+        .add("time_scale", device_config.time_scale)
+        .add("burst_size", device_config.burst_size)
+        .add("replay_s", replay_time)
+        .add("samples_per_device", (unsigned long) nb_replayed)
+        .addRaw("same_values", is_same ? "true" : "false");
+      if (accelerated)
+        result.add("delivered_ratio", nb_replayed / (replay_time * 1000.0 * config.time_scale));
+      else
+        result.add("samples_per_s", nb_devices * nb_replayed / replay_time);
+      results.push_back(result.str());
+    }
+  }
+
+  removeFiles(directory);
+  rmdir(directory);
+  return results;
+}
+
+/*
+ * Background writer, recording accelerated 6D devices straight to the files, in one file per device,
+ * in segments, or merged in a single file:
+ * the buffers waiting to be written, the time taken by the writer passes,
+ * and the acquisition loop cost, which is not to include any write.
+ */
+static std::vector<std::string> benchWriter(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  char directory[] = "/tmp/optoforce_bench_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+  {
+    std::cerr << "could not create the storage directory" << std::endl;
+    return results;
+  }
+
+  // segmented: binary split into preallocated segments of 4 MB,
+  // merged: a single csv file of all devices, aligned on a 1 ms timeline
+  const recording_format formats[] = {recording_csv, recording_binary, recording_binary, recording_csv};
+  const char * format_names[] = {"csv", "binary", "segmented", "merged"};
+
+  for (int nb_devices = 1; nb_devices <= config.max_devices; nb_devices *= 2)
+  {
+    for (int f = 0; f < 4; ++f)
+    {
+      SimulatedBackend backend;
+      for (int i = 0; i < nb_devices; ++i)
+        backend.addDevice(getDeviceConfig(false, config.time_scale));
+
+      OptoforceAcquisition acquisition;
+      if (!acquisition.initDevices(nb_devices, &backend))
+      {
+        std::cerr << "could not connect to the " << nb_devices << " simulated devices" << std::endl;
+        continue;
+      }
+      acquisition.setAcquisitionFrequency(1000);
+      acquisition.setFilename(std::string(directory) + "/bench");
+      acquisition.setRecordingFormat(formats[f]);
+      if (f == 2)
+        acquisition.setSegmentation(0.0, 4 << 20);
+      if (f == 3)
+        acquisition.setMergedOutput(merge_nearest, 1.0);
+
+      acquisition.startRecording();
+      boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+      bench_clock::time_point start = bench_clock::now();
+      acquisition.stopRecording();
+      double stop_time = elapsedSince(start);
+
+      OptoforceAcquisition::WriterStats stats = acquisition.getWriterStats();
+      OptoforceAcquisition::LoopStats loop_stats = acquisition.getLoopStats();
+      unsigned long nb_dropped = acquisition.getNumberDroppedSamples();
+      size_t buffer_size = acquisition.getRecordCapacity() * nb_devices * sizeof(StampedSample);
+      acquisition.stopReading();
+      unsigned long nb_bytes = removeFiles(directory);
+
+      JsonObject result;
+      result.add("devices", nb_devices)
+        .add("format", format_names[f])
+        .add("written", stats.nb_written)
+        .add("dropped", nb_dropped)
+        .add("bytes", nb_bytes)
+        .add("buffer_mb", buffer_size * 1e-6)
+        .add("max_backlog", (unsigned long) stats.max_backlog)
+        .add("flushes", stats.nb_flushes)
+        .add("mean_flush_ms", stats.mean_flush_latency.count() * 1e-6)
+        .add("max_flush_ms", stats.max_flush_latency.count() * 1e-6)
+        .add("max_loop_ms", loop_stats.max_busy_time.count() * 1e-6)
+        .add("stop_ms", stop_time * 1e3);
+      results.push_back(result.str());
+    }
+  }
+  rmdir(directory);
+  return results;
+}
+
+/*
+ * Serial polling compared to one reader thread per device, the daq taking 200us per read
+ * and buffering 8 samples: time samples wait in the daq, its skew between devices, and losses.
+ */
+static std::vector<std::string> benchReaders(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  for (int nb_devices = 1; nb_devices <= config.max_reader_devices; nb_devices *= 4)
+  {
+    for (int is_threaded = 0; is_threaded < 2; ++is_threaded)
+    {
+      SimulatedBackend backend;
+      SimulatedDeviceConfig device_config = getDeviceConfig(false, 1.0);
+      device_config.read_delay = 200e-6;
+      device_config.buffer_size = 8;
+      for (int i = 0; i < nb_devices; ++i)
+        backend.addDevice(device_config);
+
+      OptoforceAcquisition acquisition;
+      if (!acquisition.initDevices(nb_devices, &backend))
+      {
+        std::cerr << "could not connect to the " << nb_devices << " simulated devices" << std::endl;
+        continue;
+      }
+      acquisition.setAcquisitionFrequency(1000);
+      acquisition.setNumberReaderThreads(is_threaded ? nb_devices : 0);
+      acquisition.setAutoStore(false);
+      acquisition.setDesiredNumberSamples((int) (config.duration * 2000) + 1000);
+
+      acquisition.startRecording();
+      boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+      acquisition.stopRecording();
+
+      // the merged recording must come ordered by acquisition instant
+      std::vector<OptoforceAcquisition::MergedSample> merged(4096);
+      unsigned long nb_merged = 0;
+      bool is_ordered = true;
+      boost::chrono::high_resolution_clock::time_point last_time;
+      size_t nb_read;
+      while ((nb_read = acquisition.readMergedSamples(&merged[0], merged.size())) > 0)
+      {
+        for (size_t i = 0; i < nb_read; ++i)
+        {
+          if ((nb_merged + i > 0) && (merged[i].sample.acq_time < last_time))
+            is_ordered = false;
+          last_time = merged[i].sample.acq_time;
+        }
+        nb_merged += nb_read;
+      }
+      acquisition.stopReading();
+
+      std::vector<std::string> serial_numbers;
+      acquisition.getSerialNumbers(serial_numbers);
+      unsigned long nb_delivered = 0;
+      unsigned long nb_lost = acquisition.getNumberDroppedSamples();
+      double latency_sum = 0.0;
+      double latency_min = 0.0;
+      double latency_max = 0.0;
+      double max_latency = 0.0;
+      for (size_t i = 0; i < serial_numbers.size(); ++i)
+      {
+        SimulatedDeviceStats stats;
+        backend.getDeviceStats(serial_numbers[i], stats);
+        nb_delivered += stats.nb_delivered;
+        nb_lost += stats.nb_lost;
+        latency_sum += stats.mean_latency;
+        latency_min = i ? std::min(latency_min, stats.mean_latency) : stats.mean_latency;
+        latency_max = i ? std::max(latency_max, stats.mean_latency) : stats.mean_latency;
+        max_latency = std::max(max_latency, stats.max_latency);
+      }
+
+      JsonObject result;
+      result.add("devices", nb_devices)
+        .add("readers", is_threaded ? nb_devices : 0)
+        .add("mean_latency_ms", latency_sum * 1e3 / nb_devices)
+        .add("max_latency_ms", max_latency * 1e3)
+        .add("skew_ms", (latency_max - latency_min) * 1e3)
+        .add("delivered", nb_delivered)
+        .add("lost", nb_lost)
+        .add("loss_ratio", nb_delivered ? nb_lost / (double) nb_delivered : 0.0)
+        .add("merged", nb_merged)
+        .addRaw("merged_in_order", is_ordered ? "true" : "false");
+      results.push_back(result.str());
+    }
+  }
+  return results;
+}
+
+/*
+ * Timestamp accuracy of the recording, for a device delivering its samples by bursts,
+ * with a jittered transfer, and a sample clock drifting from its nominal rate.
+ * The stamps are compared to the line fitted on them: the residual is the stamping error.
+ * The clock estimation is left to settle during the first half of the recording.
+ */
+static std::vector<std::string> benchTimestamps(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  const int bursts[] = {1, 8, 8};
+  const double jitters[] = {0.0, 2e-3, 2e-3};
+  const double drifts[] = {1.0, 1.0, 1.0005};
+
+  for (size_t c = 0; c < 3; ++c)
+  {
+    SimulatedBackend backend;
+    SimulatedDeviceConfig device_config = getDeviceConfig(false, drifts[c]);
+    device_config.burst_size = bursts[c];
+    device_config.jitter = jitters[c];
+    backend.addDevice(device_config);
+
+    OptoforceAcquisition acquisition;
+    if (!acquisition.initDevices(1, &backend))
+    {
+      std::cerr << "could not connect to the simulated device" << std::endl;
+      continue;
+    }
+    acquisition.setAcquisitionFrequency(config.loop_frequency);
+    acquisition.setAutoStore(false);
+    acquisition.setDesiredNumberSamples((int) (config.duration * 2000) + 1000);
+
+    acquisition.startRecording();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+    acquisition.stopRecording();
+    double estimated_frequency = acquisition.getEstimatedSampleFrequency(0);
+
+    std::vector<StampedSample> samples(acquisition.getRecordCapacity());
+    size_t nb_samples = acquisition.readRecordedSamples(0, samples.empty() ? NULL : &samples[0], samples.size());
+    acquisition.stopReading();
+    if (nb_samples < 2)
+      continue;
+
+    // least squares line time = a + b * index, on times relative to the first stamp,
+    // over the second half of the recording, once the clock estimation settled
+    size_t first = nb_samples / 2;
+    std::vector<double> times(nb_samples);
+    double sum_x = 0.0, sum_t = 0.0, sum_xx = 0.0, sum_xt = 0.0;
+    for (size_t i = first; i < nb_samples; ++i)
+    {
+      times[i] = boost::chrono::duration<double>(samples[i].acq_time - samples[first].acq_time).count();
+      sum_x += i;
+      sum_t += times[i];
+      sum_xx += (double) i * i;
+      sum_xt += i * times[i];
+    }
+    double n = (double) (nb_samples - first);
+    double slope = (n * sum_xt - sum_x * sum_t) / (n * sum_xx - sum_x * sum_x);
+    double intercept = (sum_t - slope * sum_x) / n;
+
+    double residual_sum = 0.0, residual_max = 0.0;
+    double interval_min = 0.0, interval_max = 0.0;
+    for (size_t i = first; i < nb_samples; ++i)
+    {
+      double residual = times[i] - (intercept + slope * i);
+      residual_sum += residual * residual;
+      residual_max = std::max(residual_max, std::fabs(residual));
+      if (i > first)
+      {
+        double interval = times[i] - times[i - 1];
+        interval_min = (i > first + 1) ? std::min(interval_min, interval) : interval;
+        interval_max = (i > first + 1) ? std::max(interval_max, interval) : interval;
+      }
+    }
+
+    JsonObject result;
+    result.add("burst_size", bursts[c])
+      .add("jitter_ms", jitters[c] * 1e3)
+      .add("true_frequency", 1000.0 * drifts[c])
+      .add("estimated_frequency", estimated_frequency)
+      .add("fitted_frequency", 1.0 / slope)
+      .add("samples", (unsigned long) nb_samples)
+      .add("residual_rms_us", std::sqrt(residual_sum / n) * 1e6)
+      .add("residual_max_us", residual_max * 1e6)
+      .add("min_interval_us", interval_min * 1e6)
+      .add("max_interval_us", interval_max * 1e6);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! number of figures a shared memory reader reports
+static const size_t SHM_READER_FIGURES = 6;
+
+/*
+ * Shared memory reader, in a process of its own, polling the latest sample as fast as it can.
+ * It reports through fd: the number of samples seen, the percentiles 50, 99, 99.9 and maximum
+ * of the delay from their publication to their reading, in us, and the mean cost of getLatest, in ns.
+ */
+static void readShm(const std::string & serial_number, double duration, int fd)
+{
+  typedef boost::chrono::high_resolution_clock Clock;
+  double figures[SHM_READER_FIGURES] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ShmSubscriber subscriber;
+  Clock::time_point end = Clock::now() + boost::chrono::milliseconds((int) (duration * 1000) + 1000);
+  while (!subscriber.isAttached() && (Clock::now() < end))
+    if (!subscriber.attach(serial_number))
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+  std::vector<double> latencies;
+  latencies.reserve((size_t) (duration * 2000) + 1000);
+  uint64_t last_index = 0;
+  unsigned long nb_calls = 0;
+  boost::chrono::nanoseconds busy(0);
+  ShmSample sample;
+  end = Clock::now() + boost::chrono::milliseconds((int) (duration * 1000));
+  while (subscriber.isAttached() && (Clock::now() < end))
+  {
+    Clock::time_point start = Clock::now();
+    bool is_read = subscriber.getLatest(sample);
+    Clock::time_point now = Clock::now();
+    busy += now - start;
+    ++nb_calls;
+    if (is_read && (sample.index + 1 != last_index))
+    {
+      int64_t now_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(now.time_since_epoch()).count();
+      latencies.push_back((now_ns - sample.publish_time_ns) * 1e-3);
+      last_index = sample.index + 1;
+    }
+  }
+
+  if (!latencies.empty())
+  {
+    std::sort(latencies.begin(), latencies.end());
+    size_t last = latencies.size() - 1;
+    figures[0] = (double) latencies.size();
+    figures[1] = latencies[last / 2];
+    figures[2] = latencies[(size_t) (last * 0.99)];
+    figures[3] = latencies[(size_t) (last * 0.999)];
+    figures[4] = latencies[last];
+    figures[5] = busy.count() / (double) nb_calls;
+  }
+  if (write(fd, figures, sizeof(figures)) != (ssize_t) sizeof(figures))
+    std::cerr << "could not report the shared memory figures" << std::endl;
+}
+
+//! start readShm in a child process, returning its pid and the pipe read end
+static pid_t startShmReader(const std::string & serial_number, double duration, int & fd)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+    return -1;
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // the attach attempts before the publication starts are not reported
+    std::cerr.rdbuf(NULL);
+    close(fds[0]);
+    readShm(serial_number, duration, fds[1]);
+    _exit(0);
+  }
+  close(fds[1]);
+  fd = fds[0];
+  return pid;
+}
+
+//! figures of the reader started by startShmReader, once it completed
+static bool waitShmReader(pid_t pid, int fd, double * figures)
+{
+  bool is_read = (read(fd, figures, SHM_READER_FIGURES * sizeof(double)) == (ssize_t) (SHM_READER_FIGURES * sizeof(double)));
+  close(fd);
+  waitpid(pid, NULL, 0);
+  return is_read && (figures[0] > 0.0);
+}
+
+/*
+ * Delay for another process to get the latest sample through shared memory, the reader polling.
+ * The samples are published directly at 1 kHz, then by the acquisition of a simulated device,
+ * a batch being published per loop. The delay goes from the publication to the reading.
+ */
+static std::vector<std::string> benchShm(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+
+  for (int is_acquisition = 0; is_acquisition < 2; ++is_acquisition)
+  {
+    SimulatedBackend backend;
+    backend.addDevice(getDeviceConfig(false, 1.0));
+    OptoforceAcquisition acquisition;
+    std::string serial_number = "bench";
+    if (is_acquisition)
+    {
+      if (!acquisition.initDevices(1, &backend))
+      {
+        std::cerr << "could not connect to the simulated device" << std::endl;
+        continue;
+      }
+      std::vector<std::string> serial_numbers;
+      acquisition.getSerialNumbers(serial_numbers);
+      serial_number = serial_numbers[0];
+      acquisition.setAcquisitionFrequency(config.loop_frequency);
+      acquisition.setSharedMemoryPublication(true);
+    }
+
+    // the reader is forked before any thread of this process is started
+    int fd;
+    pid_t pid = startShmReader(serial_number, config.duration, fd);
+    if (pid < 0)
+      continue;
+
+    if (is_acquisition)
+    {
+      acquisition.startReading();
+      boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000) + 200));
+      acquisition.stopReading();
+    }
+    else
+    {
+      ShmPublisher publisher;
+      if (!publisher.open(serial_number, 6, 1000.0))
+      {
+        kill(pid, SIGKILL);
+        close(fd);
+        waitpid(pid, NULL, 0);
+        continue;
+      }
+      StampedSample sample = StampedSample();
+      bench_clock::time_point end = bench_clock::now() + boost::chrono::milliseconds((int) (config.duration * 1000) + 200);
+      for (boost::chrono::high_resolution_clock::time_point deadline = boost::chrono::high_resolution_clock::now();
+           bench_clock::now() < end; )
+      {
+        deadline += boost::chrono::milliseconds(1);
+        boost::this_thread::sleep_until(deadline);
+        sample.acq_time = boost::chrono::high_resolution_clock::now();
+        publisher.publish(&sample, 1);
+      }
+    }
+
+    double figures[SHM_READER_FIGURES];
+    if (!waitShmReader(pid, fd, figures))
+    {
+      std::cerr << "the shared memory reader got no sample" << std::endl;
+      continue;
+    }
+
+    JsonObject result;
+    result.add("publisher", is_acquisition ? "acquisition" : "direct")
+      .add("samples_seen", figures[0])
+      .add("p50_delay_us", figures[1])
+      .add("p99_delay_us", figures[2])
+      .add("p999_delay_us", figures[3])
+      .add("max_delay_us", figures[4])
+      .add("ns_per_get_latest", figures[5]);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! what a stream client measured
+struct StreamClientFigures
+{
+  StreamClientFigures() : nb_received(0), nb_dropped(0), is_evicted(false) {}
+
+  //! delay of each sample from its stamp to its reception, in us
+  std::vector<double> delays_us;
+  unsigned long nb_received;
+  unsigned long nb_dropped;
+  bool is_evicted;
+};
+
+//! stream client, optionally slow, taking consume_us per frame
+static void receiveStream(std::string endpoint, int consume_us, boost::atomic<bool> * is_running,
+                          StreamClientFigures * figures)
+{
+  StreamClient client;
+  if (!client.connect(endpoint))
+    return;
+  std::vector<StreamSample> samples;
+  unsigned long nb_dropped;
+  while (is_running->load() && client.isConnected())
+  {
+    if (!client.receive(samples, nb_dropped, 100))
+      continue;
+    int64_t now_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      boost::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    for (size_t i = 0; i < samples.size(); ++i)
+      figures->delays_us.push_back((now_ns - samples[i].acq_time_ns) * 1e-3);
+    figures->nb_received += samples.size();
+    figures->nb_dropped += nb_dropped;
+    if (consume_us > 0)
+      boost::this_thread::sleep_for(boost::chrono::microseconds(consume_us));
+  }
+  figures->is_evicted = !client.isConnected();
+}
+
+/*
+ * Samples of the simulated devices streamed over loopback, through a Unix socket and TCP,
+ * to 1 and 4 clients, then to a client next to a slow one (50 ms per frame, 1024 samples queued, 16 kB send buffer),
+ * with each overflow policy. The delay goes from the sample stamp to its reception by the client;
+ * the figures are those of the clients keeping up. The slow client is still reading the frames
+ * buffered by the kernel when the bench ends: server_dropped and server_evicted tell the policy applied.
+ */
+static std::vector<std::string> benchStream(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  const char * transports[] = {"unix", "tcp", "tcp", "tcp", "tcp"};
+  const int nb_clients[] = {1, 1, 4, 2, 2};
+  const bool has_slow_client[] = {false, false, false, true, true};
+  const stream_overflow overflows[] = {stream_drop_oldest, stream_drop_oldest, stream_drop_oldest,
+                                       stream_drop_oldest, stream_disconnect};
+
+  for (size_t c = 0; c < 5; ++c)
+  {
+    SimulatedBackend backend;
+    for (int i = 0; i < config.max_devices; ++i)
+      backend.addDevice(getDeviceConfig(false, config.time_scale));
+
+    OptoforceAcquisition acquisition;
+    if (!acquisition.initDevices(config.max_devices, &backend))
+    {
+      std::cerr << "could not connect to the " << config.max_devices << " simulated devices" << std::endl;
+      continue;
+    }
+    acquisition.setAcquisitionFrequency(config.loop_frequency);
+
+    std::string endpoint = (std::string(transports[c]) == "unix") ? "unix:/tmp/optoforce_bench.sock" : "tcp:127.0.0.1:15555";
+    StreamServerConfig server_config;
+    server_config.overflow = overflows[c];
+    if (has_slow_client[c])
+    {
+      server_config.queue_size = 1024;
+      server_config.send_buffer_size = 16384;
+    }
+    StreamServer server;
+    if (!server.start(acquisition, endpoint, server_config))
+      continue;
+
+    boost::atomic<bool> is_running(true);
+    std::vector<StreamClientFigures> figures(nb_clients[c]);
+    boost::thread_group clients;
+    for (int i = 0; i < nb_clients[c]; ++i)
+    {
+      int consume_us = (has_slow_client[c] && (i == nb_clients[c] - 1)) ? 50000 : 0;
+      clients.create_thread(boost::bind(&receiveStream, endpoint, consume_us, &is_running, &figures[i]));
+    }
+
+    acquisition.startReading();
+    bench_clock::time_point start = bench_clock::now();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds((int) (config.duration * 1000)));
+    OptoforceAcquisition::LoopStats stats = acquisition.getLoopStats();
+    acquisition.stopReading();
+    double elapsed = elapsedSince(start);
+    // the last frames are sent within the latency budget
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    is_running = false;
+    clients.join_all();
+    StreamServerStats server_stats = server.getStats();
+    server.stop();
+
+    std::vector<double> delays_us;
+    unsigned long nb_received = 0;
+    unsigned long nb_dropped = 0;
+    int nb_fast = nb_clients[c] - (has_slow_client[c] ? 1 : 0);
+    for (int i = 0; i < nb_fast; ++i)
+    {
+      delays_us.insert(delays_us.end(), figures[i].delays_us.begin(), figures[i].delays_us.end());
+      nb_received += figures[i].nb_received;
+      nb_dropped += figures[i].nb_dropped;
+    }
+    std::sort(delays_us.begin(), delays_us.end());
+    size_t last = delays_us.empty() ? 0 : delays_us.size() - 1;
+
+    JsonObject result;
+    result.add("transport", transports[c])
+      .add("clients", nb_clients[c])
+      .add("slow_client", has_slow_client[c] ? (overflows[c] == stream_disconnect ? "disconnect" : "drop_oldest") : "none")
+      .add("devices", config.max_devices)
+      .add("samples_per_s_per_client", nb_received / elapsed / nb_fast)
+      .add("dropped", nb_dropped)
+      .add("p50_delay_us", delays_us.empty() ? 0.0 : delays_us[last / 2])
+      .add("p99_delay_us", delays_us.empty() ? 0.0 : delays_us[(size_t) (last * 0.99)])
+      .add("p999_delay_us", delays_us.empty() ? 0.0 : delays_us[(size_t) (last * 0.999)])
+      .add("max_delay_us", delays_us.empty() ? 0.0 : delays_us[last]);
+    if (has_slow_client[c])
+    {
+      const StreamClientFigures & slow = figures[nb_clients[c] - 1];
+      result.add("slow_received", slow.nb_received)
+        .add("slow_dropped", slow.nb_dropped)
+        .addRaw("slow_evicted", slow.is_evicted ? "true" : "false");
+    }
+    result.add("server_dropped", server_stats.nb_dropped)
+      .add("server_evicted", server_stats.nb_evicted)
+      .add("loop_mean_us", stats.nb_iterations ? stats.busy_time.count() * 1e-3 / stats.nb_iterations : 0.0)
+      .add("loop_max_us", stats.max_busy_time.count() * 1e-3);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+//! mean and largest of a series of measurements
+struct LatencyFigure
+{
+  LatencyFigure() : sum(0.0), max(0.0), nb(0) {}
+
+  void add(double value)
+  {
+    sum += value;
+    max = nb ? std::max(max, value) : value;
+    ++nb;
+  }
+  double mean() const { return nb ? sum / nb : 0.0; }
+
+  double sum;
+  double max;
+  unsigned long nb;
+};
+
+//! duration from start to end, in us (negative if end is before start)
+static double microsecondsBetween(boost::chrono::high_resolution_clock::time_point start,
+                                  boost::chrono::high_resolution_clock::time_point end)
+{
+  return boost::chrono::duration<double>(end - start).count() * 1e6;
+}
+
+//! wait for a sample of each device, false after timeout_ms
+static bool waitFirstSamples(OptoforceAcquisition & acquisition, size_t nb_devices, int timeout_ms)
+{
+  std::vector<OptoforceAcquisition::LatestSample> samples(nb_devices);
+  bench_clock::time_point end = bench_clock::now() + boost::chrono::milliseconds(timeout_ms);
+  while (bench_clock::now() < end)
+  {
+    acquisition.getLatestSamples(&samples[0], nb_devices);
+    bool is_read = true;
+    for (size_t i = 0; (i < nb_devices) && is_read; ++i)
+      is_read = samples[i].nb_values > 0;
+    if (is_read)
+      return true;
+    boost::this_thread::yield();
+  }
+  return false;
+}
+
+/*
+ * Latency of the reading and recording transitions, on real time devices, from the acquisition
+ * thread or from reader threads. Each cycle starts the reading (until a sample of each device is read),
+ * records 50 ms, stops, and leaves the devices idle 20 ms. The recorded samples are compared to the instants of the startRecording
+ * and stopRecording calls: the gaps tell the precision of the boundaries, missing the samples the
+ * devices produced meanwhile that were not recorded, outside the ones stamped out of the calls.
+ */
+static std::vector<std::string> benchStartStop(const BenchConfig & config)
+{
+  std::vector<std::string> results;
+  const size_t nb_readers[] = {0, 2};
+  int nb_cycles = std::max(10, (int) (config.duration * 10));
+
+  for (size_t c = 0; c < 2; ++c)
+  {
+    SimulatedBackend backend;
+    for (int i = 0; i < config.max_devices; ++i)
+      backend.addDevice(getDeviceConfig(false, 1.0));
+
+    OptoforceAcquisition acquisition;
+    if (!acquisition.initDevices(config.max_devices, &backend))
+    {
+      std::cerr << "could not connect to the " << config.max_devices << " simulated devices" << std::endl;
+      continue;
+    }
+    acquisition.setAcquisitionFrequency(config.loop_frequency);
+    acquisition.setNumberReaderThreads(nb_readers[c]);
+    acquisition.setAutoStore(false);
+    acquisition.setDesiredNumberSamples(10000);
+
+    LatencyFigure start_reading, stop_reading, start_recording, stop_recording, first_gap, last_gap;
+    long nb_missing = 0;
+    unsigned long nb_outside = 0;
+    std::vector<StampedSample> samples(acquisition.getRecordCapacity());
+    for (int cycle = 0; cycle < nb_cycles; ++cycle)
+    {
+      bench_clock::time_point start = bench_clock::now();
+      acquisition.startReading();
+      if (!waitFirstSamples(acquisition, config.max_devices, 1000))
+      {
+        std::cerr << "no sample read after the reading start" << std::endl;
+        acquisition.stopReading();
+        break;
+      }
+      start_reading.add(elapsedSince(start) * 1e6);
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+
+      // the stamps are on the clock of the acquisition
+      boost::chrono::high_resolution_clock::time_point record_start = boost::chrono::high_resolution_clock::now();
+      acquisition.startRecording();
+      start_recording.add(microsecondsBetween(record_start, boost::chrono::high_resolution_clock::now()));
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+      boost::chrono::high_resolution_clock::time_point record_stop = boost::chrono::high_resolution_clock::now();
+      acquisition.stopRecording();
+      stop_recording.add(microsecondsBetween(record_stop, boost::chrono::high_resolution_clock::now()));
+
+      for (int i = 0; i < config.max_devices; ++i)
+      {
+        size_t nb_samples = acquisition.readRecordedSamples(i, &samples[0], samples.size());
+        if (nb_samples == 0)
+          continue;
+        first_gap.add(microsecondsBetween(record_start, samples[0].acq_time));
+        last_gap.add(microsecondsBetween(samples[nb_samples - 1].acq_time, record_stop));
+        for (size_t k = 0; k < nb_samples; ++k)
+          if ((samples[k].acq_time < record_start) || (samples[k].acq_time >= record_stop))
+            ++nb_outside;
+        double produced = boost::chrono::duration<double>(record_stop - record_start).count()
+          * acquisition.getEstimatedSampleFrequency(i);
+        nb_missing += (long) (produced + 0.5) - (long) nb_samples;
+      }
+
+      start = bench_clock::now();
+      acquisition.stopReading();
+      stop_reading.add(elapsedSince(start) * 1e6);
+      // idle devices, so that the next start does not wait for a new sample
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    }
+
+    JsonObject result;
+    result.add("reader_threads", (int) nb_readers[c])
+      .add("devices", config.max_devices)
+      .add("cycles", nb_cycles)
+      .add("start_reading_mean_us", start_reading.mean())
+      .add("start_reading_max_us", start_reading.max)
+      .add("stop_reading_mean_us", stop_reading.mean())
+      .add("stop_reading_max_us", stop_reading.max)
+      .add("start_recording_mean_us", start_recording.mean())
+      .add("stop_recording_mean_us", stop_recording.mean())
+      .add("stop_recording_max_us", stop_recording.max)
+      .add("first_gap_mean_us", first_gap.mean())
+      .add("first_gap_max_us", first_gap.max)
+      .add("last_gap_mean_us", last_gap.mean())
+      .add("last_gap_max_us", last_gap.max)
+      .add("missing_per_recording", (double) nb_missing / (nb_cycles * config.max_devices))
+      .add("outside", nb_outside);
+    results.push_back(result.str());
+  }
+  return results;
+}
+
+int main(int argc, char* argv[])
+{
+  BenchConfig config;
+  std::string scenario;
+  std::string output;
+
+  po::options_description description("optoforce_bench options");
+  description.add_options()
+    ("help,h", "display this help")
+    ("duration,d", po::value<double>(&config.duration)->default_value(1.0), "duration of each measurement, in s")
+    ("max-devices", po::value<int>(&config.max_devices)->default_value(4), "largest number of simulated devices")
+    ("max-consumers", po::value<int>(&config.max_consumers)->default_value(8), "largest number of getData threads")
+    ("max-reader-devices", po::value<int>(&config.max_reader_devices)->default_value(64),
+     "largest number of devices for the reader threads comparison")
+    ("loop-frequency", po::value<int>(&config.loop_frequency)->default_value(1000), "frequency of the acquisition loop, in Hz")
+    ("time-scale", po::value<double>(&config.time_scale)->default_value(10.0), "acceleration of the simulated daq")
+    ("scenario,s", po::value<std::string>(&scenario)->default_value("all"),
+     "driver, loop, contention, subscribe, store, append, csv, codec, seek, replay, writer, readers, timestamps, shm, stream, startstop or all")
+    ("output,o", po::value<std::string>(&output), "JSON file (standard output otherwise)");
+
+  po::variables_map options;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, description), options);
+    po::notify(options);
+  }
+  catch (const po::error & error)
+  {
+    std::cerr << error.what() << std::endl << description << std::endl;
+    return -1;
+  }
+  if (options.count("help"))
+  {
+    std::cout << description << std::endl;
+    return 0;
+  }
+
+  // the library traces are dropped, to keep the output machine-readable
+  std::streambuf * cout_buffer = std::cout.rdbuf(NULL);
+
+  JsonObject report;
+  JsonObject json_config;
+  json_config.add("duration_s", config.duration)
+    .add("max_devices", config.max_devices)
+    .add("max_consumers", config.max_consumers)
+    .add("max_reader_devices", config.max_reader_devices)
+    .add("loop_frequency", config.loop_frequency)
+    .add("time_scale", config.time_scale);
+  report.add("benchmark", "optoforce_bench").addRaw("config", json_config.str());
+
+  if (scenario == "all" || scenario == "driver")
+    report.addRaw("driver_get_data", toJsonArray(benchDriverGetData(config)));
+  if (scenario == "all" || scenario == "loop")
+    report.addRaw("acquisition_loop", toJsonArray(benchAcquisitionLoop(config)));
+  if (scenario == "all" || scenario == "contention")
+    report.addRaw("get_data_contention", toJsonArray(benchGetDataContention(config)));
+  if (scenario == "all" || scenario == "subscribe")
+    report.addRaw("subscriptions", toJsonArray(benchSubscribe(config)));
+  if (scenario == "all" || scenario == "store")
+    report.addRaw("store_data", toJsonArray(benchStoreData(config)));
+  if (scenario == "all" || scenario == "append")
+    report.addRaw("record_append", toJsonArray(benchAppend(config)));
+  if (scenario == "all" || scenario == "csv")
+    report.addRaw("csv_formatting", toJsonArray(benchCsv(config)));
+  if (scenario == "all" || scenario == "codec")
+    report.addRaw("codec", toJsonArray(benchCodec(config)));
+  if (scenario == "all" || scenario == "seek")
+    report.addRaw("window_seek", toJsonArray(benchSeek(config)));
+  if (scenario == "all" || scenario == "replay")
+    report.addRaw("replay", toJsonArray(benchReplay(config)));
+  if (scenario == "all" || scenario == "writer")
+    report.addRaw("background_writer", toJsonArray(benchWriter(config)));
+  if (scenario == "all" || scenario == "readers")
+    report.addRaw("reader_threads", toJsonArray(benchReaders(config)));
+  if (scenario == "all" || scenario == "timestamps")
+    report.addRaw("timestamps", toJsonArray(benchTimestamps(config)));
+  if (scenario == "all" || scenario == "shm")
+    report.addRaw("shared_memory", toJsonArray(benchShm(config)));
+  if (scenario == "all" || scenario == "stream")
+    report.addRaw("stream", toJsonArray(benchStream(config)));
+  if (scenario == "all" || scenario == "startstop")
+    report.addRaw("start_stop", toJsonArray(benchStartStop(config)));
+
+  std::cout.rdbuf(cout_buffer);
+
+  if (output.empty())
+    std::cout << report.str() << std::endl;
+  else
+  {
+    std::ofstream file(output.c_str());
+    file << report.str() << std::endl;
+  }
+  return 0;
+}
@@ -11,11 +11,14 @@
  */
 
 #include <optoforce/optoforce_acquisition.hpp>
+#include <optoforce/optoforce_replay_backend.hpp>
+#include <optoforce/optoforce_stream.hpp>
 #include <signal.h>
 #include <iostream>
 #include "yaml-cpp/yaml.h"
 
 OptoforceAcquisition * force_acquisition;
+StreamServer stream_server;
 
 void my_handler(int s)
 {
@@ -23,6 +26,7 @@ void my_handler(int s)
 
   if (force_acquisition != NULL)
   {
+    stream_server.stop();
     delete force_acquisition;
     force_acquisition = NULL;
   }
@@ -47,6 +51,9 @@ int main(int argc, char* argv[])
 
   int num_samples = -1;
   std::vector<std::string> ldevice;
+  // recordings replayed instead of the connected devices
+  ReplayBackend replay_backend;
+  bool is_replay = false;
   std::vector<std::vector<float> > lcalib;
 
   /****************************************************/
@@ -72,6 +79,48 @@ int main(int argc, char* argv[])
     std::cout <<"num_samples undefined, left to default: " << num_samples << std::endl;
   }
 
+  // file format, binary by default
+  recording_format format = recording_binary;
+  if (baseNode["format"] && (baseNode["format"].as<std::string>() == "csv"))
+    format = recording_csv;
+  if (baseNode["format"] && (baseNode["format"].as<std::string>() == "compressed"))
+    format = recording_compressed;
+  if (baseNode["format"] && (baseNode["format"].as<std::string>() == "columnar"))
+    format = recording_columnar;
+
+  // single file of all devices, none by default
+  merge_output merged = merge_none;
+  double merge_period_ms = 1.0;
+  if (baseNode["merged"] && (baseNode["merged"].as<std::string>() == "events"))
+    merged = merge_events;
+  if (baseNode["merged"] && (baseNode["merged"].as<std::string>() == "hold_last"))
+    merged = merge_hold_last;
+  if (baseNode["merged"] && (baseNode["merged"].as<std::string>() == "nearest"))
+    merged = merge_nearest;
+  if (baseNode["merge_period_ms"])
+    merge_period_ms = baseNode["merge_period_ms"].as<double>();
+
+  // segmentation of the binary recordings, none by default
+  double segment_duration = 0.0;
+  unsigned long long segment_bytes = 0;
+  if (baseNode["segment_duration"])
+    segment_duration = baseNode["segment_duration"].as<double>();
+  if (baseNode["segment_bytes"])
+    segment_bytes = baseNode["segment_bytes"].as<unsigned long long>();
+
+  // publication of the live samples to other processes, none by default
+  bool shm_publish = false;
+  uint32_t shm_history = SHM_HISTORY_SIZE;
+  if (baseNode["shm_publish"])
+    shm_publish = baseNode["shm_publish"].as<bool>();
+  if (baseNode["shm_history"])
+    shm_history = baseNode["shm_history"].as<uint32_t>();
+
+  // streaming of the samples to socket clients, none by default
+  std::string stream_endpoint;
+  if (baseNode["stream"])
+    stream_endpoint = baseNode["stream"].as<std::string>();
+
   int connectedDAQs = baseNode["devices"].size();
   std::cout << "Expecting "<< connectedDAQs << " devices " << std::endl;
 
@@ -96,6 +145,19 @@ int main(int argc, char* argv[])
       std::cout << "]" << std::endl;
 
       lcalib.push_back(calib);
+
+      // the device can be replaced by one of its recordings
+      if (baseNode["devices"][i]["replay"])
+      {
+        ReplayDeviceConfig replay_config;
+        replay_config.filename = baseNode["devices"][i]["replay"].as<std::string>();
+        replay_config.serial_number = device_name;
+        if (baseNode["replay_speed"])
+          replay_config.time_scale = baseNode["replay_speed"].as<double>();
+        std::cout << "[" << i << "].replay = " << replay_config.filename << std::endl;
+        is_config_ok = replay_backend.addDevice(replay_config) && is_config_ok;
+        is_replay = true;
+      }
     }
   }
   catch (...)
@@ -117,7 +179,12 @@ int main(int argc, char* argv[])
   std::cout << "Looking for " << connectedDAQs << " connected DAQ " << std::endl;
   force_acquisition = new OptoforceAcquisition();
 
-  if (!force_acquisition->initDevices(connectedDAQs))
+  if (is_replay && (replay_backend.getNumberDevices() != connectedDAQs))
+  {
+    std::cerr << "Either all the devices or none are to be replayed" << std::endl;
+    return -1;
+  }
+  if (!force_acquisition->initDevices(connectedDAQs, is_replay ? &replay_backend : NULL))
   {
     std::cerr << "Something went wrong during initialization. /n Bye" << std::endl;
     return -1;
@@ -134,8 +201,25 @@ int main(int argc, char* argv[])
     }
   }
 
+  // replayed values are given back with the calibration of their recording
+  for (int i = 0; (i < connectedDAQs) && is_replay; ++i)
+  {
+    RecordingHeader header;
+    replay_backend.getRecordingHeader(ldevice[i], header);
+    std::vector<float> calibration(header.calibration, header.calibration + (header.is_3D_sensor ? 3 : 6));
+    force_acquisition->setDeviceCalibration(ldevice[i], calibration);
+  }
+
   // reordering the devices according to the config order.
 
+  force_acquisition->setRecordingFormat(format);
+  force_acquisition->setSegmentation(segment_duration, segment_bytes);
+  force_acquisition->setMergedOutput(merged, merge_period_ms);
+  force_acquisition->setSharedMemoryPublication(shm_publish, shm_history);
+
+  if (!stream_endpoint.empty() && !stream_server.start(*force_acquisition, stream_endpoint))
+    std::cerr << "could not stream the samples on " << stream_endpoint << std::endl;
+
   force_acquisition->startRecording(num_samples);
 
   while ((force_acquisition != NULL) && force_acquisition->isRecording())
@@ -144,6 +228,7 @@ int main(int argc, char* argv[])
   }
   force_acquisition->storeData();
 
+  stream_server.stop();
   std::cout << "main call delete"<<std::endl;
   delete force_acquisition;
   std::cout << "end main"<<std::endl;
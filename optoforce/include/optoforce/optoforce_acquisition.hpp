@@ -14,8 +14,20 @@
 
 #include "optoforce/optoforce_driver.hpp"
 #include "optoforce/optoforce_array_driver.hpp"
+#include "optoforce/optoforce_clock_model.hpp"
+#include "optoforce/optoforce_csv.hpp"
+#include "optoforce/optoforce_merge.hpp"
+#include "optoforce/optoforce_recording.hpp"
+#include "optoforce/optoforce_chunk_queue.hpp"
+#include "optoforce/optoforce_sample.hpp"
+#include "optoforce/optoforce_scheduler.hpp"
+#include "optoforce/optoforce_seqlock.hpp"
+#include "optoforce/optoforce_shm.hpp"
+#include "optoforce/optoforce_subscription.hpp"
 #include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 #include <boost/date_time.hpp>
 #include <boost/thread/mutex.hpp>
@@ -26,11 +38,55 @@
 class OptoforceAcquisition
 {
 public:
-  //! basic structure used to stored the values provided by the devices
-  struct SampleStamped
+  //! recorded sample, with the device providing it
+  struct MergedSample
   {
-    boost::chrono::high_resolution_clock::time_point acq_time;
-    std::vector<float> sample;
+    //! index of the device, in the recording order
+    size_t device;
+    StampedSample sample;
+  };
+
+  //! latest sample of a device, as read (plain data, copied by SeqlockValue)
+  struct LatestSample
+  {
+    //! forces then torques, the first nb_values being meaningful
+    Wrench6 wrench;
+    //! number of values read (3 or 6), 0 if nothing was read since the reading started
+    uint32_t nb_values;
+    //! instant the sample was read, in ns of the monotonic clock
+    int64_t read_time_ns;
+    //! sample rate of the device, as estimated at that reading
+    double estimated_frequency;
+  };
+
+  //! cost of the acquisition loop, sleeping time excluded
+  struct LoopStats
+  {
+    //! number of iterations done
+    unsigned long nb_iterations;
+    //! time spent in the iterations
+    boost::chrono::nanoseconds busy_time;
+    //! longest iteration
+    boost::chrono::nanoseconds max_busy_time;
+  };
+
+  //! activity of the background writer, storing the recording while it runs
+  struct WriterStats
+  {
+    //! number of samples written to the files
+    unsigned long nb_written;
+    //! number of samples waiting in the recording buffers, at the last pass
+    size_t backlog;
+    //! largest backlog seen
+    size_t max_backlog;
+    //! number of passes that wrote samples
+    unsigned long nb_flushes;
+    //! mean time to drain the buffers and write them, per pass
+    boost::chrono::nanoseconds mean_flush_latency;
+    //! longest pass
+    boost::chrono::nanoseconds max_flush_latency;
+
+    WriterStats();
   };
 
   //! basic constructor
@@ -40,10 +96,11 @@ public:
   /*!
     \brief perform the connection to the devices
     \param nb_device number of devices expected
+    \param backend provider of the daq (not owned), the Optoforce library if NULL
     \return true if it suceeded
     \todo provide other means of initialization, such as specific serial number
    */
-  bool initDevices(const int nb_devices);
+  bool initDevices(const int nb_devices, OptoForceBackend * backend = NULL);
   /*!
     \brief reorder the devices according to a name given
     \param lserial_number ordered name we whish to handle
@@ -56,33 +113,140 @@ public:
   void closeDevices();
   /*!
     \brief Auto store data after acquisition
-    \param
+    \param auto_store if true (default), a background thread writes the samples to the files
+           while recording, with bounded memory and without duration limit.
+           If false, data are kept in memory until the next recording ends, for storeData,
+           the memory growing by chunks with the duration if no number of samples is requested
   */
   void setAutoStore(bool auto_store);
 
   /*!
     \brief launch the recording of data
-    \param num_samples number of reading requested (-1 is unlimited)
+    \param num_samples number of samples to record per device (-1 is unlimited)
+    \note the recording ends by itself once all devices recorded them, as after stopRecording
   */
   bool startRecording(const int num_samples);
   /*!
     \brief launch the recording of data
-    \param num_samples number of reading requested (-1 is unlimited)
+    \note a recording running is stopped first (its files completed with auto store)
+    \note the recording buffers are allocated at the first recording, and reused by the following ones
+    \note with auto store, the files are written while recording, and complete once stopRecording returns
   */
   bool startRecording();
   /*!
     \brief launch the reading of data
     \return true if the operation succeeded
+    \note the acquisition thread is created at the first reading, and waits for the next one in between
   */
   bool startReading();
   /*!
-    \brief acquisition thread
+    \brief reading of the devices, until stopReading
     \param desired_num_samples number of reading requested (-1 is unlimited)
     \param is_debug whether extra information is displayed during acquisition
    */
   void acquireThread(bool is_debug = false);
+  /*!
+    \brief set how the devices are polled, taken into account at next startReading
+    \param nb_threads 0 to poll all devices one after the other from the acquisition thread,
+           otherwise number of reader threads sharing the devices (one per device at most)
+   */
+  void setNumberReaderThreads(size_t nb_threads);
 
+  /*!
+    \brief get the latest sample of each device, without waiting for the acquisition
+    \param latest_samples receives one vector per device, empty if nothing was read yet.
+           Reusing the same vector from one call to the other, nothing is allocated
+   */
   void getData(std::vector< std::vector<float> > &latest_samples);
+  /*!
+    \brief get the latest sample of each device, without lock nor allocation
+    \param samples receives the samples, in the recording order
+    \param capacity number of samples that can be received
+    \return number of samples got, one per device (up to capacity)
+    \note the devices are set by startReading: this is not to be called concurrently with it
+   */
+  size_t getLatestSamples(LatestSample * samples, size_t capacity) const;
+  /*!
+    \brief have the samples read delivered to a callback, by batch, none being missed unless it overruns
+    \param callback function receiving the batches of samples, stamped as recorded
+    \param device index of the device followed, in the recording order, -1 for all devices
+    \param mode dispatch_inline to call it from the thread reading the device, without copy,
+           or dispatch_executor to call it from a thread of its own, through a queue per device
+    \param queue_size number of samples queued per device, with dispatch_executor
+    \return identifier of the subscription, -1 if the device is not known
+    \note the devices are to be initialized. Neither subscribe nor unsubscribe are to be called from a callback
+   */
+  int subscribe(const SampleCallback & callback, int device = -1, dispatch_mode mode = dispatch_inline,
+                size_t queue_size = SUBSCRIPTION_QUEUE_SIZE);
+  /*!
+    \brief stop a subscription, once its queued samples are delivered
+    \param id identifier returned by subscribe
+    \return false if no such subscription exists
+   */
+  bool unsubscribe(int id);
+  /*!
+    \brief get the overruns of a subscription, see SampleSubscription::getNumberOverruns
+    \param id identifier returned by subscribe
+    \return samples dropped (executor), or callbacks longer than the acquisition period (inline)
+   */
+  unsigned long getNumberOverruns(int id);
+  /*!
+    \brief get the sample rate of a device, as estimated from the readings
+    \param device index of the device, in the recording order
+    \return estimated number of samples per second, 0 if not estimated yet
+   */
+  double getEstimatedSampleFrequency(size_t device);
+
+  /*!
+    \brief get the cost of the acquisition loop
+    \return statistics since the reading started (or since last reset)
+   */
+  LoopStats getLoopStats();
+  //! restart the acquisition loop statistics
+  void resetLoopStats();
+  /*!
+    \brief get the wakeup statistics of the polling threads
+    \return lateness and missed deadlines, over all polling threads, since the reading started
+   */
+  SchedulerStats getSchedulerStats();
+  //! restart the wakeup statistics
+  void resetSchedulerStats();
+
+  /*!
+    \brief get the samples recorded for a device, while the acquisition continues
+    \param device index of the device, in the recording order
+    \param samples receives the samples, oldest first
+    \param capacity maximum number of samples to get
+    \return number of samples got, removed from the recording buffer
+    \warning a single thread can drain the recording: not to be mixed with storeData
+   */
+  size_t readRecordedSamples(size_t device, StampedSample * samples, size_t capacity);
+  /*!
+    \brief get the samples recorded for all devices, ordered by acquisition instant
+    \param samples receives the samples, oldest first
+    \param capacity maximum number of samples to get
+    \return number of samples got, removed from the recording buffers
+    \note while recording, a sample is only provided once all devices provided a later sample,
+           or were polled empty since, minus a 50 ms delivery lateness. A sample delivered later
+           than that is provided afterwards, out of order (see getNumberLateMergedSamples)
+    \warning a single thread can drain the recording: not to be mixed with readRecordedSamples
+   */
+  size_t readMergedSamples(MergedSample * samples, size_t capacity);
+  /*!
+    \brief number of samples a recording buffer can hold, per device
+    \return with auto store, the buffer size of the background writer,
+            otherwise the desired number of samples, or 0 if unlimited
+   */
+  size_t getRecordCapacity() const;
+  //! number of samples lost since the recording start, a recording buffer being full
+  unsigned long getNumberDroppedSamples();
+  //! number of samples merged out of order since the recording start, delivered too late by their device
+  unsigned long getNumberLateMergedSamples();
+  /*!
+    \brief get the activity of the background writer
+    \return statistics since the recording start
+   */
+  WriterStats getWriterStats();
 
   //! Get Serial numbers of connected deviced
   void getSerialNumbers(std::vector<std::string> &serial_numbers);
@@ -104,17 +268,20 @@ public:
   /*!
     \brief request the stop of the recording
     \return true if the operation succeeded, false otherwise
+    \note the samples recorded are those stamped between the startRecording and stopRecording calls
     \warning blocking until the acquisition is effectively blocked
   */
   bool stopRecording();
   /*!
-    \brief request the stop of the reading
+    \brief request the stop of the reading, and wait for the acquisition thread to complete it
     \return true if the operation succeeded, false otherwise
+    \note a recording running is ended with the reading
   */
   bool stopReading();
   /*!
     \brief store the data previously recorded
     \return true if the operation succeeded
+    \note the data stored are removed from the recording buffers
    */
   bool storeData();
 
@@ -122,6 +289,45 @@ public:
     \brief set filename to store data
    */
   void setFilename(std::string filename);
+  /*!
+    \brief set the format of the files stored
+    \param format recording_binary (default, converted by optoforce_export_csv), recording_compressed
+           (same file, the raw counts being stored losslessly as deltas), recording_columnar
+           (same file, by chunks of one column per axis with their statistics, see optoforce_query)
+           or recording_csv
+   */
+  void setRecordingFormat(recording_format format);
+  /*!
+    \brief set the number of decimals of the csv files
+    \param time_decimals decimals of the time, in ms (3 by default)
+    \param value_decimals decimals of the forces and torques (4 by default)
+   */
+  void setCsvPrecision(unsigned int time_decimals, unsigned int value_decimals);
+  /*!
+    \brief store all devices in a single csv file, merged in time order, instead of one file per device
+    \param mode merge_none (default) for one file per device, merge_events for one row per sample,
+           merge_hold_last or merge_nearest for one row per tick of a common timeline (see MergedCsvWriter)
+    \param period_ms period of the timeline, in ms
+    \note the file is named <filename>_<date>_merged_forces.csv. While recording, a sample is only written
+          once every device provided a later one, so that the memory used stays bounded
+   */
+  void setMergedOutput(merge_output mode, double period_ms = 1.0);
+  /*!
+    \brief split the binary recordings into segments, each file being preallocated on disk
+    \param duration_s time covered by a segment, in s (0 for no limit)
+    \param max_bytes largest size of a segment file, in bytes (0 for no limit). The records not yet
+           compressed are counted at their full size, so that compressed segments stay below it
+    \note segments are named <filename>_<serial>_<date>_forces_<index>.opto, and listed with their
+          time ranges in <filename>_<serial>_<date>_forces.manifest. Csv recordings are not split.
+   */
+  void setSegmentation(double duration_s, unsigned long long max_bytes);
+  /*!
+    \brief publish the samples read in shared memory, for other processes (see ShmSubscriber)
+    \param is_published whether the samples are published, from the next startReading
+    \param history_size number of samples kept per device (at least 2)
+    \note each device is published in /dev/shm/optoforce_<serial>, as long as the reading runs
+   */
+  void setSharedMemoryPublication(bool is_published, uint32_t history_size = SHM_HISTORY_SIZE);
 
   /*!
     \brief to set the calibration data of a device
@@ -159,23 +365,208 @@ public:
     \brief Set Acquisition Frequency
     \param  freq acquisition frequency in Hz.
             This frequency determines how often we get a new data. Independently from Sensor Transmission Rate
+    \note the polling is done on absolute deadlines, so that any frequency can be used
    */
   void setAcquisitionFrequency(int freq);
 
   /*!
     \brief Set Desired Number Samples
+    \param desired_num_samples number of samples to record per device (-1 is unlimited):
+           the next recordings end by themselves once all devices recorded them
   */
   void setDesiredNumberSamples(int desired_num_samples);
 
 private:
+  //! reading state of a device
+  struct DeviceRecord
+  {
+    //! values read, allocated at the reading start
+    std::vector<Wrench6> buffered_values;
+    //! values read, stamped, before being pushed to the recording buffer
+    std::vector<StampedSample> stamped_values;
+    //! whether the next reading is the first one of the recording
+    bool is_first;
+    //! whether time_last_stamp is set, a sample being stamped since the reading started
+    bool has_stamp;
+    //! number of samples recorded
+    size_t nb_recorded;
+    //! instant of the first recording
+    boost::chrono::high_resolution_clock::time_point time_start;
+    //! instant of the last recording
+    boost::chrono::high_resolution_clock::time_point time_last;
+    //! instant given to the last sample recorded, stamps being strictly increasing
+    boost::chrono::high_resolution_clock::time_point time_last_stamp;
+    //! stamp (ns) the merge can go on up to, the device not providing older samples anymore
+    int64_t merge_watermark_ns;
+    //! sample clock of the device, estimated from the readings
+    ClockModel clock_model;
+    //! number of samples the device produced since the reading started, lost ones included
+    unsigned long long nb_received;
+    //! overflows reported by the driver, so that the lost samples are skipped
+    unsigned long nb_overflows;
+    //! sample rate changes accounted in clock_model
+    unsigned long nb_speed_changes;
+
+    DeviceRecord() : is_first(true), has_stamp(false), nb_recorded(0), nb_received(0), nb_overflows(0), nb_speed_changes(0) {}
+  };
+
+  //! samples a device read records: those stamped from start (included) to stop (excluded)
+  struct RecordWindow
+  {
+    //! whether a recording is running
+    bool is_recording;
+    //! instant startRecording was called
+    boost::chrono::high_resolution_clock::time_point start;
+    //! instant stopRecording was called, time_point::max() until then
+    boost::chrono::high_resolution_clock::time_point stop;
+  };
+
+  //! persistent acquisition thread, running acquireThread at each reading start
+  void workerThread();
+  //! samples to record, for the pass to come
+  RecordWindow getRecordWindow();
+
+  /*!
+    \brief reader thread, polling a subset of the devices
+    \param reader_index index of the reader, polling the devices reader_index + k * nb_readers
+    \param nb_readers number of readers
+    \param is_debug whether extra information is displayed during acquisition
+   */
+  void readerThread(size_t reader_index, size_t nb_readers, bool is_debug);
+  /*!
+    \brief read the samples of a device, and record them if requested
+    \param i index of the device in devices_recorded_
+    \param window samples to be recorded
+    \param is_debug whether extra information is displayed during acquisition
+   */
+  void readDevice(size_t i, const RecordWindow & window, bool is_debug);
+  /*!
+    \brief get the samples recorded for all devices, ordered by acquisition instant
+    \param samples receives the samples, oldest first
+    \param capacity maximum number of samples to get
+    \param is_complete whether no sample can be recorded anymore, so that the devices with
+           an empty buffer can be left aside. Otherwise, the samples are got up to the merge
+           watermark of the devices with an empty buffer
+    \return number of samples got, removed from the recording buffers
+   */
+  size_t mergeRecordedSamples(MergedSample * samples, size_t capacity, bool is_complete);
+  //! account an acquisition loop iteration
+  void updateLoopStats(boost::chrono::nanoseconds loop_duration);
+  //! end the recording from the acquisition, without waiting for it (see stopRecording)
+  void requestRecordingEnd();
+  //! write the content of the recording buffers in files, one per device
+  bool writeRecordedData();
+  //! background writer, draining the recording buffers to the files while recording
+  void writerThread();
+
+  //! file receiving the recording of a device
+  struct RecordFile
+  {
+    //! writer of a binary recording
+    RecordingWriter writer;
+    //! writer of a csv recording
+    CsvWriter csv;
+    //! path of the file, without extension nor segment index
+    std::string name_file;
+    //! header of the binary recording, shared by its segments
+    RecordingHeader header;
+    //! segments completed, with segmentation
+    std::vector<RecordingSegment> segments;
+    //! time range of the segment being written, in ns from time zero
+    int64_t first_time_ns;
+    int64_t last_time_ns;
+  };
+  /*!
+    \brief create the file of a device, in the format selected
+    \param i index of the device in devices_recorded_
+    \param name_file path of the file, without extension
+    \param time_zero instant taken as the origin of the sample times
+    \param file file created
+    \return true if the file could be created
+   */
+  bool openRecordFile(size_t i, const std::string & name_file,
+                      boost::chrono::high_resolution_clock::time_point time_zero,
+                      RecordFile & file);
+  /*!
+    \brief move the samples of a recording buffer to its file
+    \param i index of the device in devices_recorded_
+    \param time_zero instant taken as the origin of the sample times
+    \param file file of the device
+    \param samples storage for the transfer
+    \param nb_written increased by the number of samples moved
+    \return false on write error
+   */
+  bool drainRecordFile(size_t i, boost::chrono::high_resolution_clock::time_point time_zero,
+                       RecordFile & file, std::vector<StampedSample> & samples,
+                       unsigned long & nb_written);
+  //! close the file of a device, false on write error
+  bool closeRecordFile(RecordFile & file);
+  //! name of the merged file, without extension
+  std::string getMergedFileName(const boost::posix_time::ptime & posix_time);
+  //! create the merged file of all devices, false if it could not be created
+  bool openMergedFile(const std::string & name_file, MergedCsvWriter & file);
+  /*!
+    \brief move the samples of the recording buffers to the merged file, in time order
+    \param time_zero instant taken as the origin of the sample times
+    \param file merged file
+    \param samples storage for the transfer
+    \param is_complete whether no sample can be recorded anymore
+    \param nb_written increased by the number of samples moved
+    \return false on write error
+   */
+  bool drainMergedFile(boost::chrono::high_resolution_clock::time_point time_zero,
+                       MergedCsvWriter & file, std::vector<MergedSample> & samples,
+                       bool is_complete, unsigned long & nb_written);
+  //! whether the binary recordings are split into segments
+  bool isSegmented() const;
+  //! create the next segment of a segmented recording, false if it could not be created
+  bool openRecordSegment(RecordFile & file);
+  //! close the segment being written, and list it in the manifest, false on write error
+  bool closeRecordSegment(RecordFile & file);
+  //! name of the file of a device, without extension
+  std::string getRecordFileName(size_t i, const boost::posix_time::ptime & posix_time);
+
   //! enumerator of available devices
   OptoForceArrayDriver * device_enumerator_;
   //! list of connected devices
   std::vector<OptoForceDriver *> devices_;
   //! list of devices recorded
   std::vector<OptoForceDriver *> devices_recorded_;
-  //! list of values read per connected devices (couldn't we define a structure for the values rea, or reuse the initial one?)
-  std::vector<std::vector<SampleStamped> > data_acquired_;
+  //! samples recorded per device, filled by the acquisition thread
+  std::vector< boost::shared_ptr< SpscChunkQueue<StampedSample> > > record_queues_;
+  //! instant of the first sample recorded
+  boost::chrono::high_resolution_clock::time_point record_time_zero_;
+  //! number of samples lost, a recording buffer being full
+  unsigned long nb_dropped_samples_;
+  //! number of devices that recorded desired_num_samples_ samples
+  boost::atomic<size_t> nb_devices_complete_;
+  //! whether record_time_zero_ is set for the current recording
+  bool is_time_zero_set_;
+  //! reading state per device
+  std::vector<DeviceRecord> device_records_;
+  //! held (shared) by the device reads, (exclusive) to end a recording
+  boost::shared_mutex record_mutex_;
+  //! number of reader threads, 0 for polling from the acquisition thread
+  size_t nb_reader_threads_;
+  //! next sample of each device, for the merged reading
+  std::vector<StampedSample> merge_heads_;
+  //! whether merge_heads_ holds a sample, per device
+  std::vector<bool> has_merge_head_;
+  //! per device, merge_watermark_ns of its record, set once the older samples are pushed:
+  //! an empty device only holds the merge back up to it (one per record_queues_, changed with them)
+  boost::scoped_array< boost::atomic<int64_t> > merge_watermarks_;
+  //! whether the recording is merged (merged output, or readMergedSamples called):
+  //! the devices polled empty then move their merge watermark forward
+  boost::atomic<bool> is_merging_;
+  //! stamp (ns) of the last sample merged
+  int64_t merge_last_ns_;
+  //! number of samples merged after a later one, since the recording start
+  boost::atomic<unsigned long> nb_late_merged_;
+  //! periodic wakeups of the polling threads
+  std::vector< boost::shared_ptr<DeadlineScheduler> > schedulers_;
+  //! periodic wakeups of the acquisition thread (schedulers_[0] without reader threads),
+  //! interrupted on the stop requests
+  boost::shared_ptr<DeadlineScheduler> acquire_scheduler_;
   //! whether or not is being recording data
   bool is_recording_;
   //! whether or not is being reading data
@@ -186,31 +577,69 @@ private:
   bool is_stop_reading_request_;
   //! whether or not a recording start is requested
   bool is_start_recording_request_;
+  //! whether the acquisition thread is to start a reading
+  bool is_start_reading_request_;
+  //! whether the acquisition thread is to end
+  bool is_exit_request_;
+  //! instant of the recording start request, first stamp recorded
+  boost::chrono::high_resolution_clock::time_point record_start_time_;
+  //! instant of the recording stop request, stamps recorded being before it
+  boost::chrono::high_resolution_clock::time_point record_stop_time_;
   //! to access to critical data shared in multi-threads
   boost::mutex mutex_;
+  //! notified (under mutex_) at each change of the requests and of the reading / recording states
+  boost::condition_variable state_changed_;
 
-  //! to access to critical data shared in multi-threads
-  boost::mutex mutex_sample_;
-
-  //! acquisition thread;
-  //boost::thread* thread_acq_;
+  //! acquisition thread, kept from one reading to the other
   boost::shared_ptr<boost::thread> thread_acq_;
 
   //! desired number of samples to be read from sensor
   int desired_num_samples_;
   //! current sample number
   size_t num_samples_;
-  //! maximum number of samples
-  const int max_num_samples_;
   //! acquisition frequency
   int acquisition_freq_;
   //! filename of the stored data
   std::string filename_;
+  //! format of the stored data
+  recording_format recording_format_;
+  //! decimals of the time in the csv files
+  unsigned int csv_time_decimals_;
+  //! decimals of the values in the csv files
+  unsigned int csv_value_decimals_;
+  //! layout of the merged file, merge_none for one file per device
+  merge_output merge_output_;
+  //! period of the timeline of the merged file, in ns
+  int64_t merge_period_ns_;
+  //! time covered by a segment of the binary recordings, in ns (0 for no limit)
+  int64_t segment_duration_ns_;
+  //! size of a segment file, in bytes (0 for no limit)
+  unsigned long long segment_max_bytes_;
+  //! whether the samples read are published in shared memory
+  bool shm_publication_;
+  //! number of samples kept per device in shared memory
+  uint32_t shm_history_size_;
+  //! shared memory publication per device, while reading
+  std::vector< boost::shared_ptr<ShmPublisher> > shm_publishers_;
+  //! subscriptions to the samples read, changed under record_mutex_ (exclusive)
+  std::vector< std::pair<int, boost::shared_ptr<SampleSubscription> > > subscriptions_;
+  //! identifier of the next subscription
+  int next_subscription_id_;
+  //! background writer of the recording, when auto storing
+  boost::shared_ptr<boost::thread> thread_writer_;
+  //! whether the writer has to store the remaining samples and close the files
+  bool is_stop_writing_request_;
+  //! activity of the background writer
+  WriterStats writer_stats_;
   //! Flag to indicate auto store data in a file after theacquisition finishes
   bool auto_store_;
 
-  //! last sensor data
-  std::vector< std::vector<float> > latest_samples_;
+  //! latest sample per device, written by the thread reading it
+  std::vector< boost::shared_ptr< SeqlockValue<LatestSample> > > latest_samples_;
+  //! number of sample rate changes requested
+  boost::atomic<unsigned long> nb_speed_changes_;
+  //! cost of the acquisition loop
+  LoopStats loop_stats_;
 
 };
 
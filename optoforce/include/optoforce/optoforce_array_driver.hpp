@@ -13,6 +13,7 @@
 #pragma once
 #include <vector>
 #include "omd/optoports.h"
+#include "optoforce/optoforce_backend.hpp"
 /*!
   \class OptoForceArrayDriver Enabling the listing of connected optoforce daqs
  */
@@ -24,10 +25,12 @@ public:
   /*!
     \brief constructor with a given number of expected daq
     \param p_portCount number of expected connected daq
+    \param p_enumerator listing of the daq to use, deleted with the driver.
+           Per default, the Optoforce library is used (see OmdPortEnumerator)
     \warning the value given is only stored, not yet used
     \todo remove that input parameter
   */
-  OptoForceArrayDriver(int p_portCount);
+  OptoForceArrayDriver(int p_portCount, OptoForcePortEnumerator * p_enumerator = NULL);
   //! basic destructor (todo: why virtual?)
   virtual ~OptoForceArrayDriver();
   //! get the list of connected daq
@@ -42,8 +45,8 @@ public:
   */
   bool WaitUntilPortsFound(unsigned long p_timeOut);
 protected:
-  //! connected port enumarator (from Optforce API)
-  OptoPorts * m_PortEnumerator;
+  //! connected port enumarator
+  OptoForcePortEnumerator * m_PortEnumerator;
   //! desired number of connected ports
   int m_PortCount;
 };
@@ -0,0 +1,111 @@
+/**
+ * @file   optoforce_backend.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Interfaces to the daq handled by the drivers.
+ *        The default implementation relies on the Optoforce library (see optoforce_omd_backend.hpp),
+ *        others enable using the drivers without any physical sensor.
+ */
+
+#ifndef OPTOFORCE_BACKEND_HPP
+#define OPTOFORCE_BACKEND_HPP
+
+#include <vector>
+#include <cstddef>
+#include "omd/optoports.h"
+#include "omd/optopackage.h"
+#include "omd/sensorconfig.h"
+
+/*!
+  \struct RawCounts
+  \brief location of the raw counts read from a daq, for all its channels.
+         The axes of a sample are consecutive ints.
+ */
+struct RawCounts
+{
+  //! counts of the first axis of the first sample of the first channel
+  const int * data;
+  //! number of ints between two consecutive samples of a channel
+  size_t sample_stride;
+  //! number of ints between the first samples of two consecutive channels
+  size_t channel_stride;
+};
+
+/*!
+  \class OptoForceDaq
+  \brief communication with a single daq (equivalent to OptoDAQ)
+ */
+class OptoForceDaq
+{
+public:
+  virtual ~OptoForceDaq() {}
+  /*!
+    \brief open the connection with a daq
+    \param port port of the daq, as listed by the OptoForcePortEnumerator
+    \return true if the daq could be opened
+   */
+  virtual bool open(const OPort & port) = 0;
+  //! close the connection
+  virtual void close() = 0;
+  //! whether the connection is active
+  virtual bool isOpen() = 0;
+  //! version of the daq, from which the sensor type is deduced
+  virtual opto_version getVersion() = 0;
+  //! number of sensors connected to the daq
+  virtual int getSensorSize() = 0;
+  //! current configuration of the daq
+  virtual SensorConfig getConfig() = 0;
+  //! send a new configuration to the daq
+  virtual bool sendConfig(const SensorConfig & config) = 0;
+  //! set zero of a given sensor
+  virtual bool zero(int number) = 0;
+  //! set zero of all sensors
+  virtual void zeroAll() = 0;
+  /*!
+    \brief read all the samples buffered since the previous read, for all the channels.
+           The buffer of the daq is cleared.
+    \param counts location of the counts read, valid until the next read
+    \return number of samples per channel, -1 if the buffer is full, -2 if the daq is closed
+   */
+  virtual int readAll(RawCounts & counts) = 0;
+  /*!
+    \brief heap allocations done so far to stage the data read
+    \param nb_allocations number of (re)allocations
+    \param nb_bytes number of bytes (re)allocated
+   */
+  virtual void getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const = 0;
+};
+
+/*!
+  \class OptoForcePortEnumerator
+  \brief listing of the connected daq (equivalent to OptoPorts)
+ */
+class OptoForcePortEnumerator
+{
+public:
+  virtual ~OptoForcePortEnumerator() {}
+  //! number of daq connected
+  virtual int getSize() = 0;
+  //! ports of the daq connected
+  virtual std::vector<OPort> listPorts() = 0;
+};
+
+/*!
+  \class OptoForceBackend
+  \brief creation of the port enumerator and of the daq of a given implementation
+ */
+class OptoForceBackend
+{
+public:
+  virtual ~OptoForceBackend() {}
+  //! create an enumerator, to be deleted by the caller
+  virtual OptoForcePortEnumerator * createPortEnumerator() = 0;
+  //! create a daq handler, to be deleted by the caller
+  virtual OptoForceDaq * createDaq() = 0;
+};
+
+#endif // OPTOFORCE_BACKEND_HPP
@@ -0,0 +1,62 @@
+/**
+ * @file   optoforce_calibration.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Conversion of batches of raw sensor counts into calibrated values.
+ *        Vectorized implementations are selected at runtime, according to the cpu.
+ */
+
+#ifndef OPTOFORCE_CALIBRATION_HPP
+#define OPTOFORCE_CALIBRATION_HPP
+
+#include <cstddef>
+
+//! implementations available for the conversion
+enum calibration_kernel { kernel_scalar = 0, kernel_sse2, kernel_avx2 };
+
+/*!
+  \brief fastest implementation supported by the cpu running the program
+  \return the kernel used by default by calibrateCounts
+ */
+calibration_kernel getCalibrationKernel();
+
+/*!
+  \brief name of a kernel, for display
+ */
+const char * getCalibrationKernelName(calibration_kernel kernel);
+
+/*!
+  \brief check whether a kernel can be used on the cpu running the program
+ */
+bool isCalibrationKernelSupported(calibration_kernel kernel);
+
+/*!
+  \brief convert a batch of raw counts into calibrated values, in a single pass
+  \param raw counts of the first axis of the first sample (e.g. &package6d[0].Fx).
+         The axes of a sample are expected to be consecutive ints
+  \param raw_stride number of ints between two consecutive samples
+         (sizeof(OptoPackage6D) / sizeof(int) for an array of OptoPackage6D)
+  \param nb_samples number of samples to convert
+  \param factor calibration factor of each axis
+  \param nb_axes number of axes per sample (3 or 6)
+  \param output one array per axis, receiving the converted samples
+         (structure of arrays): output[axis][sample] = raw[sample][axis] * factor[axis]
+ */
+void calibrateCounts(const int * raw, size_t raw_stride, size_t nb_samples,
+                     const float * factor, size_t nb_axes,
+                     float * const * output);
+
+/*!
+  \brief same as calibrateCounts, with an imposed implementation
+  \warning the kernel must be supported by the cpu (see isCalibrationKernelSupported)
+ */
+void calibrateCounts(calibration_kernel kernel,
+                     const int * raw, size_t raw_stride, size_t nb_samples,
+                     const float * factor, size_t nb_axes,
+                     float * const * output);
+
+#endif // OPTOFORCE_CALIBRATION_HPP
@@ -0,0 +1,245 @@
+/**
+ * @file   optoforce_chunk_queue.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Lock-free queue made of fixed-size chunks, with one producer and one consumer thread.
+ *        It grows by whole chunks taken from a pool, without moving the items stored.
+ */
+
+#ifndef OPTOFORCE_CHUNK_QUEUE_HPP
+#define OPTOFORCE_CHUNK_QUEUE_HPP
+
+#include "optoforce/optoforce_ring.hpp"
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <boost/atomic.hpp>
+
+/*!
+  \class SpscChunkQueue
+  \brief FIFO shared between a single producer and a single consumer, optionally without capacity limit
+
+  The items are stored in a linked list of chunks. The producer fills the last chunk, and links a new one
+  once it is full. The chunks emptied by the consumer go back to a pool, where the producer takes them
+  first: appending is O(1), and never copies the items already stored.
+  \warning push is to be called by one thread only, pop and size by another one
+ */
+template <typename T>
+class SpscChunkQueue
+{
+public:
+  /*!
+    \brief constructor
+    \param capacity maximum number of items stored, 0 for no limit
+    \param chunk_size number of items per chunk (at least 1)
+   */
+  explicit SpscChunkQueue(size_t capacity, size_t chunk_size = 4096)
+    : capacity_(capacity),
+      chunk_size_(std::max(chunk_size, (size_t) 1)),
+      // the pool keeps enough chunks for a full queue, or 64 of them without limit
+      pool_(capacity ? capacity / std::max(chunk_size, (size_t) 1) + 2 : 64),
+      nb_allocations_(0),
+      head_(0),
+      tail_(0)
+  {
+    write_chunk_ = read_chunk_ = newChunk();
+    write_index_ = read_index_ = 0;
+  }
+
+  //! destructor, freeing the chunks
+  ~SpscChunkQueue()
+  {
+    while (read_chunk_ != NULL)
+    {
+      Chunk * next = read_chunk_->next.load(boost::memory_order_relaxed);
+      delete read_chunk_;
+      read_chunk_ = next;
+    }
+    Chunk * chunk;
+    while (pool_.pop(chunk))
+      delete chunk;
+  }
+
+  //! maximum number of items stored, 0 for no limit
+  size_t capacity() const
+  {
+    return capacity_;
+  }
+
+  //! number of items available, as seen by the calling thread
+  size_t size() const
+  {
+    return head_.load(boost::memory_order_acquire) - tail_.load(boost::memory_order_acquire);
+  }
+
+  //! number of chunks allocated since the construction
+  unsigned long getNumberAllocations() const
+  {
+    return nb_allocations_.load(boost::memory_order_relaxed);
+  }
+
+  /*!
+    \brief fill the pool, so that the producer does not allocate before nb_items are stored
+    \param nb_items number of items the queue is to hold without allocating
+    \warning neither the producer nor the consumer should be active
+   */
+  void reserve(size_t nb_items)
+  {
+    size_t nb_chunks = std::min(nb_items / chunk_size_ + 1, pool_.capacity());
+    while (pool_.size() < nb_chunks)
+      pool_.push(newChunk());
+  }
+
+  /*!
+    \brief add items (producer side)
+    \param items items to add, oldest first
+    \param nb_items number of items to add
+    \return number of items added, less than nb_items if the capacity is reached
+   */
+  size_t push(const T * items, size_t nb_items)
+  {
+    size_t head = head_.load(boost::memory_order_relaxed);
+    size_t nb_pushed = nb_items;
+    if (capacity_ > 0)
+      nb_pushed = std::min(nb_items, capacity_ - (head - tail_.load(boost::memory_order_acquire)));
+
+    for (size_t nb_copied = 0; nb_copied < nb_pushed; )
+    {
+      if (write_index_ == chunk_size_)
+      {
+        // the consumer only follows the link once the items of the new chunk are published
+        Chunk * chunk;
+        if (!pool_.pop(chunk))
+          chunk = newChunk();
+        chunk->next.store(NULL, boost::memory_order_relaxed);
+        write_chunk_->next.store(chunk, boost::memory_order_relaxed);
+        write_chunk_ = chunk;
+        write_index_ = 0;
+      }
+      size_t nb_copy = std::min(nb_pushed - nb_copied, chunk_size_ - write_index_);
+      std::copy(items + nb_copied, items + nb_copied + nb_copy, write_chunk_->items.begin() + write_index_);
+      write_index_ += nb_copy;
+      nb_copied += nb_copy;
+    }
+
+    head_.store(head + nb_pushed, boost::memory_order_release);
+    return nb_pushed;
+  }
+
+  //! add one item (producer side), false if the capacity is reached
+  bool push(const T & item)
+  {
+    return push(&item, 1) == 1;
+  }
+
+  /*!
+    \brief remove the oldest items (consumer side)
+    \param items receives the items, oldest first
+    \param max_items maximum number of items to remove
+    \return number of items removed
+   */
+  size_t pop(T * items, size_t max_items)
+  {
+    size_t tail = tail_.load(boost::memory_order_relaxed);
+    size_t head = head_.load(boost::memory_order_acquire);
+    size_t nb_popped = std::min(max_items, head - tail);
+
+    for (size_t nb_copied = 0; nb_copied < nb_popped; )
+    {
+      if (read_index_ == chunk_size_)
+      {
+        // items remain: the producer moved to the next chunk, this one can be reused
+        Chunk * chunk = read_chunk_;
+        read_chunk_ = chunk->next.load(boost::memory_order_relaxed);
+        read_index_ = 0;
+        if (!pool_.push(chunk))
+          delete chunk;
+      }
+      size_t nb_copy = std::min(nb_popped - nb_copied, chunk_size_ - read_index_);
+      typename std::vector<T>::const_iterator start = read_chunk_->items.begin() + read_index_;
+      std::copy(start, start + nb_copy, items + nb_copied);
+      read_index_ += nb_copy;
+      nb_copied += nb_copy;
+    }
+
+    tail_.store(tail + nb_popped, boost::memory_order_release);
+    return nb_popped;
+  }
+
+  //! remove the oldest item (consumer side), false if the queue is empty
+  bool pop(T & item)
+  {
+    return pop(&item, 1) == 1;
+  }
+
+  /*!
+    \brief drop all items, their chunks going back to the pool
+    \warning neither the producer nor the consumer should be active
+   */
+  void reset()
+  {
+    while (read_chunk_ != write_chunk_)
+    {
+      Chunk * chunk = read_chunk_;
+      read_chunk_ = chunk->next.load(boost::memory_order_relaxed);
+      if (!pool_.push(chunk))
+        delete chunk;
+    }
+    read_index_ = write_index_ = 0;
+    head_.store(0, boost::memory_order_relaxed);
+    tail_.store(0, boost::memory_order_relaxed);
+  }
+
+private:
+  //! block of items, linked to the following one
+  struct Chunk
+  {
+    explicit Chunk(size_t chunk_size) : items(chunk_size), next(NULL) {}
+
+    //! storage, allocated once
+    std::vector<T> items;
+    //! next chunk, NULL for the last one
+    boost::atomic<Chunk *> next;
+  };
+
+  // no copy: the chunks are shared between threads
+  SpscChunkQueue(const SpscChunkQueue &);
+  SpscChunkQueue & operator=(const SpscChunkQueue &);
+
+  //! allocate a chunk, accounted in the allocations
+  Chunk * newChunk()
+  {
+    nb_allocations_.fetch_add(1, boost::memory_order_relaxed);
+    return new Chunk(chunk_size_);
+  }
+
+  //! maximum number of items stored, 0 for no limit
+  const size_t capacity_;
+  //! number of items per chunk
+  const size_t chunk_size_;
+  //! chunks emptied by the consumer, for the producer
+  SpscRing<Chunk *> pool_;
+  //! number of chunks allocated
+  boost::atomic<unsigned long> nb_allocations_;
+
+  //! chunk being filled, only used by the producer
+  Chunk * write_chunk_;
+  //! number of items used in write_chunk_
+  size_t write_index_;
+  //! number of items pushed so far, only written by the producer
+  boost::atomic<size_t> head_;
+  //! keeps the producer and consumer data on different cache lines
+  char padding_[64];
+  //! chunk being read, only used by the consumer
+  Chunk * read_chunk_;
+  //! number of items of read_chunk_ already read
+  size_t read_index_;
+  //! number of items popped so far, only written by the consumer
+  boost::atomic<size_t> tail_;
+};
+
+#endif // OPTOFORCE_CHUNK_QUEUE_HPP
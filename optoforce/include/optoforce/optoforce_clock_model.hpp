@@ -0,0 +1,76 @@
+/**
+ * @file   optoforce_clock_model.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Online estimation of the sample clock of a device, from the arrival
+ *        instants of the batches read, to stamp each sample as soon as it is read.
+ */
+
+#ifndef OPTOFORCE_CLOCK_MODEL_HPP
+#define OPTOFORCE_CLOCK_MODEL_HPP
+
+#include <boost/chrono.hpp>
+
+/*!
+  \class ClockModel
+  \brief linear model time = offset + period * index, fitted by recursive least squares
+
+  Each batch read gives a point (index of its last sample, arrival instant).
+  The fit forgets old points, to follow the drift of the sensor clock.
+  Arrivals are late by the transfer delay: the line is moved down to the earliest
+  arrivals, which are the closest to the generation instants.
+ */
+class ClockModel
+{
+public:
+  typedef boost::chrono::high_resolution_clock clock;
+
+  /*!
+    \brief constructor
+    \param nominal_period expected sample period, in s
+    \param forgetting weight of the past at each update, in ]0, 1]
+   */
+  explicit ClockModel(double nominal_period = 1e-3, double forgetting = 0.9995);
+
+  /*!
+    \brief restart the estimation
+    \param nominal_period expected sample period, in s
+   */
+  void reset(double nominal_period);
+  /*!
+    \brief account a batch read
+    \param last_index index of the last sample of the batch, since the reading started
+    \param arrival instant the batch was read
+   */
+  void update(unsigned long long last_index, clock::time_point arrival);
+  //! estimated generation instant of a sample
+  clock::time_point getTime(unsigned long long index) const;
+  //! estimated sample period, in s
+  double getPeriod() const { return period_; }
+  //! whether a batch has been accounted since the last reset
+  bool isStarted() const { return is_started_; }
+
+private:
+  //! forgetting factor of the fit
+  double forgetting_;
+  //! whether origin_ is set
+  bool is_started_;
+  //! reference of the times, to keep the fit well conditioned
+  clock::time_point origin_;
+  //! reference of the indexes
+  unsigned long long origin_index_;
+  //! estimated time of origin_index_, in s from origin_
+  double offset_;
+  //! estimated period, in s
+  double period_;
+  //! covariance of (offset_, period_), relative to the arrival noise
+  double p_[2][2];
+  //! lowest arrival delay observed, relaxed over time, in s
+  double min_residual_;
+};
+
+#endif // OPTOFORCE_CLOCK_MODEL_HPP
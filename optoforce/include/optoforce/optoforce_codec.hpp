@@ -0,0 +1,103 @@
+/**
+ * @file   optoforce_codec.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Lossless compression of the recorded samples: the calibrated values are
+ *        brought back to the raw sensor counts, stored as zig-zag varint deltas.
+ */
+
+#ifndef OPTOFORCE_CODEC_HPP
+#define OPTOFORCE_CODEC_HPP
+
+#include <cstddef>
+#include <stdint.h>
+
+struct RecordingSample;
+
+/*!
+  \class SampleCodec
+  \brief state shared by the encoder and the decoder: calibration and previous sample
+
+  A sample is encoded as:
+  - varint of (zigzag(time delta - previous time delta) << 1 | escaped)
+  - if not escaped, per axis, varint of zigzag(count - previous count),
+    the count being such that value == (float) count * (float) (1.0 / calibration)
+  - if escaped (a value is not a calibrated count), the 6 values as raw floats
+ */
+class SampleCodec
+{
+public:
+  //! largest size of an encoded sample, in bytes
+  static const size_t MAX_ENCODED_SIZE = 10 + 6 * 10;
+
+  SampleCodec();
+
+  /*!
+    \brief set the calibration the values were obtained with
+    \param nb_axes number of meaningful axes (3 or 6), the others being 0
+    \param calibration dividing factor per axis, as given to OptoForceDriver::setCalibration
+   */
+  void setCalibration(size_t nb_axes, const float * calibration);
+  //! forget the previous sample, so that the next one is coded on its own
+  void reset();
+
+protected:
+  //! number of meaningful axes
+  size_t nb_axes_;
+  //! dividing factors
+  double calibration_[6];
+  //! multiplying factors, as computed by the driver
+  float scale_[6];
+  //! time of the previous sample, in ns
+  int64_t previous_time_;
+  //! time delta of the previous sample, in ns
+  int64_t previous_delta_;
+  //! counts of the previous sample
+  int64_t previous_counts_[6];
+};
+
+/*!
+  \class SampleEncoder
+  \brief encode samples one after the other
+ */
+class SampleEncoder : public SampleCodec
+{
+public:
+  SampleEncoder();
+  /*!
+    \brief encode a sample
+    \param sample sample to encode
+    \param output receives the code, at least MAX_ENCODED_SIZE bytes available
+    \return position following the code
+   */
+  unsigned char * encode(const RecordingSample & sample, unsigned char * output);
+  //! number of samples stored as raw floats, not being calibrated counts
+  unsigned long getNumberEscaped() const { return nb_escaped_; }
+
+private:
+  //! samples stored as raw floats
+  unsigned long nb_escaped_;
+};
+
+/*!
+  \class SampleDecoder
+  \brief decode samples one after the other, with the calibration used at encoding
+ */
+class SampleDecoder : public SampleCodec
+{
+public:
+  /*!
+    \brief decode a sample
+    \param input code of the sample
+    \param end end of the code available
+    \param sample receives the sample
+    \return position following the code, NULL if the code is truncated
+   */
+  const unsigned char * decode(const unsigned char * input, const unsigned char * end, RecordingSample & sample);
+};
+
+#endif // OPTOFORCE_CODEC_HPP
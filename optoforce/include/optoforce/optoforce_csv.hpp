@@ -0,0 +1,118 @@
+/**
+ * @file   optoforce_csv.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Csv recording files, formatted with a fixed precision into large buffers,
+ *        without going through the iostream formatting and its locale.
+ */
+
+#ifndef OPTOFORCE_CSV_HPP
+#define OPTOFORCE_CSV_HPP
+
+#include "optoforce/optoforce_recording.hpp"
+#include "optoforce/optoforce_sample.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*!
+  \brief write a number with a fixed number of decimals, '.' being the decimal separator
+  \param value number to write
+  \param decimals number of decimals, at most 9
+  \param output receives the characters, at least 32 available
+  \return position following the last character written (no terminating null)
+ */
+char * formatFixed(double value, unsigned int decimals, char * output);
+
+/*!
+  \class CsvWriter
+  \brief write samples in the csv layout of the recordings: t_ms;f_x;f_y;f_z[;t_x;t_y;t_z];
+ */
+class CsvWriter
+{
+public:
+  /*!
+    \brief constructor
+    \param buffer_size number of characters gathered before a write to the file
+   */
+  explicit CsvWriter(size_t buffer_size = 1 << 20);
+  //! destructor, closing the file
+  ~CsvWriter();
+
+  /*!
+    \brief set the number of decimals written
+    \param time_decimals decimals of the time, in ms (3 by default, the us)
+    \param value_decimals decimals of the forces and torques (4 by default)
+   */
+  void setPrecision(unsigned int time_decimals, unsigned int value_decimals);
+
+  /*!
+    \brief create the file, and write the column names
+    \param filename path of the file, replaced if it exists
+    \param nb_axes 3 for forces only, 6 for forces and torques
+    \return true if the file could be created
+   */
+  bool open(const std::string & filename, size_t nb_axes);
+  /*!
+    \brief create the file, with other columns than the recording ones
+    \param filename path of the file, replaced if it exists
+    \param columns names of the columns following the time
+    \return true if the file could be created
+   */
+  bool open(const std::string & filename, const std::vector<std::string> & columns);
+  /*!
+    \brief add a row
+    \param time_ms time of the sample, in ms
+    \param values forces, then torques, nb_axes used (one per column)
+   */
+  void append(double time_ms, const float * values);
+  /*!
+    \brief add a row whose first column is an integer, such as a device index
+    \param time_ms time of the sample, in ms
+    \param index value of the first column
+    \param values values of the other columns
+   */
+  void append(double time_ms, unsigned int index, const float * values);
+  /*!
+    \brief add acquired samples
+    \param samples samples to add
+    \param nb_samples number of samples
+    \param time_zero instant taken as the origin of the times
+   */
+  void append(const StampedSample * samples, size_t nb_samples,
+              boost::chrono::high_resolution_clock::time_point time_zero);
+  //! \overload add samples of a binary recording
+  void append(const RecordingSample * records, size_t nb_records);
+  //! write the rows gathered so far, false on write error
+  bool flush();
+  //! flush and close the file, false on write error
+  bool close();
+
+  //! whether a file is open
+  bool isOpen() const { return file_.is_open(); }
+
+private:
+  //! longest formatted value
+  static const size_t MAX_VALUE_SIZE = 34;
+
+  //! file written
+  std::ofstream file_;
+  //! rows not yet written, allocated once
+  std::vector<char> buffer_;
+  //! number of characters used in buffer_
+  size_t buffer_fill_;
+  //! number of values per row, time excluded
+  size_t nb_values_;
+  //! longest row possible
+  size_t max_row_size_;
+  //! decimals of the time
+  unsigned int time_decimals_;
+  //! decimals of the values
+  unsigned int value_decimals_;
+};
+
+#endif // OPTOFORCE_CSV_HPP
@@ -13,9 +13,12 @@
 // todo check if pragma once makes sense under Linux
 #pragma once
 #include <string>
-#include "omd/optodaq.h"
 #include "omd/optoports.h"
+#include "omd/sensorconfig.h"
+#include "optoforce/optoforce_backend.hpp"
+#include "optoforce/optoforce_sample.hpp"
 #include <vector>
+#include <boost/chrono.hpp>
 
 /*!
   \class handler of a connection with an Optoforce Device.
@@ -23,8 +26,25 @@
 class OptoForceDriver
 {
 public:
-  //! basic constructor
-  OptoForceDriver();
+  //! statistics on the heap allocations needed to stage the data read from the daq
+  struct AllocationStats
+  {
+    //! number of (re)allocations since the last reset
+    unsigned long nb_allocations;
+    //! number of bytes (re)allocated since the last reset
+    unsigned long nb_bytes;
+    //! time covered by the statistics, in s
+    double duration;
+    double allocations_per_second;
+    double bytes_per_second;
+  };
+
+  /*!
+    \brief basic constructor
+    \param daq handler of the daq to use, deleted with the driver.
+           Per default, the Optoforce library is used (see OmdDaq)
+   */
+  OptoForceDriver(OptoForceDaq * daq = NULL);
   //! basic destuctor (todo why virtual?)
   virtual ~OptoForceDriver();
   /*!
@@ -52,6 +72,45 @@ public:
    */
   bool getData(std::vector< std::vector<float> > & val, int p_iSensorIndex = 0);
 
+  /*!
+    \brief  get buffer of data into a caller-provided array, without any allocation.
+            The samples are the ones received between two calls to this function.
+    \param  samples array receiving the values read. First one is the oldest in time.
+            For a 3D sensor, the torque entries are set to 0.
+    \param  capacity number of entries available in samples
+    \param  p_iSensorIndex to select the 3d sensor when several are connected on a single daq
+    \return number of samples written, 0 if no new data, negative on error
+    \note   samples not fitting in the array are kept, and returned first at next call
+   */
+  int getData(Wrench6 * samples, int capacity, int p_iSensorIndex = 0);
+
+  /*!
+    \brief  get buffer of forces into a caller-provided array, without any allocation.
+            Same as the Wrench6 version, torques of 6D sensors being skipped.
+    \param  samples array receiving the values read. First one is the oldest in time.
+    \param  capacity number of entries available in samples
+    \param  p_iSensorIndex to select the 3d sensor when several are connected on a single daq
+    \return number of samples written, 0 if no new data, negative on error
+   */
+  int getData(Force3 * samples, int capacity, int p_iSensorIndex = 0);
+
+  /*!
+    \brief  get buffer of forces of all the channels of a multi-channel daq, with a single read
+    \param  samples array receiving the values read, channel after channel:
+            sample i of channel c is at samples[c * capacity + i]. Needs getNumberChannels() * capacity entries
+    \param  capacity number of entries available per channel
+    \param  nb_samples array receiving the number of samples written per channel
+    \return total number of samples written, negative on error
+   */
+  int getDataAllChannels(Force3 * samples, int capacity, int * nb_samples);
+
+  /*!
+    \brief number of sensors handled by the daq
+    \return the number of channels, 1 for a 6D sensor
+    \warning makes only sense if already connected
+   */
+  int getNumberChannels() const;
+
   //! whether or not a connecteion with a daq is active
   bool isOpen() const;
   /*!
@@ -80,6 +139,12 @@ public:
     \todo check with Asier if such calibration is enough
    */
   bool setCalibration(const std::vector<float> & factor);
+  /*!
+    \brief get the calibration in use
+    \return the dividing factors set, one per axis (1 if no calibration set)
+    \note a value is (float) raw_count * (float) (1.0 / factor), computed in that order
+   */
+  std::vector<float> getCalibration() const;
   /*!
     \brief configure the desired filtering
     \param filter_freq the desired frequency according to the authorized values (no_filter = 0, filter_150hz, filter_50hz, filter_15hz)
@@ -98,6 +163,16 @@ public:
     \todo check what is the default value
   */
   bool setFrequency(const sensor_speed freq);
+  /*!
+    \brief get the sample frequency configured on the daq
+    \return the frequency in Hz, 0 if not connected
+   */
+  double getSampleFrequency();
+  /*!
+    \brief number of reads that reported a full daq buffer, samples being lost
+    \return the count since the connection
+   */
+  unsigned long getNumberOverflows() const;
 
   /*!
     \brief to set Zero of the optoforce device
@@ -111,14 +186,63 @@ public:
    */
   bool setZeroAll();
 
+  /*!
+    \brief get the allocations done by the driver for staging the daq data
+    \return the statistics since the construction or the last reset
+   */
+  AllocationStats getAllocationStats() const;
+  //! restart the allocation statistics
+  void resetAllocationStats();
+
 protected:
+  /*!
+    \brief read the daq if all samples previously read on that channel have been delivered
+    \param channel to select the 3d sensor when several are connected on a single daq
+    \return number of samples pending on the channel, negative on error
+   */
+  int fetchData(size_t channel);
+  /*!
+    \brief copy pending samples of a channel into a caller array, and mark them delivered
+    \param channel channel considered
+    \param samples array receiving the samples
+    \param nb_samples number of samples to deliver, expected to be pending
+   */
+  void deliverData(size_t channel, Wrench6 * samples, size_t nb_samples);
+  //! \overload
+  void deliverData(size_t channel, Force3 * samples, size_t nb_samples);
+
+  //! samples of a channel read from the daq and not yet delivered, stored axis after axis
+  struct PendingSamples
+  {
+    //! calibrated values, one array per axis (torques unused for a 3D sensor)
+    std::vector<float> axis[6];
+    //! index of the first sample not yet delivered
+    size_t begin;
+    //! number of samples not yet delivered
+    size_t size() const { return axis[0].size() - begin; }
+  };
+
   //! daq of the device considered.
-  OptoDAQ * daq_;
+  OptoForceDaq * daq_;
   //! specification of the port related to that device
   OPort port_;
   //! specify if it is a 3d or 6d sensor
   bool is_3D_sensor_;
   //! calibration factor being used
   std::vector<float> factor_;
+  //! dividing factors set, factor_ being their inverse
+  std::vector<float> calibration_;
+  //! per channel, calibrated samples read from the daq, not yet delivered. Storage reused between reads.
+  std::vector<PendingSamples> pending_;
+  //! allocations done so far, the daq ones excepted
+  AllocationStats alloc_stats_;
+  //! start instant of the allocation statistics
+  boost::chrono::steady_clock::time_point alloc_stats_start_;
+  //! daq allocations at the start of the statistics
+  unsigned long daq_nb_allocations_start_;
+  //! daq bytes allocated at the start of the statistics
+  unsigned long daq_nb_bytes_start_;
+  //! number of reads that reported a full daq buffer
+  unsigned long nb_overflows_;
 };
 
@@ -0,0 +1,102 @@
+/**
+ * @file   optoforce_merge.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Single csv file gathering the samples of several devices, given in time order,
+ *        either one row per sample, or one row per tick of a common timeline.
+ */
+
+#ifndef OPTOFORCE_MERGE_HPP
+#define OPTOFORCE_MERGE_HPP
+
+#include "optoforce/optoforce_csv.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//! layout of the merged file of all devices
+enum merge_output {merge_none = 0,   //!< one file per device
+                   merge_events,     //!< one row per sample: t_ms;device;f_x;f_y;f_z;t_x;t_y;t_z;
+                   merge_hold_last,  //!< one row per tick, with the last sample of each device
+                   merge_nearest};   //!< one row per tick, with the sample of each device nearest to it
+
+/*!
+  \class MergedCsvWriter
+  \brief write the samples of several devices in a single csv file, as they come in time order
+
+  With merge_hold_last and merge_nearest, a row t_ms;<serial>_f_x;...;<serial>_t_z;... is written per tick,
+  starting once every device provided a sample. merge_nearest takes the sample of each device nearest
+  to the tick within half a period, and otherwise the last one before it. The memory used does not depend
+  on the duration: a single sample per device is kept for the pending tick.
+ */
+class MergedCsvWriter
+{
+public:
+  MergedCsvWriter();
+
+  //! set the number of decimals written, see CsvWriter::setPrecision
+  void setPrecision(unsigned int time_decimals, unsigned int value_decimals);
+
+  /*!
+    \brief create the file, and write the column names
+    \param filename path of the file, replaced if it exists
+    \param serial_numbers names of the devices, in the order of their indexes
+    \param nb_axes number of axes of each device (3 or 6)
+    \param mode layout of the file, merge_none not being valid
+    \param period_ns period of the timeline, for merge_hold_last and merge_nearest
+    \return true if the file could be created
+   */
+  bool open(const std::string & filename, const std::vector<std::string> & serial_numbers,
+            const std::vector<size_t> & nb_axes, merge_output mode, int64_t period_ns);
+  /*!
+    \brief add a sample, the samples being given in time order over all devices
+    \param device index of the device
+    \param time_ns time of the sample, in ns from the recording start
+    \param wrench forces then torques
+   */
+  void append(size_t device, int64_t time_ns, const float * wrench);
+  //! write the rows gathered so far, false on write error
+  bool flush();
+  //! flush and close the file, false on write error
+  bool close();
+
+  //! whether a file is open
+  bool isOpen() const { return csv_.isOpen(); }
+  //! number of rows written since open
+  unsigned long long getNumberRows() const { return nb_rows_; }
+
+private:
+  //! write the row of the pending tick, and move to the next one
+  void writeTick();
+
+  //! file written
+  CsvWriter csv_;
+  //! layout of the file
+  merge_output mode_;
+  //! period of the timeline, in ns
+  int64_t period_ns_;
+  //! number of axes per device
+  std::vector<size_t> nb_axes_;
+  //! pending tick, in ns from the recording start
+  int64_t tick_ns_;
+  //! whether every device provided a sample, the timeline being started
+  bool is_started_;
+  //! last sample of each device
+  std::vector<RecordingSample> last_;
+  //! whether last_ holds a sample, per device
+  std::vector<bool> has_last_;
+  //! sample nearest to the pending tick, per device, with merge_nearest
+  std::vector<RecordingSample> nearest_;
+  //! whether nearest_ holds a sample, per device
+  std::vector<bool> has_nearest_;
+  //! values of the row being written, allocated once
+  std::vector<float> row_;
+  //! number of rows written
+  unsigned long long nb_rows_;
+};
+
+#endif // OPTOFORCE_MERGE_HPP
@@ -0,0 +1,103 @@
+/**
+ * @file   optoforce_omd_backend.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Backend relying on the Optoforce library (OptoDAQ, OptoPorts).
+ *        This is the one used by default by the drivers.
+ */
+
+#ifndef OPTOFORCE_OMD_BACKEND_HPP
+#define OPTOFORCE_OMD_BACKEND_HPP
+
+#include "optoforce/optoforce_backend.hpp"
+#include "omd/optodaq.h"
+#include "omd/optoports.h"
+
+/*!
+  \class OmdDaq
+  \brief daq handled through the Optoforce library
+ */
+class OmdDaq : public OptoForceDaq
+{
+public:
+  OmdDaq();
+  virtual ~OmdDaq();
+
+  virtual bool open(const OPort & port);
+  virtual void close();
+  virtual bool isOpen();
+  virtual opto_version getVersion();
+  virtual int getSensorSize();
+  virtual SensorConfig getConfig();
+  virtual bool sendConfig(const SensorConfig & config);
+  virtual bool zero(int number);
+  virtual void zeroAll();
+  virtual int readAll(RawCounts & counts);
+  virtual void getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const;
+
+protected:
+  /*!
+    \brief update the allocation statistics after a read of the daq
+    \param previous buffer given to the daq
+    \param size number of entries of the buffer given, updated to the new one
+    \param current buffer returned by the daq
+    \param new_size number of entries of the buffer returned
+    \param item_size size of one entry, in bytes
+   */
+  void trackStagingBuffer(const void * previous, size_t & size,
+                          const void * current, size_t new_size,
+                          size_t item_size);
+
+  //! daq from the Optoforce library
+  OptoDAQ * daq_;
+  //! specify if it is a 3d or 6d sensor
+  bool is_3D_sensor_;
+  //! staging buffer of the 3D daq reads, kept from one read to the other
+  OptoPackage * package3d_buffer_;
+  //! staging buffer of the 6D daq reads, kept from one read to the other
+  OptoPackage6D * package6d_buffer_;
+  //! number of entries in package3d_buffer_
+  size_t package3d_buffer_size_;
+  //! number of entries in package6d_buffer_
+  size_t package6d_buffer_size_;
+  //! number of staging (re)allocations so far
+  unsigned long nb_allocations_;
+  //! number of staging bytes (re)allocated so far
+  unsigned long nb_bytes_;
+};
+
+/*!
+  \class OmdPortEnumerator
+  \brief listing of the daq through the Optoforce library
+  \warning only one instance is allowed per process otherwise poor performance is guaranteed
+ */
+class OmdPortEnumerator : public OptoForcePortEnumerator
+{
+public:
+  OmdPortEnumerator();
+  virtual ~OmdPortEnumerator();
+
+  virtual int getSize();
+  virtual std::vector<OPort> listPorts();
+
+protected:
+  //! connected port enumarator (from Optforce API)
+  OptoPorts * ports_;
+};
+
+/*!
+  \class OmdBackend
+  \brief creation of the objects relying on the Optoforce library
+ */
+class OmdBackend : public OptoForceBackend
+{
+public:
+  virtual OptoForcePortEnumerator * createPortEnumerator();
+  virtual OptoForceDaq * createDaq();
+};
+
+#endif // OPTOFORCE_OMD_BACKEND_HPP
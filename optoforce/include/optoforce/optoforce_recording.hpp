@@ -0,0 +1,316 @@
+/**
+ * @file   optoforce_recording.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Binary recording files: a header describing the device, followed by
+ *        fixed-size records, compressed blocks or column chunks, written by large blocks as the samples are acquired.
+ */
+
+#ifndef OPTOFORCE_RECORDING_HPP
+#define OPTOFORCE_RECORDING_HPP
+
+#include "optoforce/optoforce_codec.hpp"
+#include "optoforce/optoforce_sample.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//! format of the files written by the acquisition
+enum recording_format {recording_csv = 0, recording_binary, recording_compressed, recording_columnar};
+//! layout of the samples in a binary recording
+enum recording_encoding {encoding_records = 0, encoding_delta_varint, encoding_columnar};
+
+//! first bytes of a binary recording
+const char RECORDING_MAGIC[8] = {'O', 'P', 'T', 'O', 'R', 'E', 'C', '\0'};
+//! version of the binary layout, increased at each incompatible change
+const uint32_t RECORDING_VERSION = 1;
+
+/*!
+  \struct RecordingHeader
+  \brief description of the device recorded, at the beginning of the file
+  \note all fields are stored in the byte order of the recording host (little endian on x86)
+ */
+struct RecordingHeader
+{
+  //! RECORDING_MAGIC
+  char magic[8];
+  //! RECORDING_VERSION
+  uint32_t version;
+  //! size of this header, offset of the first record
+  uint32_t header_size;
+  //! size of a record
+  uint32_t record_size;
+  //! number of meaningful axes in the records (3 or 6)
+  uint32_t nb_axes;
+  //! serial number of the daq, null terminated
+  char serial_number[32];
+  //! nominal sample frequency, in Hz
+  double sample_frequency;
+  //! dividing factor applied to the raw counts, per axis
+  float calibration[6];
+  //! 1 for a 3D sensor, 0 for a 6D one
+  uint32_t is_3D_sensor;
+  //! recording_encoding of the samples
+  uint32_t encoding;
+  //! wall clock instant of the record times origin, in ns since the Unix epoch
+  int64_t start_time_ns;
+  //! number of records, 0 if the file was not closed properly (then given by the file size)
+  uint64_t nb_records;
+  //! room for future fields, kept to 0
+  char padding[16];
+};
+
+/*!
+  \struct RecordingBlock
+  \brief with encoding_delta_varint, the samples are stored by blocks, each one coded on its own
+ */
+struct RecordingBlock
+{
+  //! number of samples in the block
+  uint32_t nb_records;
+  //! size of the codes following, in bytes
+  uint32_t nb_bytes;
+};
+
+/*!
+  \struct RecordingChunk
+  \brief with encoding_columnar, the samples are stored by chunks of one column per value:
+         the chunk header, the times (int64_t), then the values of each axis (float), in order
+  \note the chunks being a multiple of 8 bytes, the columns of a mapped file are aligned
+ */
+struct RecordingChunk
+{
+  //! number of samples, and size of the chunk following this field, in bytes
+  RecordingBlock block;
+  //! time of the first sample, in ns from the recording start
+  int64_t first_time_ns;
+  //! time of the last sample
+  int64_t last_time_ns;
+  //! smallest value of each axis
+  float min[6];
+  //! largest value of each axis
+  float max[6];
+  //! mean value of each axis
+  float mean[6];
+};
+
+/*!
+  \struct RecordingSample
+  \brief a record: one sample of the device
+ */
+struct RecordingSample
+{
+  //! acquisition instant, in ns from the recording start
+  int64_t time_ns;
+  //! forces then torques (torques are 0 for a 3D sensor)
+  float wrench[6];
+};
+
+static_assert(sizeof(RecordingHeader) == 128, "the recording header layout is part of the file format");
+static_assert(sizeof(RecordingSample) == 32, "the record layout is part of the file format");
+static_assert(sizeof(RecordingChunk) == 96, "the chunk layout is part of the file format");
+
+/*!
+  \brief prepare a header with the layout fields set, and no device information
+  \param header header initialized
+ */
+void initRecordingHeader(RecordingHeader & header);
+
+/*!
+  \struct RecordingSegment
+  \brief a file of a recording split into segments, as listed in its manifest
+ */
+struct RecordingSegment
+{
+  //! name of the file, without directory
+  std::string filename;
+  //! time of the first record, in ns from the recording start
+  int64_t first_time_ns;
+  //! time of the last record
+  int64_t last_time_ns;
+  //! number of records
+  unsigned long long nb_records;
+  //! size of the file, in bytes
+  unsigned long long nb_bytes;
+};
+
+/*!
+  \brief write the manifest of a segmented recording, replacing it
+  \param filename path of the manifest
+  \param header header shared by the segments
+  \param segments segments in time order
+  \return false on write error
+
+  The manifest is a text file: comment lines starting by '#' (device and start time),
+  then one line per segment: file;first_time_ms;last_time_ms;nb_samples;nb_bytes
+ */
+bool writeRecordingManifest(const std::string & filename, const RecordingHeader & header,
+                            const std::vector<RecordingSegment> & segments);
+/*!
+  \brief read the manifest of a segmented recording
+  \param filename path of the manifest
+  \param segments receives the segments, their file names being relative to the manifest directory
+  \return false if the manifest could not be read
+ */
+bool readRecordingManifest(const std::string & filename, std::vector<RecordingSegment> & segments);
+
+/*!
+  \brief gather the columns of a chunk into records
+  \param columns times then values of each axis, following the RecordingChunk
+  \param records receives the records, sized to the number of samples of the chunk
+ */
+void readChunkColumns(const unsigned char * columns, std::vector<RecordingSample> & records);
+
+/*!
+  \class RecordingWriter
+  \brief append records to a binary recording, by large blocks
+ */
+class RecordingWriter
+{
+public:
+  /*!
+    \brief constructor
+    \param block_size number of records gathered before a write to the file
+   */
+  explicit RecordingWriter(size_t block_size = 4096);
+  //! destructor, closing the file
+  ~RecordingWriter();
+
+  /*!
+    \brief create the file, and write its header
+    \param filename path of the file, replaced if it exists
+    \param header description of the recording (layout fields are set by the writer,
+           the encoding and calibration fields select the compression)
+    \return true if the file could be created
+   */
+  bool open(const std::string & filename, const RecordingHeader & header);
+  /*!
+    \brief add records
+    \param records records to add
+    \param nb_records number of records
+    \return false on write error
+   */
+  bool append(const RecordingSample * records, size_t nb_records);
+  /*!
+    \brief add acquired samples, converted into records
+    \param samples samples to add
+    \param nb_samples number of samples
+    \param time_zero instant taken as the origin of the record times
+    \return false on write error
+   */
+  bool append(const StampedSample * samples, size_t nb_samples,
+              boost::chrono::high_resolution_clock::time_point time_zero);
+  //! write the records gathered so far, false on write error
+  bool flush();
+  /*!
+    \brief reserve the space of the file on disk, so that appending does not wait for its extension
+    \param nb_bytes size reserved, from the file start; the file size is kept, the space left is released at close
+    \return false if the file system does not support it, the writing being still possible
+   */
+  bool preallocate(unsigned long long nb_bytes);
+  //! flush, write the number of records in the header, and close the file
+  bool close();
+
+  //! whether a file is open
+  bool isOpen() const { return fd_ >= 0; }
+  //! number of records appended since open
+  unsigned long long getNumberRecords() const { return nb_records_; }
+  /*!
+    \brief size of the file once flushed
+    \return bytes written, plus the records gathered counted uncompressed
+   */
+  unsigned long long getNumberBytes() const { return nb_bytes_ + block_fill_ * sizeof(RecordingSample); }
+
+private:
+  // no copy: the file descriptor is owned
+  RecordingWriter(const RecordingWriter &);
+  RecordingWriter & operator=(const RecordingWriter &);
+
+  //! records not yet written, allocated once
+  std::vector<RecordingSample> block_;
+  //! number of records used in block_
+  size_t block_fill_;
+  //! file written, -1 if none
+  int fd_;
+  //! records appended since open
+  unsigned long long nb_records_;
+  //! bytes written to the file since open
+  unsigned long long nb_bytes_;
+  //! recording_encoding of the file
+  uint32_t encoding_;
+  //! fill the chunk of the gathered records in encoded_, with encoding_columnar
+  size_t fillChunk();
+  //! write to the file, counting the bytes written
+  bool write(const void * data, size_t size);
+
+  //! compression of the blocks, with encoding_delta_varint
+  SampleEncoder encoder_;
+  //! block compressed or chunk, allocated once
+  std::vector<unsigned char> encoded_;
+};
+
+/*!
+  \class RecordingReader
+  \brief read the records of a binary recording, in order
+ */
+class RecordingReader
+{
+public:
+  RecordingReader();
+  //! destructor, closing the file
+  ~RecordingReader();
+
+  /*!
+    \brief open a recording, and check its header
+    \param filename path of the file
+    \return true if the file is a recording of a supported version
+   */
+  bool open(const std::string & filename);
+  //! close the file
+  void close();
+
+  //! header of the recording
+  const RecordingHeader & getHeader() const { return header_; }
+  //! number of complete records in the file
+  unsigned long long getNumberRecords() const { return nb_records_; }
+  /*!
+    \brief read the next records
+    \param records receives the records
+    \param max_records maximum number of records to read
+    \return number of records read, 0 at the end of the file
+   */
+  size_t read(RecordingSample * records, size_t max_records);
+
+private:
+  // no copy: the file descriptor is owned
+  RecordingReader(const RecordingReader &);
+  RecordingReader & operator=(const RecordingReader &);
+
+  //! count the complete blocks or chunks of an interrupted recording, from the current position
+  unsigned long long countBlockRecords();
+  //! read the next block or chunk of a recording into decoded_, false at the end
+  bool readBlock();
+
+  //! header read at open
+  RecordingHeader header_;
+  //! file read, -1 if none
+  int fd_;
+  //! number of complete records in the file
+  unsigned long long nb_records_;
+  //! number of records read so far
+  unsigned long long nb_read_;
+  //! decompression of the blocks, with encoding_delta_varint
+  SampleDecoder decoder_;
+  //! block or chunk being read
+  std::vector<unsigned char> encoded_;
+  //! records of the block being read
+  std::vector<RecordingSample> decoded_;
+  //! number of records of decoded_ already read
+  size_t decoded_read_;
+};
+
+#endif // OPTOFORCE_RECORDING_HPP
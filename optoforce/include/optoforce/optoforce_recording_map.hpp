@@ -0,0 +1,131 @@
+/**
+ * @file   optoforce_recording_map.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Memory-mapped access to a binary recording, with a sparse time index
+ *        to get the samples of a time window without scanning the file,
+ *        and the statistics of the column chunks to skip the ones out of a query.
+ */
+
+#ifndef OPTOFORCE_RECORDING_MAP_HPP
+#define OPTOFORCE_RECORDING_MAP_HPP
+
+#include "optoforce/optoforce_recording.hpp"
+#include <string>
+#include <vector>
+
+/*!
+  \class RecordingMap
+  \brief map a recording in memory, and access its samples by time
+  \note the sample times of a recording are expected to be increasing, as written by the acquisition.
+        With encoding_columnar, the chunks of the file give direct access to the columns.
+ */
+class RecordingMap
+{
+public:
+  RecordingMap();
+  //! destructor, unmapping the file
+  ~RecordingMap();
+
+  /*!
+    \brief map a recording, and build its time index
+    \param filename path of the file
+    \return true if the file is a recording of a supported version
+   */
+  bool open(const std::string & filename);
+  //! unmap the file
+  void close();
+
+  //! header of the recording
+  const RecordingHeader & getHeader() const { return header_; }
+  //! number of complete records in the file
+  unsigned long long getNumberRecords() const { return nb_records_; }
+  /*!
+    \brief direct access to the records, without copy
+    \return the records, NULL for a compressed recording
+   */
+  const RecordingSample * getRecords() const { return records_; }
+
+  /*!
+    \brief locate the records of a time window, in O(log n)
+    \param start_ns start of the window, in ns from the recording start (included)
+    \param end_ns end of the window (excluded)
+    \param first index of the first record of the window
+    \param last index following the last record of the window (first if empty)
+   */
+  void findWindow(int64_t start_ns, int64_t end_ns,
+                  unsigned long long & first, unsigned long long & last);
+  /*!
+    \brief get the records of a time window
+    \param start_ns start of the window, in ns from the recording start (included)
+    \param end_ns end of the window (excluded)
+    \param records receives the records, decoded for a compressed recording
+    \return number of records of the window
+   */
+  size_t readWindow(int64_t start_ns, int64_t end_ns, std::vector<RecordingSample> & records);
+
+  //! number of chunks of a columnar recording, 0 for the other layouts
+  size_t getNumberChunks() const;
+  //! header and statistics of a chunk, NULL if out of range
+  const RecordingChunk * getChunk(size_t chunk) const;
+  //! times of the samples of a chunk, without copy, NULL if out of range
+  const int64_t * getChunkTimes(size_t chunk) const;
+  //! values of an axis over a chunk, without copy, NULL if out of range
+  const float * getChunkColumn(size_t chunk, size_t axis) const;
+  /*!
+    \brief get the samples where the absolute value of an axis exceeds a threshold
+    \param axis axis tested (0 for f_x to 5 for t_z)
+    \param threshold value exceeded
+    \param records receives the samples found, in time order
+    \return number of chunks or blocks read, the columnar chunks out of the threshold being skipped
+   */
+  size_t findAbove(size_t axis, float threshold, std::vector<RecordingSample> & records);
+
+private:
+  // no copy: the mapping is owned
+  RecordingMap(const RecordingMap &);
+  RecordingMap & operator=(const RecordingMap &);
+
+  //! entry of the sparse index: a block of records, or a chunk
+  struct IndexEntry
+  {
+    //! time of the first record of the block, in ns
+    int64_t time_ns;
+    //! index of the first record of the block
+    unsigned long long record;
+    //! position of the block in the file
+    size_t offset;
+  };
+
+  //! index of the block containing the first record at or after a time
+  size_t findBlock(int64_t time_ns) const;
+  //! index of the first record of a block at or after a time
+  unsigned long long findRecord(size_t block, int64_t time_ns);
+  //! decode a block of a compressed recording into decoded_, if not done yet (chunks are read in place)
+  const RecordingSample * decodeBlock(size_t block);
+
+  //! header of the recording
+  RecordingHeader header_;
+  //! mapped file, NULL if none
+  const unsigned char * data_;
+  //! size of the mapping
+  size_t size_;
+  //! records of an uncompressed recording
+  const RecordingSample * records_;
+  //! number of complete records
+  unsigned long long nb_records_;
+  //! sparse index, one entry per block of records or chunk
+  std::vector<IndexEntry> index_;
+  //! decompression of the blocks
+  SampleDecoder decoder_;
+  //! records of the last block decoded
+  std::vector<RecordingSample> decoded_;
+  //! index of the block in decoded_, index_.size() if none
+  size_t decoded_block_;
+};
+
+#endif // OPTOFORCE_RECORDING_MAP_HPP
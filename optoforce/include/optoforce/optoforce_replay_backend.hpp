@@ -0,0 +1,152 @@
+/**
+ * @file   optoforce_replay_backend.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Replay of binary recordings as Optoforce daq, to run the drivers on real force data
+ *        without any sensor. Each sample is delivered at its recorded instant,
+ *        possibly accelerated, or as fast as the daq is read.
+ */
+
+#ifndef OPTOFORCE_REPLAY_BACKEND_HPP
+#define OPTOFORCE_REPLAY_BACKEND_HPP
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "optoforce/optoforce_backend.hpp"
+#include "optoforce/optoforce_recording.hpp"
+
+/*!
+  \struct ReplayDeviceConfig
+  \brief recording replayed by a daq, and how
+ */
+struct ReplayDeviceConfig
+{
+  //! default: real time, each sample delivered at its own instant, no loop
+  ReplayDeviceConfig();
+
+  //! binary recording replayed (any encoding)
+  std::string filename;
+  //! serial number reported by the port, the one of the recording if empty
+  std::string serial_number;
+  //! how much faster than recorded the samples are delivered, 0 for as fast as read
+  double time_scale;
+  //! number of samples delivered together (USB transfers), 1 to follow the recorded instants only
+  int burst_size;
+  //! number of samples the daq can buffer, and largest delivery of a read when replaying as fast as read
+  int buffer_size;
+  //! whether the recording starts over once finished
+  bool is_loop;
+  //! duration of each read (USB transfer), in s
+  double read_delay;
+};
+
+/*!
+  \struct ReplayDeviceStats
+  \brief counters of a replayed daq, since its opening
+ */
+struct ReplayDeviceStats
+{
+  //! samples read by the driver
+  unsigned long nb_read;
+  //! samples lost due to buffer overflows
+  unsigned long nb_lost;
+  //! number of reads done
+  unsigned long nb_reads;
+  //! number of times the recording was started over
+  unsigned long nb_loops;
+  //! whether the whole recording was delivered (never with is_loop)
+  bool is_finished;
+};
+
+class ReplayDevice;
+
+/*!
+  \class ReplayDaq
+  \brief handler of a replayed daq, as created by the ReplayBackend
+ */
+class ReplayDaq : public OptoForceDaq
+{
+public:
+  /*!
+    \brief constructor
+    \param devices devices known, looked up by port name at opening
+   */
+  ReplayDaq(const std::vector< boost::shared_ptr<ReplayDevice> > & devices);
+  virtual ~ReplayDaq();
+
+  virtual bool open(const OPort & port);
+  virtual void close();
+  virtual bool isOpen();
+  virtual opto_version getVersion();
+  virtual int getSensorSize();
+  virtual SensorConfig getConfig();
+  virtual bool sendConfig(const SensorConfig & config);
+  virtual bool zero(int number);
+  virtual void zeroAll();
+  virtual int readAll(RawCounts & counts);
+  virtual void getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const;
+
+protected:
+  //! devices that can be opened
+  std::vector< boost::shared_ptr<ReplayDevice> > devices_;
+  //! device opened, NULL if closed
+  boost::shared_ptr<ReplayDevice> device_;
+  //! counts of the last read, kept from one read to the other
+  std::vector<int> counts_;
+  //! number of staging (re)allocations so far
+  unsigned long nb_allocations_;
+  //! number of staging bytes (re)allocated so far
+  unsigned long nb_bytes_;
+};
+
+/*!
+  \class ReplayBackend
+  \brief set of recordings, seen as daq connected to the computer
+  \note the samples are delivered as raw counts, obtained with the calibration of the recording:
+        the drivers give back the recorded values once set with the same calibration
+        (see getRecordingHeader)
+ */
+class ReplayBackend : public OptoForceBackend
+{
+public:
+  ReplayBackend();
+  virtual ~ReplayBackend();
+
+  /*!
+    \brief add a replayed daq
+    \param config recording and replay parameters
+    \return false if the recording could not be read
+    \warning to be done before creating the enumerators and the daq handlers
+   */
+  bool addDevice(const ReplayDeviceConfig & config);
+  //! number of replayed daq
+  int getNumberDevices() const;
+  /*!
+    \brief get the header of the recording replayed by a daq
+    \param serial_number identificator of the device of interest
+    \param header header of the recording, with its calibration
+    \return true if the device exists
+   */
+  bool getRecordingHeader(const std::string & serial_number, RecordingHeader & header) const;
+  /*!
+    \brief get the counters of a daq
+    \param serial_number identificator of the device of interest
+    \param stats counters of the device
+    \return true if the device exists
+   */
+  bool getDeviceStats(const std::string & serial_number, ReplayDeviceStats & stats) const;
+
+  virtual OptoForcePortEnumerator * createPortEnumerator();
+  virtual OptoForceDaq * createDaq();
+
+protected:
+  //! replayed devices, shared with the daq handlers
+  std::vector< boost::shared_ptr<ReplayDevice> > devices_;
+};
+
+#endif // OPTOFORCE_REPLAY_BACKEND_HPP
@@ -0,0 +1,131 @@
+/**
+ * @file   optoforce_ring.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Lock-free ring buffer, with one producer and one consumer thread.
+ *        The storage is allocated once, at construction.
+ */
+
+#ifndef OPTOFORCE_RING_HPP
+#define OPTOFORCE_RING_HPP
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <boost/atomic.hpp>
+
+/*!
+  \class SpscRing
+  \brief fixed capacity FIFO, shared between a single producer and a single consumer
+  \warning push is to be called by one thread only, pop and size by another one
+ */
+template <typename T>
+class SpscRing
+{
+public:
+  /*!
+    \brief constructor
+    \param capacity maximum number of items stored (at least 1)
+   */
+  explicit SpscRing(size_t capacity)
+    : buffer_(std::max(capacity, (size_t) 1)), head_(0), tail_(0)
+  {
+  }
+
+  //! maximum number of items stored
+  size_t capacity() const
+  {
+    return buffer_.size();
+  }
+
+  //! number of items available, as seen by the calling thread
+  size_t size() const
+  {
+    return head_.load(boost::memory_order_acquire) - tail_.load(boost::memory_order_acquire);
+  }
+
+  /*!
+    \brief add items (producer side)
+    \param items items to add, oldest first
+    \param nb_items number of items to add
+    \return number of items added, less than nb_items if the ring gets full
+   */
+  size_t push(const T * items, size_t nb_items)
+  {
+    size_t head = head_.load(boost::memory_order_relaxed);
+    size_t tail = tail_.load(boost::memory_order_acquire);
+    size_t nb_pushed = std::min(nb_items, buffer_.size() - (head - tail));
+
+    // copied in at most two segments: up to the end of the storage, and from its beginning
+    size_t start = head % buffer_.size();
+    size_t first = std::min(nb_pushed, buffer_.size() - start);
+    std::copy(items, items + first, buffer_.begin() + start);
+    std::copy(items + first, items + nb_pushed, buffer_.begin());
+
+    head_.store(head + nb_pushed, boost::memory_order_release);
+    return nb_pushed;
+  }
+
+  //! add one item (producer side), false if the ring is full
+  bool push(const T & item)
+  {
+    return push(&item, 1) == 1;
+  }
+
+  /*!
+    \brief remove the oldest items (consumer side)
+    \param items receives the items, oldest first
+    \param max_items maximum number of items to remove
+    \return number of items removed
+   */
+  size_t pop(T * items, size_t max_items)
+  {
+    size_t tail = tail_.load(boost::memory_order_relaxed);
+    size_t head = head_.load(boost::memory_order_acquire);
+    size_t nb_popped = std::min(max_items, head - tail);
+
+    size_t start = tail % buffer_.size();
+    size_t first = std::min(nb_popped, buffer_.size() - start);
+    std::copy(buffer_.begin() + start, buffer_.begin() + start + first, items);
+    std::copy(buffer_.begin(), buffer_.begin() + (nb_popped - first), items + first);
+
+    tail_.store(tail + nb_popped, boost::memory_order_release);
+    return nb_popped;
+  }
+
+  //! remove the oldest item (consumer side), false if the ring is empty
+  bool pop(T & item)
+  {
+    return pop(&item, 1) == 1;
+  }
+
+  /*!
+    \brief drop all items
+    \warning neither the producer nor the consumer should be active
+   */
+  void reset()
+  {
+    head_.store(0, boost::memory_order_relaxed);
+    tail_.store(0, boost::memory_order_relaxed);
+  }
+
+private:
+  // no copy: the indexes are shared between threads
+  SpscRing(const SpscRing &);
+  SpscRing & operator=(const SpscRing &);
+
+  //! storage, allocated once
+  std::vector<T> buffer_;
+  //! number of items pushed so far, only written by the producer
+  boost::atomic<size_t> head_;
+  //! keeps head_ and tail_ on different cache lines
+  char padding_[64];
+  //! number of items popped so far, only written by the consumer
+  boost::atomic<size_t> tail_;
+};
+
+#endif // OPTOFORCE_RING_HPP
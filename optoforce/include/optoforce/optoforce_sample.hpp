@@ -0,0 +1,55 @@
+/**
+ * @file   optoforce_sample.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Fixed-size sample types provided by the Optoforce devices.
+ */
+
+#ifndef OPTOFORCE_SAMPLE_HPP
+#define OPTOFORCE_SAMPLE_HPP
+
+#include <boost/chrono.hpp>
+
+/*!
+  \struct Force3
+  \brief calibrated measure of a 3D sensor (one channel of the daq)
+  \note plain data, can be copied with memcpy and stored in raw arrays
+ */
+struct Force3
+{
+  float fx;
+  float fy;
+  float fz;
+};
+
+/*!
+  \struct Wrench6
+  \brief calibrated measure of a 6D sensor
+  \note when filled from a 3D sensor, the torque entries are set to 0
+ */
+struct Wrench6
+{
+  float fx;
+  float fy;
+  float fz;
+  float tx;
+  float ty;
+  float tz;
+};
+
+/*!
+  \struct StampedSample
+  \brief measure of a device, with its acquisition instant, as recorded
+  \note for a 3D sensor, only the force is meaningful
+ */
+struct StampedSample
+{
+  boost::chrono::high_resolution_clock::time_point acq_time;
+  Wrench6 wrench;
+};
+
+#endif // OPTOFORCE_SAMPLE_HPP
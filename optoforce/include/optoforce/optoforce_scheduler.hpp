@@ -0,0 +1,90 @@
+/**
+ * @file   optoforce_scheduler.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Periodic wakeups on absolute deadlines, so that the period does not drift
+ *        with the loop runtime, with statistics on the wakeup lateness.
+ *        A wait can be interrupted from another thread, to handle a request at once.
+ */
+
+#ifndef OPTOFORCE_SCHEDULER_HPP
+#define OPTOFORCE_SCHEDULER_HPP
+
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*!
+  \struct SchedulerStats
+  \brief wakeup statistics of a periodic loop
+ */
+struct SchedulerStats
+{
+  //! number of wakeups done
+  unsigned long nb_wakeups;
+  //! number of deadlines missed, the loop running longer than its period
+  unsigned long nb_missed;
+  //! mean delay between a deadline and the effective wakeup
+  boost::chrono::nanoseconds mean_lateness;
+  //! largest delay between a deadline and the effective wakeup
+  boost::chrono::nanoseconds max_lateness;
+
+  SchedulerStats();
+  //! combine the statistics of another loop
+  void merge(const SchedulerStats & other);
+};
+
+/*!
+  \class DeadlineScheduler
+  \brief wait for the next period of a loop, on the monotonic clock
+ */
+class DeadlineScheduler
+{
+public:
+  /*!
+    \brief constructor
+    \param frequency number of wakeups per second
+   */
+  explicit DeadlineScheduler(double frequency);
+  //! destructor
+  ~DeadlineScheduler();
+
+  //! set the first deadline one period from now
+  void start();
+  /*!
+    \brief sleep until the next deadline, or an interruption
+    \return true at the deadline, false if interrupted: the deadline is then kept for the next wait
+    \note deadlines already passed are counted as missed and skipped, so that late loops do not burst
+   */
+  bool wait();
+  /*!
+    \brief end the current wait at once (can be called from any thread)
+    \note an interruption requested while not waiting ends the next wait, unless start is called before
+   */
+  void interrupt();
+  //! statistics since the start (can be called from any thread)
+  SchedulerStats getStats() const;
+  //! restart the statistics
+  void resetStats();
+
+private:
+  //! period, in ns
+  long long period_ns_;
+  //! next deadline, in ns on the monotonic clock
+  long long deadline_ns_;
+  //! sum of the lateness measured, in ns
+  long long lateness_sum_ns_;
+  //! statistics, lateness mean excluded
+  SchedulerStats stats_;
+  //! statistics are read from other threads
+  mutable boost::mutex mutex_;
+  //! timerfd armed on the deadline, -1 if not available (waits not interruptible)
+  int timer_fd_;
+  //! eventfd signalled by interrupt, -1 if not available (waits not interruptible)
+  int interrupt_fd_;
+};
+
+#endif // OPTOFORCE_SCHEDULER_HPP
@@ -0,0 +1,86 @@
+/**
+ * @file   optoforce_seqlock.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Latest value shared by one writer thread with any number of reader threads,
+ *        without lock nor allocation on either side.
+ */
+
+#ifndef OPTOFORCE_SEQLOCK_HPP
+#define OPTOFORCE_SEQLOCK_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <boost/atomic.hpp>
+
+/*!
+  \class SeqlockValue
+  \brief value overwritten by a single writer, and copied by readers that never block it
+
+  The sequence number is odd while the writer updates the value. A reader copies the value between
+  two reads of the sequence, and starts again if it changed: the writer never waits, and a reader
+  only retries when a store overlaps its copy, which lasts a few ns for a sample.
+  \warning T is to be trivially copyable (plain data), as copied with memcpy; store is to be called by one thread only
+ */
+template <typename T>
+class SeqlockValue
+{
+public:
+  SeqlockValue() : sequence_(0), value_() {}
+
+  //! replace the value (writer side)
+  void store(const T & value)
+  {
+    size_t sequence = sequence_.load(boost::memory_order_relaxed);
+    sequence_.store(sequence + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    std::memcpy(&value_, &value, sizeof(value_));
+    sequence_.store(sequence + 2, boost::memory_order_release);
+  }
+
+  /*!
+    \brief copy the value, if not being stored meanwhile
+    \param value receives the value
+    \return false if a store overlapped the copy, value being then meaningless
+   */
+  bool tryLoad(T & value) const
+  {
+    size_t sequence = sequence_.load(boost::memory_order_acquire);
+    if (sequence & 1)
+      return false;
+    std::memcpy(&value, &value_, sizeof(value_));
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    return sequence_.load(boost::memory_order_relaxed) == sequence;
+  }
+
+  //! copy the value, retrying while stores overlap the copy
+  void load(T & value) const
+  {
+    while (!tryLoad(value))
+      ;
+  }
+
+  //! number of stores since the construction
+  size_t getNumberStores() const
+  {
+    return sequence_.load(boost::memory_order_acquire) / 2;
+  }
+
+private:
+  // no copy: shared between threads
+  SeqlockValue(const SeqlockValue &);
+  SeqlockValue & operator=(const SeqlockValue &);
+
+  //! odd while the value is being stored
+  boost::atomic<size_t> sequence_;
+  //! latest value stored
+  T value_;
+  //! keeps the neighbour values on other cache lines
+  char padding_[64];
+};
+
+#endif // OPTOFORCE_SEQLOCK_HPP
@@ -0,0 +1,200 @@
+/**
+ * @file   optoforce_shm.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Publication of the live samples of a device in POSIX shared memory, for other processes:
+ *        the latest sample and a short history, in a versioned ring that readers never lock.
+ */
+
+#ifndef OPTOFORCE_SHM_HPP
+#define OPTOFORCE_SHM_HPP
+
+#include "optoforce/optoforce_sample.hpp"
+#include <string>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+
+//! first bytes of a shared memory segment
+const char SHM_MAGIC[8] = {'O', 'P', 'T', 'O', 'S', 'H', 'M', '\0'};
+//! version of the shared memory layout, increased at each incompatible change
+const uint32_t SHM_VERSION = 1;
+//! default number of samples kept in the history of a device
+const uint32_t SHM_HISTORY_SIZE = 1024;
+
+/*!
+  \struct ShmSample
+  \brief a sample, as published
+ */
+struct ShmSample
+{
+  //! index of the sample since the publication start
+  uint64_t index;
+  //! acquisition instant, in ns of the monotonic clock (CLOCK_MONOTONIC, shared by the processes of the host)
+  int64_t acq_time_ns;
+  //! publication instant, in ns of the same clock
+  int64_t publish_time_ns;
+  //! forces then torques (torques are 0 for a 3D sensor)
+  float wrench[6];
+};
+
+/*!
+  \struct ShmSlot
+  \brief slot of the history ring
+  \note sequence is odd while the writer fills the slot, and 2 * (index + 1) once sample index is complete
+ */
+struct ShmSlot
+{
+  boost::atomic<uint64_t> sequence;
+  ShmSample sample;
+};
+
+/*!
+  \struct ShmHeader
+  \brief description of the device, at the beginning of the segment, followed by the history ring
+ */
+struct ShmHeader
+{
+  //! SHM_MAGIC, written last once the segment is ready
+  char magic[8];
+  //! SHM_VERSION
+  uint32_t version;
+  //! number of slots of the history ring
+  uint32_t history_size;
+  //! serial number of the daq, null terminated
+  char serial_number[32];
+  //! number of meaningful axes (3 or 6)
+  uint32_t nb_axes;
+  //! process id of the publisher
+  uint32_t publisher_pid;
+  //! nominal sample frequency, in Hz
+  double sample_frequency;
+  //! number of samples published, the latest one being nb_published - 1
+  boost::atomic<uint64_t> nb_published;
+  //! room for future fields, kept to 0
+  char padding[32];
+};
+
+/*!
+  \brief name of the shared memory segment of a device
+  \param serial_number serial number of the device
+  \return "/optoforce_<serial_number>"
+ */
+std::string getShmName(const std::string & serial_number);
+
+/*!
+  \class ShmPublisher
+  \brief create the segment of a device, and publish its samples (single writer)
+ */
+class ShmPublisher
+{
+public:
+  ShmPublisher();
+  //! destructor, removing the segment
+  ~ShmPublisher();
+
+  /*!
+    \brief create the segment, replacing a former one
+    \param serial_number serial number of the device, naming the segment
+    \param nb_axes number of meaningful axes (3 or 6)
+    \param sample_frequency nominal sample frequency, in Hz
+    \param history_size number of slots (at least 2), ShmSubscriber::read getting the history_size - 1 last samples
+    \return true if the segment could be created
+   */
+  bool open(const std::string & serial_number, uint32_t nb_axes, double sample_frequency,
+            uint32_t history_size = SHM_HISTORY_SIZE);
+  //! remove the segment, the attached readers keeping their mapping
+  void close();
+  //! whether a segment is published
+  bool isOpen() const { return header_ != NULL; }
+
+  /*!
+    \brief publish samples, without waiting for the readers
+    \param samples samples to publish, oldest first
+    \param nb_samples number of samples
+   */
+  void publish(const StampedSample * samples, size_t nb_samples);
+
+private:
+  // no copy: the mapping is owned
+  ShmPublisher(const ShmPublisher &);
+  ShmPublisher & operator=(const ShmPublisher &);
+
+  //! name of the segment
+  std::string name_;
+  //! mapped segment, NULL if none
+  ShmHeader * header_;
+  //! history ring, following the header
+  ShmSlot * slots_;
+  //! size of the mapping
+  size_t size_;
+};
+
+/*!
+  \class ShmSubscriber
+  \brief attach to the segment of a device, and read its samples (any number of readers)
+  \note reading never blocks the publisher: a sample overwritten while being read is read again
+ */
+class ShmSubscriber
+{
+public:
+  ShmSubscriber();
+  //! destructor, detaching
+  ~ShmSubscriber();
+
+  /*!
+    \brief attach to the segment of a device
+    \param serial_number serial number of the device
+    \return false if no acquisition publishes the device
+   */
+  bool attach(const std::string & serial_number);
+  //! detach from the segment
+  void detach();
+  //! whether attached
+  bool isAttached() const { return header_ != NULL; }
+
+  //! serial number of the device
+  std::string getSerialNumber() const;
+  //! number of meaningful axes
+  uint32_t getNumberAxes() const { return header_ ? header_->nb_axes : 0; }
+  //! nominal sample frequency, in Hz
+  double getSampleFrequency() const { return header_ ? header_->sample_frequency : 0.0; }
+  //! number of samples published so far
+  uint64_t getNumberPublished() const;
+
+  /*!
+    \brief get the latest sample
+    \param sample receives the sample
+    \return false if no sample is published yet
+   */
+  bool getLatest(ShmSample & sample) const;
+  /*!
+    \brief get the samples published since a given one
+    \param next_index index of the first sample wished, moved after the last sample got
+    \param samples receives the samples, oldest first
+    \param max_samples maximum number of samples to get
+    \return number of samples got. Samples older than the history are skipped:
+            next_index then jumps forward, and the first sample got tells the gap
+   */
+  size_t read(uint64_t & next_index, ShmSample * samples, size_t max_samples) const;
+
+private:
+  // no copy: the mapping is owned
+  ShmSubscriber(const ShmSubscriber &);
+  ShmSubscriber & operator=(const ShmSubscriber &);
+
+  //! copy the sample of a given index, false if it is not (or no more) in its slot
+  bool readSlot(uint64_t index, ShmSample & sample) const;
+
+  //! mapped segment, NULL if none
+  const ShmHeader * header_;
+  //! history ring, following the header
+  const ShmSlot * slots_;
+  //! size of the mapping
+  size_t size_;
+};
+
+#endif // OPTOFORCE_SHM_HPP
@@ -0,0 +1,181 @@
+/**
+ * @file   optoforce_simulated_backend.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief In-process simulation of Optoforce daq, to run the drivers without any sensor.
+ *        The samples are generated according to the time elapsed, with the configured rate,
+ *        delivery pattern and buffer capacity.
+ */
+
+#ifndef OPTOFORCE_SIMULATED_BACKEND_HPP
+#define OPTOFORCE_SIMULATED_BACKEND_HPP
+
+#include <string>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include "optoforce/optoforce_backend.hpp"
+
+//! behavior of a simulated daq whose buffer is full
+enum simulated_overflow { overflow_drop_oldest = 0, overflow_error };
+//! values generated by a simulated daq
+enum simulated_signal { signal_sine = 0, signal_counter };
+
+/*!
+  \struct SimulatedDeviceConfig
+  \brief characteristics of a simulated daq
+ */
+struct SimulatedDeviceConfig
+{
+  //! default: 6D sensor at 1kHz, each sample delivered on its own
+  SimulatedDeviceConfig();
+
+  //! serial number reported by the port
+  std::string serial_number;
+  //! whether the daq handles 3D sensors (6D otherwise)
+  bool is_3D_sensor;
+  //! number of sensors connected to a 3D daq (1 for a 6D one)
+  int nb_channels;
+  //! initial speed, as a real device it can then be changed with sendConfig
+  sensor_speed speed;
+  //! number of samples delivered together (USB transfers)
+  int burst_size;
+  //! maximum delay added to the delivery of a burst, in s
+  double jitter;
+  //! number of samples the daq can buffer (per channel)
+  int buffer_size;
+  //! what happens when the buffer is full
+  simulated_overflow overflow;
+  //! noisy sines, or a counter (sample index % 65536 * 64 + channel * 8 + axis) to check the delivery
+  simulated_signal signal;
+  //! seed of the jitter and noise generation
+  unsigned int seed;
+  //! how much faster than real time the samples are generated (1 for the sensor speed)
+  double time_scale;
+  //! duration of each read (USB transfer), in s
+  double read_delay;
+};
+
+/*!
+  \struct SimulatedDeviceStats
+  \brief counters of a simulated daq, since its opening
+ */
+struct SimulatedDeviceStats
+{
+  //! samples delivered by the daq, per channel
+  unsigned long nb_delivered;
+  //! samples read by the driver, per channel
+  unsigned long nb_read;
+  //! samples lost due to buffer overflows, per channel
+  unsigned long nb_lost;
+  //! number of reads done
+  unsigned long nb_reads;
+  //! mean time the oldest sample of a read waited in the daq, in s
+  double mean_latency;
+  //! longest time a sample waited in the daq, in s
+  double max_latency;
+};
+
+class SimulatedDevice;
+
+/*!
+  \class SimulatedDaq
+  \brief handler of a simulated daq, as created by the SimulatedBackend
+ */
+class SimulatedDaq : public OptoForceDaq
+{
+public:
+  /*!
+    \brief constructor
+    \param devices devices known, looked up by port name at opening
+   */
+  SimulatedDaq(const std::vector< boost::shared_ptr<SimulatedDevice> > & devices);
+  virtual ~SimulatedDaq();
+
+  virtual bool open(const OPort & port);
+  virtual void close();
+  virtual bool isOpen();
+  virtual opto_version getVersion();
+  virtual int getSensorSize();
+  virtual SensorConfig getConfig();
+  virtual bool sendConfig(const SensorConfig & config);
+  virtual bool zero(int number);
+  virtual void zeroAll();
+  virtual int readAll(RawCounts & counts);
+  virtual void getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const;
+
+protected:
+  //! devices that can be opened
+  std::vector< boost::shared_ptr<SimulatedDevice> > devices_;
+  //! device opened, NULL if closed
+  boost::shared_ptr<SimulatedDevice> device_;
+  //! counts of the last read, channel after channel, kept from one read to the other
+  std::vector<int> counts_;
+  //! number of staging (re)allocations so far
+  unsigned long nb_allocations_;
+  //! number of staging bytes (re)allocated so far
+  unsigned long nb_bytes_;
+};
+
+/*!
+  \class SimulatedPortEnumerator
+  \brief listing of the simulated daq, all of them being connected from the start
+ */
+class SimulatedPortEnumerator : public OptoForcePortEnumerator
+{
+public:
+  SimulatedPortEnumerator(const std::vector<OPort> & ports);
+
+  virtual int getSize();
+  virtual std::vector<OPort> listPorts();
+
+protected:
+  //! ports of the simulated daq
+  std::vector<OPort> ports_;
+};
+
+/*!
+  \class SimulatedBackend
+  \brief set of simulated daq, seen as connected to the computer
+ */
+class SimulatedBackend : public OptoForceBackend
+{
+public:
+  SimulatedBackend();
+  /*!
+    \brief constructor with a set of daq
+    \param configs characteristics of each daq
+   */
+  SimulatedBackend(const std::vector<SimulatedDeviceConfig> & configs);
+  virtual ~SimulatedBackend();
+
+  /*!
+    \brief add a simulated daq
+    \param config characteristics of the daq
+    \warning to be done before creating the enumerators and the daq handlers
+   */
+  void addDevice(const SimulatedDeviceConfig & config);
+  //! number of simulated daq
+  int getNumberDevices() const;
+  /*!
+    \brief get the counters of a daq
+    \param serial_number identificator of the device of interest
+    \param stats counters of the device
+    \return true if the device exists
+   */
+  bool getDeviceStats(const std::string & serial_number, SimulatedDeviceStats & stats) const;
+
+  virtual OptoForcePortEnumerator * createPortEnumerator();
+  virtual OptoForceDaq * createDaq();
+
+protected:
+  //! simulated devices, shared with the daq handlers
+  std::vector< boost::shared_ptr<SimulatedDevice> > devices_;
+};
+
+#endif // OPTOFORCE_SIMULATED_BACKEND_HPP
@@ -0,0 +1,262 @@
+/**
+ * @file   optoforce_stream.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Streaming of the samples read by the acquisition to clients connected on a TCP or
+ *        Unix-domain socket, in binary frames, each client having its own bounded queue.
+ */
+
+#ifndef OPTOFORCE_STREAM_HPP
+#define OPTOFORCE_STREAM_HPP
+
+#include "optoforce/optoforce_ring.hpp"
+#include "optoforce/optoforce_subscription.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+class OptoforceAcquisition;
+
+//! first bytes sent to a client
+const char STREAM_MAGIC[8] = {'O', 'P', 'T', 'O', 'S', 'T', 'R', '\0'};
+//! version of the stream layout, increased at each incompatible change
+const uint32_t STREAM_VERSION = 1;
+//! marker of each frame
+const uint32_t STREAM_FRAME_MARKER = 0x4d52464fu;  // "OFRM"
+
+/*!
+  \struct StreamHello
+  \brief sent once to each client, followed by nb_devices serial numbers of 32 bytes (null terminated)
+  \note all fields are in the byte order of the server host
+ */
+struct StreamHello
+{
+  //! STREAM_MAGIC
+  char magic[8];
+  //! STREAM_VERSION
+  uint32_t version;
+  //! number of devices streamed, their index being the order of the serial numbers
+  uint32_t nb_devices;
+};
+
+/*!
+  \struct StreamFrameHeader
+  \brief header of a frame, followed by nb_samples StreamSample
+ */
+struct StreamFrameHeader
+{
+  //! STREAM_FRAME_MARKER
+  uint32_t marker;
+  //! number of samples of the frame
+  uint32_t nb_samples;
+  //! samples dropped for this client since its previous frame, its queue being full
+  uint32_t nb_dropped;
+  //! kept to 0
+  uint32_t reserved;
+  //! instant the frame was built, in ns of the monotonic clock
+  int64_t send_time_ns;
+};
+
+/*!
+  \struct StreamSample
+  \brief a sample, as streamed
+ */
+struct StreamSample
+{
+  //! index of the device
+  uint32_t device;
+  //! index of the sample for its device since the server started, a jump telling dropped samples
+  uint32_t index;
+  //! acquisition instant, in ns of the monotonic clock (comparable on the host only)
+  int64_t acq_time_ns;
+  //! forces then torques (torques are 0 for a 3D sensor)
+  float wrench[6];
+};
+
+//! what the server does with a client whose queue is full
+enum stream_overflow {stream_drop_oldest = 0,  //!< the oldest samples queued are dropped, and reported in the next frame
+                      stream_disconnect};      //!< the client is disconnected
+
+/*!
+  \struct StreamServerConfig
+  \brief parameters of a streaming server
+ */
+struct StreamServerConfig
+{
+  //! largest number of samples per frame: a frame is sent as soon as it is full
+  size_t batch_size;
+  //! latency budget, in ns: a partial frame is sent once its oldest sample is that old (from its stamp)
+  int64_t max_latency_ns;
+  //! number of samples queued per client
+  size_t queue_size;
+  //! policy once a client queue is full
+  stream_overflow overflow;
+  //! socket send buffer per client, in bytes (0 for the system default, growing up to megabytes):
+  //! beyond it, the samples wait in the client queue, where the overflow policy applies
+  int send_buffer_size;
+
+  StreamServerConfig() : batch_size(64), max_latency_ns(1000000), queue_size(65536), overflow(stream_drop_oldest),
+                         send_buffer_size(65536) {}
+};
+
+/*!
+  \struct StreamServerStats
+  \brief activity of a streaming server
+ */
+struct StreamServerStats
+{
+  //! clients connected
+  size_t nb_clients;
+  //! clients accepted since the start
+  unsigned long nb_accepted;
+  //! clients disconnected by the server, their queue being full
+  unsigned long nb_evicted;
+  //! samples sent, over all clients
+  unsigned long long nb_sent;
+  //! samples dropped from the client queues, over all clients,
+  //! and before reaching them when the server thread does not keep up
+  unsigned long long nb_dropped;
+};
+
+/*!
+  \class StreamServer
+  \brief stream the samples of an acquisition to the clients of a socket
+
+  The server subscribes to the acquisition through an executor, and a single thread serves all clients
+  without blocking: each one gets the samples through its own bounded queue, by frames of batch_size
+  samples at most, a partial frame being sent once its oldest sample is max_latency_ns old.
+  A slow client only loses its own samples (or its connection), the acquisition never waits.
+ */
+class StreamServer
+{
+public:
+  StreamServer();
+  //! destructor, stopping the server
+  ~StreamServer();
+
+  /*!
+    \brief listen on an endpoint, and stream the samples the acquisition reads
+    \param acquisition acquisition, with its devices initialized, that outlives the server
+    \param endpoint "tcp:<port>" (all interfaces), "tcp:<host>:<port>", or "unix:<path>"
+    \param config batching and queuing parameters
+    \return false if the endpoint can not be listened to
+   */
+  bool start(OptoforceAcquisition & acquisition, const std::string & endpoint,
+             const StreamServerConfig & config = StreamServerConfig());
+  //! unsubscribe, send the clients the samples left, and disconnect them
+  void stop();
+  //! whether the server runs
+  bool isRunning() const { return thread_.get() != NULL; }
+
+  //! get the activity of the server
+  StreamServerStats getStats();
+
+private:
+  //! connected client
+  struct Client;
+
+  // no copy: shared with the server thread
+  StreamServer(const StreamServer &);
+  StreamServer & operator=(const StreamServer &);
+
+  //! subscription callback, queuing the samples for the server thread
+  void onBatch(const SampleBatch & batch);
+  //! server thread, accepting the clients and sending them the frames
+  void serverThread();
+  //! move the samples received to the client queues
+  void dispatchSamples(std::vector< boost::shared_ptr<Client> > & clients);
+  //! build the next frame of a client, if due or if flushing
+  void buildFrame(Client & client, int64_t now_ns, bool is_flush);
+  //! send the frames of a client as far as its socket takes them, without waiting
+  void sendFrames(Client & client, int64_t now_ns, bool is_flush);
+  //! on stop, send the clients all the samples left, within a second
+  void flushClients(std::vector< boost::shared_ptr<Client> > & clients);
+
+  //! acquisition streamed
+  OptoforceAcquisition * acquisition_;
+  //! subscription to the acquisition
+  int subscription_;
+  //! parameters
+  StreamServerConfig config_;
+  //! listening socket
+  int listen_fd_;
+  //! path of the Unix socket, removed on stop
+  std::string unix_path_;
+  //! wakes the server thread up (eventfd)
+  int wakeup_fd_;
+  //! serial numbers of the devices, for the clients
+  std::vector<std::string> serial_numbers_;
+  //! next index per device, only used by the subscription executor
+  std::vector<uint32_t> indexes_;
+  //! samples of a batch, converted by the subscription executor
+  std::vector<StreamSample> converted_;
+  //! samples from the subscription, for the server thread
+  boost::shared_ptr< SpscRing<StreamSample> > input_;
+  //! samples the server thread received from input_, before copying them to each client
+  std::vector<StreamSample> received_;
+  //! whether the server thread is to stop
+  boost::atomic<bool> is_stop_request_;
+  //! server thread
+  boost::shared_ptr<boost::thread> thread_;
+  //! protects stats_
+  boost::mutex mutex_;
+  //! activity of the server
+  StreamServerStats stats_;
+};
+
+/*!
+  \class StreamClient
+  \brief connection to a streaming server, reading its frames
+ */
+class StreamClient
+{
+public:
+  StreamClient();
+  //! destructor, disconnecting
+  ~StreamClient();
+
+  /*!
+    \brief connect to a server, and read the devices it streams
+    \param endpoint "tcp:<host>:<port>", "tcp:<port>" (local host) or "unix:<path>"
+    \return false if the connection failed, or the server is not a compatible one
+   */
+  bool connect(const std::string & endpoint);
+  //! close the connection
+  void disconnect();
+  //! whether connected
+  bool isConnected() const { return fd_ >= 0; }
+
+  //! serial numbers of the devices streamed, in the order of their indexes
+  const std::vector<std::string> & getSerialNumbers() const { return serial_numbers_; }
+
+  /*!
+    \brief wait for the next frame
+    \param samples receives the samples of the frame
+    \param nb_dropped receives the number of samples the server dropped before this frame
+    \param timeout_ms longest wait, -1 for no limit
+    \return false on timeout, error, or disconnection (isConnected then telling)
+   */
+  bool receive(std::vector<StreamSample> & samples, unsigned long & nb_dropped, int timeout_ms = -1);
+
+private:
+  // no copy: the connection is owned
+  StreamClient(const StreamClient &);
+  StreamClient & operator=(const StreamClient &);
+
+  //! read exactly nb_bytes, false on error, disconnection or timeout before the first byte
+  bool readAll(void * data, size_t nb_bytes, int timeout_ms);
+
+  //! connected socket, -1 if none
+  int fd_;
+  //! serial numbers of the devices
+  std::vector<std::string> serial_numbers_;
+};
+
+#endif // OPTOFORCE_STREAM_HPP
@@ -0,0 +1,135 @@
+/**
+ * @file   optoforce_subscription.hpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Subscription to the samples read by the acquisition, delivered by batch to a callback,
+ *        either from the thread reading the device, or from a thread of the subscriber.
+ */
+
+#ifndef OPTOFORCE_SUBSCRIPTION_HPP
+#define OPTOFORCE_SUBSCRIPTION_HPP
+
+#include "optoforce/optoforce_ring.hpp"
+#include "optoforce/optoforce_sample.hpp"
+#include <cstddef>
+#include <vector>
+#include <semaphore.h>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+//! default number of samples an executor subscription queues per device
+const size_t SUBSCRIPTION_QUEUE_SIZE = 4096;
+
+/*!
+  \struct SampleBatch
+  \brief samples newly read from a device, as given to a subscriber
+  \note the samples are only valid during the callback
+ */
+struct SampleBatch
+{
+  //! index of the device, in the recording order
+  size_t device;
+  //! samples, oldest first, stamped as recorded
+  const StampedSample * samples;
+  //! number of samples
+  size_t nb_samples;
+  //! samples of the device lost by this subscriber since its previous batch, its queue being full
+  unsigned long nb_missed;
+};
+
+//! function receiving the batches of a subscription
+typedef boost::function<void (const SampleBatch &)> SampleCallback;
+
+//! thread calling the subscription callback
+enum dispatch_mode {dispatch_inline = 0, //!< the thread reading the device: the callback must return quickly
+                    dispatch_executor};  //!< a thread of the subscription, fed through a bounded queue per device
+
+/*!
+  \class SampleSubscription
+  \brief delivery of the samples read to a callback, never blocking the acquisition
+
+  Inline, the callback gets the samples where they were stamped, without copy. Through the executor,
+  the samples are queued per device and the callback is called from the subscription thread: when the
+  subscriber does not keep up, the samples not fitting in its queue are dropped and counted as overruns.
+  Inline, a callback lasting longer than the acquisition period is counted as an overrun.
+ */
+class SampleSubscription
+{
+public:
+  /*!
+    \brief constructor, starting the executor thread if needed
+    \param callback function receiving the batches
+    \param device index of the device followed, -1 for all devices
+    \param nb_devices number of devices read
+    \param mode thread calling the callback
+    \param queue_size number of samples queued per device, with dispatch_executor
+    \param period_ns acquisition period, longest duration of an inline callback
+   */
+  SampleSubscription(const SampleCallback & callback, int device, size_t nb_devices,
+                     dispatch_mode mode, size_t queue_size, int64_t period_ns);
+  //! destructor, delivering the samples queued, and stopping the executor thread
+  ~SampleSubscription();
+
+  //! whether the samples of a device are followed
+  bool isFollowing(size_t device) const
+  {
+    return (device_ < 0) || ((size_t) device_ == device);
+  }
+
+  /*!
+    \brief deliver samples newly read, called by the thread reading the device
+    \param device index of the device
+    \param samples samples, oldest first
+    \param nb_samples number of samples
+   */
+  void deliver(size_t device, const StampedSample * samples, size_t nb_samples);
+
+  //! number of samples dropped (executor), or of callbacks lasting longer than the period (inline)
+  unsigned long getNumberOverruns() const
+  {
+    return nb_overruns_.load(boost::memory_order_relaxed);
+  }
+
+private:
+  // no copy: shared with the executor thread
+  SampleSubscription(const SampleSubscription &);
+  SampleSubscription & operator=(const SampleSubscription &);
+
+  //! executor thread, delivering the queued samples
+  void executorThread();
+  //! deliver the samples queued for a device, false if none
+  bool deliverQueued(size_t device, std::vector<StampedSample> & samples);
+
+  //! function receiving the batches
+  SampleCallback callback_;
+  //! device followed, -1 for all
+  const int device_;
+  //! thread calling the callback
+  const dispatch_mode mode_;
+  //! longest duration of an inline callback, in ns
+  const int64_t period_ns_;
+  //! overruns, see getNumberOverruns
+  boost::atomic<unsigned long> nb_overruns_;
+
+  //! samples waiting for the executor, per device (one producer each)
+  std::vector< boost::shared_ptr< SpscRing<StampedSample> > > queues_;
+  //! samples dropped per device since its previous batch
+  boost::scoped_array< boost::atomic<unsigned long> > nb_missed_;
+  //! whether the executor is about to wait, so that the readers wake it up
+  boost::atomic<bool> is_waiting_;
+  //! whether the executor is to stop
+  boost::atomic<bool> is_stop_request_;
+  //! posted to wake the executor up, without blocking the readers
+  sem_t wakeup_;
+  //! executor thread, with dispatch_executor
+  boost::shared_ptr<boost::thread> thread_;
+};
+
+#endif // OPTOFORCE_SUBSCRIPTION_HPP
@@ -11,23 +11,76 @@
  */
 
 #include "optoforce/optoforce_acquisition.hpp"
+#include <cstdio>
 #include <iostream>
+#include <limits>
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include "boost/date_time/c_local_time_adjustor.hpp"
 
-// the maximum number of samples is hardcoded to 5min supposing a 1Khz sensor acq
+// samples buffered per device for the background writer: 1 min at 1kHz
+static const size_t WRITER_BUFFER_SIZE = 64 * 1024;
+// period of the background writer passes
+static const int WRITE_PERIOD_MS = 50;
+// samples per chunk of the recording buffers
+static const size_t RECORD_CHUNK_SIZE = 4096;
+// samples reserved per device for the recordings without limit, before any chunk allocation: 1 min at 1kHz
+static const size_t RECORD_RESERVE_SIZE = 64 * 1024;
+// samples read per device at once, the buffer growing if a larger burst is pending: 1 s at 1kHz
+static const size_t READ_BUFFER_SIZE = 1024;
+// largest delay of a sample delivery, from its acquisition: a device polled without new sample
+// lets the merge go on up to that delay before the poll
+static const int64_t MERGE_LATENESS_NS = 50000000;
+
+OptoforceAcquisition::WriterStats::WriterStats() : nb_written(0),
+                                                   backlog(0),
+                                                   max_backlog(0),
+                                                   nb_flushes(0),
+                                                   mean_flush_latency(0),
+                                                   max_flush_latency(0)
+{
+}
+
+// end of the name of a segment file, after the name of the recording
+static std::string getSegmentSuffix(size_t index)
+{
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "_%03u.opto", (unsigned int) index);
+  return suffix;
+}
+
 OptoforceAcquisition::OptoforceAcquisition() : device_enumerator_(NULL),
+                                               nb_dropped_samples_(0),
+                                               nb_devices_complete_(0),
+                                               is_time_zero_set_(false),
+                                               nb_reader_threads_(0),
+                                               is_merging_(false),
+                                               merge_last_ns_(0),
+                                               nb_late_merged_(0),
                                                is_recording_(false),
                                                is_reading_(false),
                                                is_stop_recording_request_(false),
                                                is_stop_reading_request_(false),
                                                is_start_recording_request_(false),
+                                               is_start_reading_request_(false),
+                                               is_exit_request_(false),
+                                               acquisition_freq_(1000),
+                                               recording_format_(recording_binary),
+                                               csv_time_decimals_(3),
+                                               csv_value_decimals_(4),
+                                               merge_output_(merge_none),
+                                               merge_period_ns_(1000000),
+                                               segment_duration_ns_(0),
+                                               segment_max_bytes_(0),
+                                               shm_publication_(false),
+                                               shm_history_size_(SHM_HISTORY_SIZE),
+                                               next_subscription_id_(0),
+                                               is_stop_writing_request_(false),
                                                auto_store_(true),
-                                               max_num_samples_ (5 * 60 * 1000),
-                                               acquisition_freq_(1000)
+                                               nb_speed_changes_(0)
 {
   filename_ = "";
-  desired_num_samples_ = max_num_samples_;
+  desired_num_samples_ = -1;
+  resetLoopStats();
 }
 
 OptoforceAcquisition::~OptoforceAcquisition()
@@ -39,17 +92,30 @@ OptoforceAcquisition::~OptoforceAcquisition()
     stopRecording();
     std::cout << " acquisition stopped" << std::endl;
   }
+  if (isReading())
+    stopReading();
+  if (thread_acq_)
+  {
+    mutex_.lock();
+    is_exit_request_ = true;
+    mutex_.unlock();
+    state_changed_.notify_all();
+    thread_acq_->join();
+  }
+  if (thread_writer_)
+    thread_writer_->join();
   closeDevices();
   std::cout << "object getting destructed" << std::endl;
 }
 
 // todo handle the data desallocation on error
 //todo avoid hardcoding the frequency in it.
-bool OptoforceAcquisition::initDevices(const int nb_devices)
+bool OptoforceAcquisition::initDevices(const int nb_devices, OptoForceBackend * backend)
 {
   //check if some devices are already connected. If so, just close it
   //todo handle such capability
-  device_enumerator_ = new OptoForceArrayDriver(nb_devices);
+  device_enumerator_ = new OptoForceArrayDriver(nb_devices,
+                                                backend ? backend->createPortEnumerator() : NULL);
 
   // look for the expected devices.
   if (!device_enumerator_->WaitUntilPortsFound(500))
@@ -66,7 +132,7 @@ bool OptoforceAcquisition::initDevices(const int nb_devices)
        it != ports.end();
        ++it)
   {
-    new_device = new OptoForceDriver();
+    new_device = new OptoForceDriver(backend ? backend->createDaq() : NULL);
     bool success = new_device->openDevice(*it);
     if (success)
     {
@@ -178,9 +244,54 @@ void OptoforceAcquisition::closeDevices()
 
 bool OptoforceAcquisition::startRecording()
 {
+  // a recording running is ended first: its writer only completes once stopped
+  if (isRecording())
+  {
+    std::cerr << "[OptoforceAcquisition::startRecording] a recording is running: it is stopped first" << std::endl;
+    stopRecording();
+  }
+  // the files of the previous recording are to be completed, before the buffers are reused
+  if (thread_writer_)
+  {
+    thread_writer_->join();
+    thread_writer_.reset();
+  }
+
+  // the reader threads may still be in a pass: the buffers are rebuilt once it is over
+  boost::unique_lock<boost::shared_mutex> record_lock(record_mutex_);
+  // the recording buffers are kept from one recording to the other, their chunks being reused
+  size_t capacity = getRecordCapacity();
+  if ((record_queues_.size() != devices_recorded_.size()) ||
+      (!record_queues_.empty() && record_queues_[0]->capacity() != capacity))
+  {
+    record_queues_.clear();
+    for (size_t i = 0; i < devices_recorded_.size(); ++i)
+      record_queues_.push_back(boost::shared_ptr< SpscChunkQueue<StampedSample> >(
+        new SpscChunkQueue<StampedSample>(capacity, RECORD_CHUNK_SIZE)));
+    merge_watermarks_.reset(new boost::atomic<int64_t>[record_queues_.size()]);
+  }
+  for (size_t i = 0; i < record_queues_.size(); ++i)
+    merge_watermarks_[i] = std::numeric_limits<int64_t>::min();
+  for (size_t i = 0; i < record_queues_.size(); ++i)
+  {
+    record_queues_[i]->reset();
+    record_queues_[i]->reserve(capacity ? capacity : RECORD_RESERVE_SIZE);
+  }
+  has_merge_head_.assign(record_queues_.size(), false);
+  merge_last_ns_ = std::numeric_limits<int64_t>::min();
+  nb_late_merged_ = 0;
+  is_merging_ = (merge_output_ != merge_none);
+  record_lock.unlock();
+
+  nb_devices_complete_ = 0;
   mutex_.lock();
+  nb_dropped_samples_ = 0;
+  writer_stats_ = WriterStats();
+  is_stop_writing_request_ = false;
   is_start_recording_request_ = true;
   is_stop_recording_request_ = false;
+  // the samples stamped from now on are recorded, whatever the pass reading them
+  record_start_time_ = boost::chrono::high_resolution_clock::now();
   mutex_.unlock();
 
   std::cout << "[ OptoforceAcquisition::startRecording] is_start_recording_request: " << is_start_recording_request_ << std::endl;
@@ -189,15 +300,21 @@ bool OptoforceAcquisition::startRecording()
   mutex_.lock();
   is_recording_ = true;
   mutex_.unlock();
+  state_changed_.notify_all();
+
+  // the samples are written while recording, so that the memory used does not grow with the duration
+  if (auto_store_)
+    thread_writer_ = boost::shared_ptr< boost::thread >(new boost::thread(boost::bind(&OptoforceAcquisition::writerThread, this)));
 
   if (!isReading())
-    startReading();
+    return startReading();
+  return true;
 }
 // todo can we use the value of thread_acq_ to know whether it is active or not?
 bool OptoforceAcquisition::startRecording(int num_samples)
 {
-
-
+  setDesiredNumberSamples(num_samples);
+  return startRecording();
 }
 // todo can we use the value of thread_acq_ to know whether it is active or not?
 void OptoforceAcquisition::setAutoStore(bool auto_store)
@@ -209,11 +326,8 @@ void OptoforceAcquisition::setAutoStore(bool auto_store)
 bool OptoforceAcquisition::startReading()
 {
   std::cout << "startReading" << std::endl;
-  std::cout << "is reading: " << is_reading_ << std::endl;
-  bool is_reading;
-  mutex_.lock();
-  is_reading = is_reading_;
-  mutex_.unlock();
+  bool is_reading = isReading();
+  std::cout << "is reading: " << is_reading << std::endl;
 
   // If a recording is running, start new recording
   // stopRecording function will set the flag to break acquireThread while loop
@@ -221,30 +335,211 @@ bool OptoforceAcquisition::startReading()
   {
     stopReading();
   }
+
+  // no thread reads the devices: their latest samples can be reset
+  if (latest_samples_.size() != devices_recorded_.size())
+  {
+    latest_samples_.clear();
+    for (size_t i = 0; i < devices_recorded_.size(); ++i)
+      latest_samples_.push_back(boost::shared_ptr< SeqlockValue<LatestSample> >(new SeqlockValue<LatestSample>()));
+  }
+  LatestSample empty_sample = LatestSample();
+  for (size_t i = 0; i < latest_samples_.size(); ++i)
+    latest_samples_[i]->store(empty_sample);
     //return false;
 
-  // not recording, launch it!
+  // not reading, the acquisition thread is woken up to launch it
   mutex_.lock();
   is_reading_ = true;
+  is_start_reading_request_ = true;
   mutex_.unlock();
+  state_changed_.notify_all();
 
-  std::cout << "launching thread" << std::endl;
-  //boost::thread t(&OptoforceAcquisition::acquireThread, this, num_samples, false);
-  //if (thread_acq_ != NULL)
-    //thread_acq_.reset();
+  if (!thread_acq_)
+  {
+    std::cout << "launching thread" << std::endl;
+    thread_acq_ = boost::shared_ptr< boost::thread >(new boost::thread(boost::bind(&OptoforceAcquisition::workerThread, this)));
+  }
+  return true;
+}
 
+void OptoforceAcquisition::workerThread()
+{
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (true)
+  {
+    while (!is_start_reading_request_ && !is_exit_request_)
+      state_changed_.wait(lock);
+    if (is_exit_request_)
+      break;
+    is_start_reading_request_ = false;
 
-    thread_acq_ = boost::shared_ptr< boost::thread >(new boost::thread(boost::bind(&OptoforceAcquisition::acquireThread, this, false)));
+    lock.unlock();
+    acquireThread(false);
+    lock.lock();
+  }
+}
 
-  return true;
+OptoforceAcquisition::RecordWindow OptoforceAcquisition::getRecordWindow()
+{
+  RecordWindow window;
+  mutex_.lock();
+  window.is_recording = is_start_recording_request_;
+  window.start = record_start_time_;
+  window.stop = is_stop_recording_request_ ? record_stop_time_ : boost::chrono::high_resolution_clock::time_point::max();
+  mutex_.unlock();
+  return window;
 }
 
 // return latest data
 void OptoforceAcquisition::getData(std::vector< std::vector<float> > &latest_samples)
 {
-  mutex_sample_.lock();
-  latest_samples = latest_samples_;
-  mutex_sample_.unlock();
+  latest_samples.resize(latest_samples_.size());
+  for (size_t i = 0; i < latest_samples_.size(); ++i)
+  {
+    LatestSample sample;
+    latest_samples_[i]->load(sample);
+    const float * values = &sample.wrench.fx;
+    latest_samples[i].assign(values, values + sample.nb_values);
+  }
+}
+
+size_t OptoforceAcquisition::getLatestSamples(LatestSample * samples, size_t capacity) const
+{
+  size_t nb_samples = std::min(capacity, latest_samples_.size());
+  for (size_t i = 0; i < nb_samples; ++i)
+    latest_samples_[i]->load(samples[i]);
+  return nb_samples;
+}
+
+int OptoforceAcquisition::subscribe(const SampleCallback & callback, int device, dispatch_mode mode,
+                                    size_t queue_size)
+{
+  if ((device >= (int) devices_recorded_.size()) || (device < -1))
+  {
+    std::cerr << "[OptoforceAcquisition::subscribe] no device " << device << std::endl;
+    return -1;
+  }
+
+  boost::shared_ptr<SampleSubscription> subscription(
+    new SampleSubscription(callback, device, devices_recorded_.size(), mode, queue_size,
+                           1000000000LL / std::max(acquisition_freq_, 1)));
+  // the readers see the subscription from their next pass
+  boost::unique_lock<boost::shared_mutex> lock(record_mutex_);
+  subscriptions_.push_back(std::make_pair(next_subscription_id_, subscription));
+  return next_subscription_id_++;
+}
+
+bool OptoforceAcquisition::unsubscribe(int id)
+{
+  boost::shared_ptr<SampleSubscription> subscription;
+  {
+    boost::unique_lock<boost::shared_mutex> lock(record_mutex_);
+    for (size_t i = 0; i < subscriptions_.size(); ++i)
+    {
+      if (subscriptions_[i].first == id)
+      {
+        subscription = subscriptions_[i].second;
+        subscriptions_.erase(subscriptions_.begin() + i);
+        break;
+      }
+    }
+  }
+  // released out of the lock, its executor completing the deliveries
+  return subscription.get() != NULL;
+}
+
+unsigned long OptoforceAcquisition::getNumberOverruns(int id)
+{
+  boost::shared_lock<boost::shared_mutex> lock(record_mutex_);
+  for (size_t i = 0; i < subscriptions_.size(); ++i)
+    if (subscriptions_[i].first == id)
+      return subscriptions_[i].second->getNumberOverruns();
+  return 0;
+}
+
+double OptoforceAcquisition::getEstimatedSampleFrequency(size_t device)
+{
+  if (device >= latest_samples_.size())
+    return 0.0;
+  LatestSample sample;
+  latest_samples_[device]->load(sample);
+  return sample.estimated_frequency;
+}
+
+size_t OptoforceAcquisition::readRecordedSamples(size_t device, StampedSample * samples, size_t capacity)
+{
+  if (device >= record_queues_.size())
+    return 0;
+  return record_queues_[device]->pop(samples, capacity);
+}
+
+size_t OptoforceAcquisition::getRecordCapacity() const
+{
+  if (auto_store_)
+    return WRITER_BUFFER_SIZE;
+  return (desired_num_samples_ > 0) ? desired_num_samples_ : 0;
+}
+
+OptoforceAcquisition::WriterStats OptoforceAcquisition::getWriterStats()
+{
+  WriterStats stats;
+  mutex_.lock();
+  stats = writer_stats_;
+  mutex_.unlock();
+  if (stats.nb_flushes > 0)
+    stats.mean_flush_latency /= stats.nb_flushes;
+  return stats;
+}
+
+unsigned long OptoforceAcquisition::getNumberDroppedSamples()
+{
+  unsigned long nb_dropped;
+  mutex_.lock();
+  nb_dropped = nb_dropped_samples_;
+  mutex_.unlock();
+  return nb_dropped;
+}
+
+unsigned long OptoforceAcquisition::getNumberLateMergedSamples()
+{
+  return nb_late_merged_.load();
+}
+
+OptoforceAcquisition::LoopStats OptoforceAcquisition::getLoopStats()
+{
+  LoopStats stats;
+  mutex_.lock();
+  stats = loop_stats_;
+  mutex_.unlock();
+  return stats;
+}
+
+void OptoforceAcquisition::resetLoopStats()
+{
+  mutex_.lock();
+  loop_stats_.nb_iterations = 0;
+  loop_stats_.busy_time = boost::chrono::nanoseconds(0);
+  loop_stats_.max_busy_time = boost::chrono::nanoseconds(0);
+  mutex_.unlock();
+}
+
+SchedulerStats OptoforceAcquisition::getSchedulerStats()
+{
+  SchedulerStats stats;
+  mutex_.lock();
+  for (size_t i = 0; i < schedulers_.size(); ++i)
+    stats.merge(schedulers_[i]->getStats());
+  mutex_.unlock();
+  return stats;
+}
+
+void OptoforceAcquisition::resetSchedulerStats()
+{
+  mutex_.lock();
+  for (size_t i = 0; i < schedulers_.size(); ++i)
+    schedulers_[i]->resetStats();
+  mutex_.unlock();
 }
 
 void OptoforceAcquisition::getSerialNumbers(std::vector<std::string> &serial_numbers)
@@ -262,192 +557,459 @@ void OptoforceAcquisition::acquireThread(bool is_debug)
 {
   std::cout << "acquireThread" << std::endl;
 
-  // double check if the data_acquired variable is empty. If not force it
-  if (!data_acquired_.empty())
+  unsigned long nb_speed_changes = nb_speed_changes_.load();
+
+  // for the first one, we just read the last value
+  // so that we flush the internal buffer (done per device).
+  device_records_.assign(devices_recorded_.size(), DeviceRecord());
+  for (size_t i = 0; i < device_records_.size(); ++i)
   {
-    std::cout << "Acquisition buffer not empty. Previous data are deleted " << std::endl;
-    data_acquired_.clear();
+    DeviceRecord & record = device_records_[i];
+    record.is_first = true;
+    record.merge_watermark_ns = std::numeric_limits<int64_t>::min();
+    record.buffered_values.resize(READ_BUFFER_SIZE);
+    // the clock model starts from the nominal rate of the device
+    double frequency = devices_recorded_[i]->getSampleFrequency();
+    record.clock_model.reset((frequency > 0.0) ? 1.0 / frequency : 1e-3);
+    record.nb_overflows = devices_recorded_[i]->getNumberOverflows();
+    record.nb_speed_changes = nb_speed_changes;
   }
 
-  // to locally store all values without time info
-  std::vector< std::vector< std::vector<float> > > data_acq;
-  // to store the last values provided by the device
-  std::vector< std::vector<float> > buffered_values;
-
-  latest_samples_.clear();
-  std::vector<float> vec;
-  vec.clear();
-  for (size_t i = 0; i < devices_recorded_.size(); ++i)
+  // a device that can not be published is still read
+  shm_publishers_.clear();
+  for (size_t i = 0; shm_publication_ && (i < devices_recorded_.size()); ++i)
   {
-    data_acq.push_back(buffered_values);
-    latest_samples_.push_back(vec);
+    boost::shared_ptr<ShmPublisher> publisher(new ShmPublisher());
+    if (!publisher->open(devices_recorded_[i]->getSerialNumber(), devices_recorded_[i]->is3DSensor() ? 3 : 6,
+                         devices_recorded_[i]->getSampleFrequency(), shm_history_size_))
+      publisher.reset();
+    shm_publishers_.push_back(publisher);
   }
 
   bool is_stop_reading_request = false;
 
   num_samples_ = 0;
+  resetLoopStats();
 
-  // for the first one, we just read the last value
-  // so that we flush the internal buffer.
-  bool is_first = true;
-
-  // record the start instants of each device
-  std::vector< boost::chrono::high_resolution_clock::time_point> l_time_start;
-  // record the last recoding of each devic
-  std::vector< boost::chrono::high_resolution_clock::time_point> l_time_last;
+  mutex_.lock();
+  is_time_zero_set_ = false;
+  mutex_.unlock();
 
   std::cout << "is_stop_request: " << is_stop_reading_request << std::endl;
   std::cout << "is_stop_recording_request_: " << is_stop_reading_request_ << std::endl;
 
-  bool is_start_recording_request = false;
+  // with reader threads, each one polls its own devices,
+  // and this one only handles the recording requests
+  size_t nb_readers = std::min(nb_reader_threads_, devices_recorded_.size());
+
+  // one scheduler per polling thread, for the wakeup statistics
+  mutex_.lock();
+  schedulers_.clear();
+  for (size_t k = 0; k < std::max(nb_readers, (size_t) 1); ++k)
+    schedulers_.push_back(boost::shared_ptr<DeadlineScheduler>(new DeadlineScheduler(acquisition_freq_)));
+  boost::shared_ptr<DeadlineScheduler> scheduler = schedulers_[0];
+  if (nb_readers > 0)
+    scheduler.reset(new DeadlineScheduler(acquisition_freq_));
+  acquire_scheduler_ = scheduler;
+  mutex_.unlock();
+
+  boost::thread_group readers;
+  for (size_t k = 0; k < nb_readers; ++k)
+    readers.create_thread(boost::bind(&OptoforceAcquisition::readerThread, this, k, nb_readers, is_debug));
+
   bool is_stop_recording_request = false;
 
+  scheduler->start();
   while (!is_stop_reading_request)
   {
-    l_time_last.clear();
-
-    if (is_debug)
+    if (is_debug && (nb_readers == 0))
       std::cout << "[" << num_samples_ << "] " ;
 
     mutex_.lock();
-    is_start_recording_request = is_start_recording_request_;
     is_stop_recording_request = is_stop_recording_request_;
+    is_stop_reading_request = is_stop_reading_request_;
     mutex_.unlock();
+    RecordWindow window = getRecordWindow();
 
-    for (size_t i = 0; i < devices_recorded_.size(); ++i)
+    if (nb_readers == 0)
     {
-      //values.clear();
-      buffered_values.clear();
-
-      bool is_data_available = true;
-
-      is_data_available  = devices_recorded_[i]->getData(buffered_values);
-      //l_time_last.push_back(boost::chrono::high_resolution_clock::now());
-
-      if (is_data_available)
+      boost::chrono::steady_clock::time_point loop_start = boost::chrono::steady_clock::now();
       {
-          int idx_last = buffered_values.size()- 1;
-
-          // Fill latest data within this variable
-          // This variable is used to return latest value within getData method
-          mutex_sample_.lock();
-          latest_samples_[i] = buffered_values[idx_last];
-          mutex_sample_.unlock();
-
-        if (is_start_recording_request)
+        boost::shared_lock<boost::shared_mutex> lock(record_mutex_);
+        for (size_t i = 0; i < devices_recorded_.size(); ++i)
         {
-          l_time_last.push_back(boost::chrono::high_resolution_clock::now());
-
-          // todo: make sure is_data_available is true, and some data is available
-          if (is_first)
-          {
-            //todo make sure the lat value is indeed the good one to use.
-            // read the last value of each device, so that we fluch the internal buffer
-
-            int idx_last = buffered_values.size()- 1;
-            data_acq[i].push_back(buffered_values[idx_last]);
-
-            if (is_debug)
-            {
-              for (unsigned int k = 0; k < buffered_values[idx_last].size(); ++k)
-                std::cout << buffered_values[idx_last][k] << " ";
-              std::cout << " + ";
-            }
-          }
-
-          else
-          {
-            for (unsigned int j = 0; j < buffered_values.size(); ++j)
-            {
-              data_acq[i].push_back(buffered_values[j]);
-
-              if (is_debug)
-              {
-                // displaying the values read.
-                for (unsigned int k = 0; k < buffered_values[j].size(); ++k)
-                  std::cout << buffered_values[j][k] << " ";
-                std::cout << " + ";
-              }
-            }
-          }
-          if (is_first)
-            l_time_start = l_time_last;
-          is_first = false;
+          readDevice(i, window, is_debug);
+          num_samples_ = device_records_[i].nb_recorded;
         }
       }
-      else
-      {
-        //std::cerr << "\n Prb while reading the sensor data " << i << std::endl;
-      }
       if (is_debug)
-        std::cout << " || ";
-
-      num_samples_ = data_acq[i].size();
+        std::cout << std::endl;
+      updateLoopStats(boost::chrono::steady_clock::now() - loop_start);
     }
 
-    if (is_debug)
-      std::cout << std::endl;
-
-    //if (is_first)
-    //  l_time_start = l_time_last;
-    //is_first = false;
-
     if (is_stop_recording_request)
     {
+      // wait for the readers to complete their current pass:
+      // the following ones see the recording is no more requested
+      boost::unique_lock<boost::shared_mutex> lock(record_mutex_);
+
+      // a last pass records the samples stamped before the stop request, still buffered by the devices
+      window = getRecordWindow();
+      for (size_t i = 0; i < devices_recorded_.size(); ++i)
+        readDevice(i, window, is_debug);
+
+      num_samples_ = 0;
+      for (size_t i = 0; i < devices_recorded_.size(); ++i)
+        num_samples_ += device_records_[i].nb_recorded;
       std::cout << "Recorded " << num_samples_ << " data" << std::endl;
 
       for (size_t i = 0; i < devices_recorded_.size(); ++i)
       {
-        boost::chrono::nanoseconds acq_all_sample_ns = l_time_last[i] - l_time_start[i];
-        boost::chrono::nanoseconds acq_one_sample_ns = boost::chrono::nanoseconds(acq_all_sample_ns.count() / (data_acq[i].size() -1));
+        DeviceRecord & record = device_records_[i];
+        boost::chrono::nanoseconds acq_all_sample_ns = record.time_last - record.time_start;
+        boost::chrono::nanoseconds acq_one_sample_ns(0);
+        if (record.nb_recorded > 1)
+          acq_one_sample_ns = acq_all_sample_ns / (record.nb_recorded - 1);
 
-        std::cout << "Device["<< i << "]-->"<< data_acq[i].size() << " samples" << std::endl;
+        std::cout << "Device["<< i << "]-->"<< record.nb_recorded << " samples" << std::endl;
         std::cout << " Acquisition time : " << acq_all_sample_ns.count() * 1e-6 << std::endl;
-        std::cout << " num data acquired: "  << std::endl;
         std::cout << " time per acq: " << acq_one_sample_ns.count() * 1e-6 << std::endl;
+      }
 
-        std::vector<SampleStamped> l_data_stamped;
-        SampleStamped data_stamped;
-        for (unsigned int j = 0; j < data_acq[i].size(); ++j)
-        {
-          data_stamped.sample = data_acq[i][j];
-          data_stamped.acq_time = l_time_start[i] + boost::chrono::nanoseconds(j * acq_one_sample_ns.count() );
+      for (size_t i = 0; i < device_records_.size(); ++i)
+      {
+        device_records_[i].is_first = true;
+        device_records_[i].nb_recorded = 0;
+      }
 
-          l_data_stamped.push_back(data_stamped);
-        }
+      // without auto store, the data are kept in the recording buffers, for storeData or readRecordedSamples.
+      // Otherwise the writer stores the last samples, and ends the recording.
+      mutex_.lock();
+      if (auto_store_)
+        is_stop_writing_request_ = true;
+      else
+        is_recording_ = false;
+      is_start_recording_request_ = false;
+      is_stop_recording_request_ = false;
+      is_time_zero_set_ = false;
+      mutex_.unlock();
+      state_changed_.notify_all();
+    }
+
+    // the stop is handled without waiting for the next period
+    if (is_stop_reading_request)
+      break;
+    scheduler->wait();
+  }
 
-        data_acquired_.push_back(l_data_stamped);
-        //std::cout << "Storing " <<  data_acquired_[i].size() << " samples" << std::endl;
+  readers.join_all();
+  shm_publishers_.clear();
 
-      }
+  mutex_.lock();
+  // nothing more is pushed: the writer can complete the files, and ends the recording
+  is_stop_writing_request_ = true;
+  if (!auto_store_)
+    is_recording_ = false;
+  is_start_recording_request_ = false;
+  is_stop_recording_request_ = false;
+  is_reading_ = false;
+  is_stop_reading_request_ = false;
+  mutex_.unlock();
+  state_changed_.notify_all();
+
+  std::cout << "[acquireThread] end" << std::endl;
+
+}
+
+void OptoforceAcquisition::readerThread(size_t reader_index, size_t nb_readers, bool is_debug)
+{
+  bool is_stop_reading_request = false;
+
+  mutex_.lock();
+  boost::shared_ptr<DeadlineScheduler> scheduler = schedulers_[reader_index];
+  mutex_.unlock();
 
+  scheduler->start();
+  while (!is_stop_reading_request)
+  {
+    boost::chrono::steady_clock::time_point loop_start = boost::chrono::steady_clock::now();
+    {
+      boost::shared_lock<boost::shared_mutex> lock(record_mutex_);
       mutex_.lock();
-      is_recording_ = false;
+      is_stop_reading_request = is_stop_reading_request_;
       mutex_.unlock();
+      RecordWindow window = getRecordWindow();
 
-      storeData();
+      for (size_t i = reader_index; i < devices_recorded_.size(); i += nb_readers)
+        readDevice(i, window, is_debug);
+    }
+    updateLoopStats(boost::chrono::steady_clock::now() - loop_start);
 
-      for (size_t i = 0; i < devices_recorded_.size(); ++i)
+    if (is_stop_reading_request)
+      break;
+    scheduler->wait();
+  }
+}
+
+void OptoforceAcquisition::readDevice(size_t i, const RecordWindow & window, bool is_debug)
+{
+  DeviceRecord & record = device_records_[i];
+
+  // all the samples pending are read, the buffer only growing on a burst larger than ever
+  size_t nb_read = 0;
+  while (true)
+  {
+    if (nb_read == record.buffered_values.size())
+      record.buffered_values.resize(std::max(2 * record.buffered_values.size(), READ_BUFFER_SIZE));
+    int nb_samples = devices_recorded_[i]->getData(&record.buffered_values[nb_read],
+                                                   record.buffered_values.size() - nb_read);
+    if (nb_samples <= 0)
+      break;
+    nb_read += nb_samples;
+    if (nb_read < record.buffered_values.size())
+      break;
+  }
+
+  if (nb_read > 0)
+  {
+    int idx_last = nb_read - 1;
+    size_t nb_axes = devices_recorded_[i]->is3DSensor() ? 3 : 6;
+    boost::chrono::high_resolution_clock::time_point time_read = boost::chrono::high_resolution_clock::now();
+
+    unsigned long nb_speed_changes = nb_speed_changes_.load();
+
+    // the sample rate changed: the clock is estimated again
+    if (nb_speed_changes != record.nb_speed_changes)
+    {
+      double frequency = devices_recorded_[i]->getSampleFrequency();
+      record.clock_model.reset((frequency > 0.0) ? 1.0 / frequency : 1e-3);
+      record.nb_speed_changes = nb_speed_changes;
+    }
+
+    // samples were lost by the driver: the sample count is moved forward by the time elapsed
+    unsigned long nb_overflows = devices_recorded_[i]->getNumberOverflows();
+    if (nb_overflows != record.nb_overflows && record.clock_model.isStarted())
+    {
+      boost::chrono::duration<double> gap = time_read - record.clock_model.getTime(record.nb_received + idx_last);
+      double nb_lost = gap.count() / record.clock_model.getPeriod();
+      if (nb_lost >= 1.0)
+        record.nb_received += (unsigned long long) nb_lost;
+    }
+    record.nb_overflows = nb_overflows;
+
+    // each batch read refines the sample clock, so that samples are stamped as soon as read
+    unsigned long long index_first = record.nb_received;
+    record.nb_received += nb_read;
+    record.clock_model.update(record.nb_received - 1, time_read);
+
+    // the latest value, returned by getData, is published without waiting for its readers
+    LatestSample latest;
+    latest.nb_values = nb_axes;
+    latest.wrench = record.buffered_values[idx_last];
+    latest.read_time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(time_read.time_since_epoch()).count();
+    latest.estimated_frequency = 1.0 / record.clock_model.getPeriod();
+    latest_samples_[i]->store(latest);
+
+    ShmPublisher * publisher = shm_publishers_.empty() ? NULL : shm_publishers_[i].get();
+    bool is_followed = false;
+    for (size_t k = 0; (k < subscriptions_.size()) && !is_followed; ++k)
+      is_followed = subscriptions_[k].second->isFollowing(i);
+    if (window.is_recording || publisher || is_followed)
+    {
+      // all samples are stamped: the recorded ones are selected by their stamp
+      record.stamped_values.resize(nb_read);
+      for (size_t j = 0; j < record.stamped_values.size(); ++j)
       {
-        data_acq[i].clear();
-        data_acquired_.clear();
+        StampedSample & sample = record.stamped_values[j];
+
+        // a sample can not be generated after being read, nor before the previous one
+        sample.acq_time = record.clock_model.getTime(index_first + j);
+        if (sample.acq_time > time_read)
+          sample.acq_time = time_read;
+        if (record.has_stamp && sample.acq_time <= record.time_last_stamp)
+          sample.acq_time = record.time_last_stamp + boost::chrono::nanoseconds(1);
+        record.time_last_stamp = sample.acq_time;
+        record.has_stamp = true;
+        sample.wrench = record.buffered_values[j];
       }
-      // clear variables
-      //latest_samples_.clear();
-      //vec.clear();
-      //data_acq.clear();
-      mutex_.lock();
-      is_stop_recording_request_ = false;
-      mutex_.unlock();
 
-      is_first = true;
+      if (publisher)
+        publisher->publish(record.stamped_values.data(), record.stamped_values.size());
+      for (size_t k = 0; k < subscriptions_.size(); ++k)
+        subscriptions_[k].second->deliver(i, record.stamped_values.data(), record.stamped_values.size());
+
+      // the stamps increasing, the samples recorded are those from idx_first to idx_end (excluded):
+      // the older ones were buffered by the device before the recording start, the newer ones after its stop
+      size_t idx_first = 0;
+      size_t idx_end = window.is_recording ? record.stamped_values.size() : 0;
+      while ((idx_first < idx_end) && (record.stamped_values[idx_first].acq_time < window.start))
+        ++idx_first;
+      while ((idx_end > idx_first) && (record.stamped_values[idx_end - 1].acq_time >= window.stop))
+        --idx_end;
+      // nor the ones after the number of samples requested
+      int desired_num_samples = desired_num_samples_;
+      if (desired_num_samples > 0)
+        idx_end = std::min(idx_end, idx_first + (size_t) std::max((long) desired_num_samples - (long) record.nb_recorded, 0L));
+
+      if (idx_end > idx_first)
+      {
+        if (record.is_first)
+        {
+          record.time_start = time_read;
+          record.time_last = time_read;
+
+          // the recording start gives the time reference of all devices
+          mutex_.lock();
+          if (!is_time_zero_set_)
+          {
+            record_time_zero_ = window.start;
+            is_time_zero_set_ = true;
+          }
+          mutex_.unlock();
+        }
+
+        if (is_debug)
+        {
+          // displaying the values recorded.
+          for (size_t j = idx_first; j < idx_end; ++j)
+          {
+            const float * values = &record.buffered_values[j].fx;
+            for (size_t k = 0; k < nb_axes; ++k)
+              std::cout << values[k] << " ";
+            std::cout << " + ";
+          }
+        }
+
+        size_t nb_values = idx_end - idx_first;
+        size_t nb_pushed = record_queues_[i]->push(record.stamped_values.data() + idx_first, nb_values);
+        record.nb_recorded += nb_pushed;
+        if (nb_pushed < nb_values)
+        {
+          mutex_.lock();
+          nb_dropped_samples_ += nb_values - nb_pushed;
+          mutex_.unlock();
+        }
+        // the last device getting its samples ends the recording
+        if ((desired_num_samples > 0) && (record.nb_recorded >= (size_t) desired_num_samples) &&
+            (record.nb_recorded - nb_pushed < (size_t) desired_num_samples) &&
+            (++nb_devices_complete_ == devices_recorded_.size()))
+          requestRecordingEnd();
+
+        record.time_last = time_read;
+        record.is_first = false;
+      }
     }
+  }
+  else
+  {
+    //std::cerr << "\n Prb while reading the sensor data " << i << std::endl;
+
+    // a device without new sample, unplugged or at the end of its replay, does not hold the merge back:
+    // its next samples are expected after the poll instant, minus the delivery lateness allowed
+    if (is_merging_.load(boost::memory_order_relaxed))
+      record.merge_watermark_ns = std::max(record.merge_watermark_ns,
+        boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+          boost::chrono::high_resolution_clock::now().time_since_epoch()).count() - MERGE_LATENESS_NS);
+  }
 
-    boost::this_thread::sleep_for(boost::chrono::milliseconds(1000/acquisition_freq_));
+  // the next samples are stamped after the last one
+  if (record.has_stamp)
+    record.merge_watermark_ns = std::max(record.merge_watermark_ns,
+      (int64_t) boost::chrono::duration_cast<boost::chrono::nanoseconds>(record.time_last_stamp.time_since_epoch()).count());
+  // published after the push: the merge reading it first, then finding the queue empty,
+  // knows the samples stamped up to it were all popped
+  if (i < record_queues_.size())
+    merge_watermarks_[i].store(record.merge_watermark_ns, boost::memory_order_release);
+  if (is_debug)
+    std::cout << " || ";
+}
+
+void OptoforceAcquisition::updateLoopStats(boost::chrono::nanoseconds loop_duration)
+{
+  mutex_.lock();
+  ++loop_stats_.nb_iterations;
+  loop_stats_.busy_time += loop_duration;
+  if (loop_duration > loop_stats_.max_busy_time)
+    loop_stats_.max_busy_time = loop_duration;
+  mutex_.unlock();
+}
+
+void OptoforceAcquisition::requestRecordingEnd()
+{
+  mutex_.lock();
+  if (is_start_recording_request_ && !is_stop_recording_request_)
+  {
+    // as stopRecording, the acquisition thread then ends the recording
+    record_stop_time_ = boost::chrono::high_resolution_clock::now();
+    is_stop_recording_request_ = true;
+    if (acquire_scheduler_)
+      acquire_scheduler_->interrupt();
   }
+  mutex_.unlock();
+}
 
-  std::cout << "[acquireThread] end" << std::endl;
+size_t OptoforceAcquisition::readMergedSamples(MergedSample * samples, size_t capacity)
+{
+  is_merging_ = true;
+  // once the recording is stopped, no older sample can come anymore
+  return mergeRecordedSamples(samples, capacity, !isRecording());
+}
+
+size_t OptoforceAcquisition::mergeRecordedSamples(MergedSample * samples, size_t capacity, bool is_complete)
+{
+  size_t nb_devices = record_queues_.size();
+  merge_heads_.resize(nb_devices);
+  has_merge_head_.resize(nb_devices, false);
+
+  size_t nb_read = 0;
+
+  while (nb_read < capacity)
+  {
+    size_t oldest = nb_devices;
+    // stamp up to which the samples can be released, the empty devices only providing later ones
+    int64_t limit_ns = std::numeric_limits<int64_t>::max();
+    for (size_t i = 0; i < nb_devices; ++i)
+    {
+      if (!has_merge_head_[i])
+      {
+        int64_t watermark_ns = merge_watermarks_[i].load(boost::memory_order_acquire);
+        has_merge_head_[i] = record_queues_[i]->pop(merge_heads_[i]);
+        if (!has_merge_head_[i])
+        {
+          if (!is_complete)
+            limit_ns = std::min(limit_ns, watermark_ns);
+          continue;
+        }
+      }
+      if ((oldest == nb_devices) || (merge_heads_[i].acq_time < merge_heads_[oldest].acq_time))
+        oldest = i;
+    }
+    if (oldest == nb_devices)
+      break;
+    // an empty device may still provide older samples
+    if (boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+          merge_heads_[oldest].acq_time.time_since_epoch()).count() > limit_ns)
+      break;
 
+    // delivered after the watermark of its device passed: provided late, its stamp being kept
+    int64_t head_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      merge_heads_[oldest].acq_time.time_since_epoch()).count();
+    if (head_ns < merge_last_ns_)
+      ++nb_late_merged_;
+    else
+      merge_last_ns_ = head_ns;
+
+    samples[nb_read].device = oldest;
+    samples[nb_read].sample = merge_heads_[oldest];
+    has_merge_head_[oldest] = false;
+    ++nb_read;
+  }
+  return nb_read;
+}
+
+void OptoforceAcquisition::setNumberReaderThreads(size_t nb_threads)
+{
+  nb_reader_threads_ = nb_threads;
 }
 
 
@@ -489,15 +1051,23 @@ bool OptoforceAcquisition::stopReading()
 {
   std::cout << "stopReading start" << std::endl;
 
-  mutex_.lock();
-  is_stop_reading_request_ = true;
-  mutex_.unlock();
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  // a request left while not reading would end the next reading at once
+  if (is_reading_)
+  {
+    is_stop_reading_request_ = true;
+    // the polling threads see the request without waiting for their next period
+    if (acquire_scheduler_)
+      acquire_scheduler_->interrupt();
+    for (size_t i = 0; i < schedulers_.size(); ++i)
+      schedulers_[i]->interrupt();
+  }
 
-  std::cout << "[ OptoforceAcquisition::startRecording] is_stop_reading_request_: " << is_stop_reading_request_ << std::endl;
+  std::cout << "[ OptoforceAcquisition::stopReading] is_stop_reading_request_: " << is_stop_reading_request_ << std::endl;
 
-  // block until it stops reading
-  while (isReading())
-    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  // block until it stops reading, the current passes completed
+  while (is_reading_)
+    state_changed_.wait(lock);
 
   std::cout << "stopReading end" << std::endl;
   return true;
@@ -507,17 +1077,23 @@ bool OptoforceAcquisition::stopRecording()
 {
   std::cout << "[OptoforceAcquisition::stopRecording] in" << std::endl;
 
-  mutex_.lock();
-  is_stop_recording_request_ = true;
-  is_start_recording_request_ = false;
-  mutex_.unlock();
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  // the samples stamped from now on are not recorded: the acquisition thread still reads
+  // the ones before, and then ends the recording
+  record_stop_time_ = boost::chrono::high_resolution_clock::now();
+  if (is_reading_ && is_start_recording_request_)
+  {
+    is_stop_recording_request_ = true;
+    if (acquire_scheduler_)
+      acquire_scheduler_->interrupt();
+  }
 
   std::cout << "[ OptoforceAcquisition::stopRecording] is_start_recording_request: " << is_start_recording_request_ << std::endl;
   std::cout << "[ OptoforceAcquisition::stopRecording] is_stop_recording_request: " << is_stop_recording_request_ << std::endl;
 
-  // block until it stops reading
-  while (isRecording())
-    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  // block until the recording ends, once the writer completed the files with auto store
+  while (is_recording_)
+    state_changed_.wait(lock);
 
   std::cout << "[OptoforceAcquisition::stopRecording] out" << std::endl;
   return true;
@@ -528,9 +1104,42 @@ void OptoforceAcquisition::setFilename(std::string filename)
   filename_ = filename;
 }
 
+void OptoforceAcquisition::setRecordingFormat(recording_format format)
+{
+  recording_format_ = format;
+}
+
+void OptoforceAcquisition::setCsvPrecision(unsigned int time_decimals, unsigned int value_decimals)
+{
+  csv_time_decimals_ = time_decimals;
+  csv_value_decimals_ = value_decimals;
+}
+
+void OptoforceAcquisition::setMergedOutput(merge_output mode, double period_ms)
+{
+  merge_output_ = mode;
+  merge_period_ns_ = std::max((int64_t) (period_ms * 1e6), (int64_t) 1);
+}
+
+void OptoforceAcquisition::setSegmentation(double duration_s, unsigned long long max_bytes)
+{
+  segment_duration_ns_ = (duration_s > 0.0) ? (int64_t) (duration_s * 1e9) : 0;
+  segment_max_bytes_ = max_bytes;
+}
+
+void OptoforceAcquisition::setSharedMemoryPublication(bool is_published, uint32_t history_size)
+{
+  shm_publication_ = is_published;
+  shm_history_size_ = history_size;
+}
+
+bool OptoforceAcquisition::isSegmented() const
+{
+  return ((segment_duration_ns_ > 0) || (segment_max_bytes_ > 0)) && (recording_format_ != recording_csv);
+}
+
 
 // warning may not be correctly working if acquisition asked while storing
-// todo if no data recorded, get out directly
 // todo agree on a precision for the data stored.
 bool OptoforceAcquisition::storeData()
 {
@@ -546,11 +1155,19 @@ bool OptoforceAcquisition::storeData()
     std::cerr << "Record is active" << std::endl;
     return false;
   }
+  return writeRecordedData();
+}
+
+bool OptoforceAcquisition::writeRecordedData()
+{
+  size_t nb_available = 0;
+  for (size_t i = 0; i < record_queues_.size(); ++i)
+    nb_available += record_queues_[i]->size();
 
-  if (data_acquired_.empty() || data_acquired_[0].empty())
+  if (nb_available == 0)
   {
     std::cerr << "No data to record" << std::endl;
-    if (data_acquired_.empty())
+    if (record_queues_.empty())
       std::cerr << "no data has been recorded at all-..." << std::endl;
     return false;
   }
@@ -559,86 +1176,375 @@ bool OptoforceAcquisition::storeData()
     boost::date_time::c_local_adjustor<boost::posix_time::ptime>::utc_to_local(
       boost::posix_time::second_clock::local_time() );
 
-  for (size_t i = 0; i < devices_recorded_.size(); ++i)
+  // the recording start is the time reference
+  boost::chrono::high_resolution_clock::time_point time_zero;
+  mutex_.lock();
+  time_zero = record_time_zero_;
+  mutex_.unlock();
+
+  // all devices in a single file, merged in time order
+  if (merge_output_ != merge_none)
   {
-    // We only take part of the posix time
-    //std::string name_file = boost::posix_time::to_iso_string(posix_time) + "_"
-      std::string name_file = filename_ + "_"
-                                + devices_recorded_[i]->getSerialNumber() + "_"
-                                + boost::posix_time::to_iso_string(posix_time)
-                                + "_forces.csv";
+    std::cout << "Storing " << nb_available << " samples" << std::endl;
+    MergedCsvWriter file;
+    std::vector<MergedSample> samples(1024);
+    unsigned long nb_written = 0;
+    if (!openMergedFile(getMergedFileName(posix_time), file))
+      return false;
+    bool is_ok = drainMergedFile(time_zero, file, samples, true, nb_written);
+    return file.close() && is_ok;
+  }
 
-    std::cout << "Storing filename: " << name_file << std::endl;
-    std::cout << "Storing " <<  data_acquired_[i].size() << " samples" << std::endl;
+  // the buffers are drained by blocks, to keep the memory use bounded
+  std::vector<StampedSample> samples(1024);
 
-    std::ofstream file_handler;
-    // todo check if the file opening worked
-    file_handler.open (name_file);
+  bool is_ok = true;
+  for (size_t i = 0; i < devices_recorded_.size(); ++i)
+  {
+    std::cout << "Storing " <<  record_queues_[i]->size() << " samples" << std::endl;
 
-    // prepare the csv format, according to the sensor connected
-    std::stringstream oss;
+    RecordFile file;
+    if (!openRecordFile(i, getRecordFileName(i, posix_time), time_zero, file))
+    {
+      is_ok = false;
+      continue;
+    }
+    unsigned long nb_written = 0;
+    is_ok = drainRecordFile(i, time_zero, file, samples, nb_written) && is_ok;
+    is_ok = closeRecordFile(file) && is_ok;
+  }
 
-    // '#' is for Gnuplot
-    if (devices_recorded_[i]->is3DSensor())
-      oss << "#t_ms;f_x;f_y;f_z;";
-    else
-      oss << "#t_ms;f_x;f_y;f_z;t_x;t_y;t_z;";
+  return is_ok;
+}
 
-    file_handler << oss.str() << std::endl;
+void OptoforceAcquisition::writerThread()
+{
+  boost::posix_time::ptime posix_time =
+    boost::date_time::c_local_adjustor<boost::posix_time::ptime>::utc_to_local(
+      boost::posix_time::second_clock::local_time() );
 
-    // Storing the data
-    // todo decide what to do on the record time...
-    // we assume the first one is the first first one
-    // an we take it as reference
-    boost::chrono::high_resolution_clock::time_point time_zero;
+  // the files are created once the device delivers its first samples, time zero being then known
+  std::vector< boost::shared_ptr<RecordFile> > files(devices_recorded_.size());
+  std::vector<bool> is_failed(devices_recorded_.size(), false);
+  std::vector<StampedSample> samples(1024);
+  bool is_stop_writing_request = false;
+  boost::chrono::high_resolution_clock::time_point time_zero;
+  bool is_time_zero_known = false;
+  // with a merged output, a single file gathers all devices
+  MergedCsvWriter merged_file;
+  bool is_merged_failed = false;
+  std::vector<MergedSample> merged_samples((merge_output_ != merge_none) ? 1024 : 0);
+
+  while (true)
+  {
+    mutex_.lock();
+    is_stop_writing_request = is_stop_writing_request_;
+    mutex_.unlock();
+
+    boost::chrono::steady_clock::time_point pass_start = boost::chrono::steady_clock::now();
+    size_t backlog = 0;
+    unsigned long nb_written = 0;
+    for (size_t i = 0; i < record_queues_.size(); ++i)
+      backlog += record_queues_[i]->size();
 
-    if (data_acquired_.empty() || data_acquired_[0].empty())
+    // time zero is set before the first sample is pushed
+    if ((backlog > 0) && !is_time_zero_known)
     {
-      //nothing acqired? we take current time as reference. But something is wrong.
-      time_zero = boost::chrono::high_resolution_clock::now();
+      mutex_.lock();
+      time_zero = record_time_zero_;
+      mutex_.unlock();
+      is_time_zero_known = true;
     }
-    else
-      time_zero = data_acquired_[0][0].acq_time;
 
-    for (size_t j = 0; j < data_acquired_[i].size(); ++j)
+    if ((merge_output_ != merge_none) && (backlog > 0) && !is_merged_failed)
     {
-      oss.str("");
+      if (!merged_file.isOpen())
+        is_merged_failed = !openMergedFile(getMergedFileName(posix_time), merged_file);
+      if (!is_merged_failed &&
+          !drainMergedFile(time_zero, merged_file, merged_samples, is_stop_writing_request, nb_written))
+      {
+        std::cerr << "[OptoforceAcquisition::writerThread] write error, merged recording stopped" << std::endl;
+        is_merged_failed = true;
+      }
+    }
 
-      boost::chrono::nanoseconds rel_time_ms = data_acquired_[i][j].acq_time - time_zero;
-      oss << rel_time_ms.count() * 1e-6 << ";";
+    for (size_t i = 0; (i < record_queues_.size()) && (merge_output_ == merge_none); ++i)
+    {
+      if ((record_queues_[i]->size() == 0) || is_failed[i])
+        continue;
 
-      if (data_acquired_[i][j].sample.empty())
+      if (!files[i])
       {
-        if (devices_recorded_[i]->is3DSensor())
-          oss << ";;;";
-        else
-          oss << ";;;;;;";
+        files[i].reset(new RecordFile);
+        is_failed[i] = !openRecordFile(i, getRecordFileName(i, posix_time), time_zero, *files[i]);
+        if (is_failed[i])
+          continue;
       }
-      else
+      if (!drainRecordFile(i, time_zero, *files[i], samples, nb_written))
       {
-        for (size_t k = 0 ; k < data_acquired_[i][k].sample.size(); ++k)
-        {
-          oss << data_acquired_[i][j].sample[k] << ";";
-        }
+        std::cerr << "[OptoforceAcquisition::writerThread] write error, recording of device " << i << " stopped" << std::endl;
+        is_failed[i] = true;
       }
-      oss << std::endl;
-      file_handler << oss.str();
     }
-    file_handler.close();
+    boost::chrono::nanoseconds pass_duration = boost::chrono::steady_clock::now() - pass_start;
+
+    mutex_.lock();
+    writer_stats_.backlog = backlog;
+    writer_stats_.max_backlog = std::max(writer_stats_.max_backlog, backlog);
+    if (nb_written > 0)
+    {
+      // mean_flush_latency holds the sum, until read
+      writer_stats_.nb_written += nb_written;
+      ++writer_stats_.nb_flushes;
+      writer_stats_.mean_flush_latency += pass_duration;
+      writer_stats_.max_flush_latency = std::max(writer_stats_.max_flush_latency, pass_duration);
+    }
+    mutex_.unlock();
+
+    // the readers no longer push once the stop is requested: this pass got everything
+    if (is_stop_writing_request)
+      break;
+
+    // woken up earlier by the stop request
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    if (!is_stop_writing_request_)
+      state_changed_.wait_for(lock, boost::chrono::milliseconds(WRITE_PERIOD_MS));
+  }
+
+  for (size_t i = 0; i < files.size(); ++i)
+    if (files[i] && !closeRecordFile(*files[i]))
+      std::cerr << "[OptoforceAcquisition::writerThread] could not complete the file of device " << i << std::endl;
+  if (!merged_file.close())
+    std::cerr << "[OptoforceAcquisition::writerThread] could not complete the merged file" << std::endl;
+
+  mutex_.lock();
+  is_stop_writing_request_ = false;
+  is_recording_ = false;
+  mutex_.unlock();
+  state_changed_.notify_all();
+}
+
+std::string OptoforceAcquisition::getRecordFileName(size_t i, const boost::posix_time::ptime & posix_time)
+{
+  // We only take part of the posix time
+  //std::string name_file = boost::posix_time::to_iso_string(posix_time) + "_"
+  return filename_ + "_"
+    + devices_recorded_[i]->getSerialNumber() + "_"
+    + boost::posix_time::to_iso_string(posix_time)
+    + "_forces";
+}
+
+std::string OptoforceAcquisition::getMergedFileName(const boost::posix_time::ptime & posix_time)
+{
+  return filename_ + "_"
+    + boost::posix_time::to_iso_string(posix_time)
+    + "_merged_forces";
+}
+
+bool OptoforceAcquisition::openMergedFile(const std::string & name_file, MergedCsvWriter & file)
+{
+  std::vector<std::string> serial_numbers;
+  std::vector<size_t> nb_axes;
+  for (size_t i = 0; i < devices_recorded_.size(); ++i)
+  {
+    serial_numbers.push_back(devices_recorded_[i]->getSerialNumber());
+    nb_axes.push_back(devices_recorded_[i]->is3DSensor() ? 3 : 6);
+  }
+
+  std::cout << "Storing filename: " << name_file << ".csv" << std::endl;
+  file.setPrecision(csv_time_decimals_, csv_value_decimals_);
+  if (!file.open(name_file + ".csv", serial_numbers, nb_axes, merge_output_, merge_period_ns_))
+  {
+    std::cerr << "Could not create " << name_file << ".csv" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool OptoforceAcquisition::drainMergedFile(boost::chrono::high_resolution_clock::time_point time_zero,
+                                           MergedCsvWriter & file, std::vector<MergedSample> & samples,
+                                           bool is_complete, unsigned long & nb_written)
+{
+  size_t nb_samples;
+  while ((nb_samples = mergeRecordedSamples(samples.data(), samples.size(), is_complete)) > 0)
+  {
+    nb_written += nb_samples;
+    for (size_t k = 0; k < nb_samples; ++k)
+    {
+      const StampedSample & sample = samples[k].sample;
+      file.append(samples[k].device,
+                  boost::chrono::duration_cast<boost::chrono::nanoseconds>(sample.acq_time - time_zero).count(),
+                  &sample.wrench.fx);
+    }
   }
+  return file.flush();
+}
 
-  std::cout << "[storeData] Clear Variables to free memory" << std::endl;
+bool OptoforceAcquisition::openRecordFile(size_t i, const std::string & name_file,
+                                          boost::chrono::high_resolution_clock::time_point time_zero,
+                                          RecordFile & file)
+{
+  size_t nb_axes = devices_recorded_[i]->is3DSensor() ? 3 : 6;
 
-  //std::vector<std::vector<SampleStamped> >().swap(data_acquired_);
-  //std::vector< std::vector<float> >().swap(latest_samples_);
-  data_acquired_.shrink_to_fit();
-  latest_samples_.shrink_to_fit();
-  //data_acquired_.clear();
-  //latest_samples_.clear();
+  if (recording_format_ == recording_csv)
+  {
+    std::cout << "Storing filename: " << name_file << ".csv" << std::endl;
+    file.csv.setPrecision(csv_time_decimals_, csv_value_decimals_);
+    if (!file.csv.open(name_file + ".csv", nb_axes))
+    {
+      std::cerr << "Could not create " << name_file << ".csv" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  std::cout << "Storing filename: " << name_file << ".opto" << std::endl;
+
+  RecordingHeader header;
+  initRecordingHeader(header);
+  std::string serial_number = devices_recorded_[i]->getSerialNumber();
+  serial_number.copy(header.serial_number, sizeof(header.serial_number) - 1);
+  header.is_3D_sensor = devices_recorded_[i]->is3DSensor() ? 1 : 0;
+  header.nb_axes = nb_axes;
+  if (recording_format_ == recording_compressed)
+    header.encoding = encoding_delta_varint;
+  else if (recording_format_ == recording_columnar)
+    header.encoding = encoding_columnar;
+  header.sample_frequency = devices_recorded_[i]->getSampleFrequency();
+  std::vector<float> calibration = devices_recorded_[i]->getCalibration();
+  for (size_t k = 0; (k < calibration.size()) && (k < 6); ++k)
+    header.calibration[k] = calibration[k];
+
+  // the wall clock instant of time zero, from the delay since it
+  boost::chrono::nanoseconds since_zero = boost::chrono::high_resolution_clock::now() - time_zero;
+  header.start_time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+    boost::chrono::system_clock::now().time_since_epoch()).count() - since_zero.count();
+
+  file.name_file = name_file;
+  file.header = header;
+  file.segments.clear();
+  if (isSegmented())
+    return openRecordSegment(file);
+  return file.writer.open(name_file + ".opto", header);
+}
 
+bool OptoforceAcquisition::openRecordSegment(RecordFile & file)
+{
+  std::string name_segment = file.name_file + getSegmentSuffix(file.segments.size());
+  std::cout << "Storing segment: " << name_segment << std::endl;
+  if (!file.writer.open(name_segment, file.header))
+    return false;
+  file.first_time_ns = 0;
+  file.last_time_ns = 0;
 
+  // the whole segment is reserved at once, so that no write waits for the file system to extend the file
+  unsigned long long nb_bytes = segment_max_bytes_;
+  if ((segment_duration_ns_ > 0) && (file.header.sample_frequency > 0.0))
+  {
+    unsigned long long nb_bytes_duration = sizeof(RecordingHeader) + sizeof(RecordingSample) *
+      (unsigned long long) (segment_duration_ns_ * 1e-9 * file.header.sample_frequency + 1.0);
+    if ((nb_bytes == 0) || (nb_bytes_duration < nb_bytes))
+      nb_bytes = nb_bytes_duration;
+  }
+  if (nb_bytes > 0)
+    file.writer.preallocate(nb_bytes);
   return true;
 }
+
+bool OptoforceAcquisition::closeRecordSegment(RecordFile & file)
+{
+  if (!file.writer.isOpen())
+    return true;
+
+  RecordingSegment segment;
+  segment.filename = file.name_file.substr(file.name_file.rfind('/') + 1) + getSegmentSuffix(file.segments.size());
+  segment.first_time_ns = file.first_time_ns;
+  segment.last_time_ns = file.last_time_ns;
+  segment.nb_records = file.writer.getNumberRecords();
+  bool is_ok = file.writer.close();
+  segment.nb_bytes = file.writer.getNumberBytes();
+  file.segments.push_back(segment);
+
+  // the manifest is updated at each segment, so that it follows an interrupted recording
+  return writeRecordingManifest(file.name_file + ".manifest", file.header, file.segments) && is_ok;
+}
+
+bool OptoforceAcquisition::drainRecordFile(size_t i, boost::chrono::high_resolution_clock::time_point time_zero,
+                                           RecordFile & file, std::vector<StampedSample> & samples,
+                                           unsigned long & nb_written)
+{
+  bool is_ok = true;
+  size_t nb_samples;
+  while ((nb_samples = record_queues_[i]->pop(samples.data(), samples.size())) > 0)
+  {
+    nb_written += nb_samples;
+    if (!file.writer.isOpen())
+      file.csv.append(samples.data(), nb_samples, time_zero);
+    else if (!isSegmented())
+      is_ok = file.writer.append(samples.data(), nb_samples, time_zero) && is_ok;
+    else
+    {
+      // the samples are shared out among the segments, a new one being started once the current one is full
+      size_t k = 0;
+      while (k < nb_samples)
+      {
+        bool is_empty = (file.writer.getNumberRecords() == 0);
+        if (is_empty)
+          file.first_time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(samples[k].acq_time - time_zero).count();
+
+        size_t nb_fitting = nb_samples - k;
+        if (segment_duration_ns_ > 0)
+        {
+          nb_fitting = 0;
+          while ((k + nb_fitting < nb_samples) &&
+                 (boost::chrono::duration_cast<boost::chrono::nanoseconds>(samples[k + nb_fitting].acq_time - time_zero).count()
+                  - file.first_time_ns < segment_duration_ns_))
+            ++nb_fitting;
+        }
+        if (segment_max_bytes_ > 0)
+        {
+          // the chunk header of the records gathered is accounted as well
+          unsigned long long nb_bytes = file.writer.getNumberBytes();
+          if (recording_format_ == recording_columnar)
+            nb_bytes += sizeof(RecordingChunk);
+          size_t nb_room = (nb_bytes < segment_max_bytes_) ? (segment_max_bytes_ - nb_bytes) / sizeof(RecordingSample) : 0;
+          nb_fitting = std::min(nb_fitting, nb_room);
+        }
+        // a segment holds at least a sample, whatever the limits
+        if (is_empty && (nb_fitting == 0))
+          nb_fitting = 1;
+
+        if (nb_fitting == 0)
+        {
+          is_ok = closeRecordSegment(file) && is_ok;
+          if (!openRecordSegment(file))
+            return false;
+          continue;
+        }
+
+        is_ok = file.writer.append(&samples[k], nb_fitting, time_zero) && is_ok;
+        k += nb_fitting;
+        file.last_time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(samples[k - 1].acq_time - time_zero).count();
+      }
+    }
+  }
+
+  // the samples reach the system, so that the file follows the recording
+  if (file.writer.isOpen())
+    return file.writer.flush() && is_ok;
+  return file.csv.flush() && is_ok;
+}
+
+bool OptoforceAcquisition::closeRecordFile(RecordFile & file)
+{
+  if (file.writer.isOpen() && isSegmented())
+    return closeRecordSegment(file);
+  if (file.writer.isOpen())
+    return file.writer.close();
+
+  return file.csv.close();
+}
+
 void OptoforceAcquisition::setDesiredNumberSamples(int desired_num_samples)
 {
   std::cout << "***" << std::endl;
@@ -677,6 +1583,9 @@ bool OptoforceAcquisition::setSensorSpeed(int freq)
     state  = state & devices_recorded_[i]->setFrequency((sensor_speed)frequency);
   }
 
+  // the reading restarts the estimation of the sample clocks
+  ++nb_speed_changes_;
+
   return state;
 }
 // TODO set filter frequency to all devices?
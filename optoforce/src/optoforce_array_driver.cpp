@@ -12,6 +12,7 @@
 #include <iostream>
 
 #include "optoforce/optoforce_array_driver.hpp"
+#include "optoforce/optoforce_omd_backend.hpp"
 
 #ifdef _WINDOWS
 #include <windows.h>
@@ -24,7 +25,7 @@
 
 
 OptoForceArrayDriver::OptoForceArrayDriver()
-  : m_PortEnumerator(new OptoPorts()), m_PortCount(0)
+  : m_PortEnumerator(new OmdPortEnumerator()), m_PortCount(0)
 {
 }
 
@@ -32,9 +33,12 @@ OptoForceArrayDriver::OptoForceArrayDriver()
  * The p_portCount parameter tells the enumerator how many DAQs you
  * have connected to the computer.
  */
-OptoForceArrayDriver::OptoForceArrayDriver(int p_portCount)
-  : m_PortEnumerator(new OptoPorts()), m_PortCount(p_portCount)
+OptoForceArrayDriver::OptoForceArrayDriver(int p_portCount, OptoForcePortEnumerator * p_enumerator)
+  : m_PortEnumerator(p_enumerator), m_PortCount(p_portCount)
 {
+  // per default, the Optoforce library is used
+  if (m_PortEnumerator == NULL)
+    m_PortEnumerator = new OmdPortEnumerator();
 }
 
 OptoForceArrayDriver::~OptoForceArrayDriver()
@@ -45,21 +49,12 @@ OptoForceArrayDriver::~OptoForceArrayDriver()
 
 std::vector<OPort> OptoForceArrayDriver::GetPorts()
 {
-  std::vector<OPort> result;
-  int iSize = m_PortEnumerator->getSize(true);
-  if (iSize > 0) {
-    OPort * portList = m_PortEnumerator->listPorts(true);
-    iSize = m_PortEnumerator->getLastSize(); // this is the exact number of ports in portList after calling listPorts
-    for (int i = 0; i < iSize; ++i) {
-      result.push_back(portList[i]);
-    }
-  }
-  return result;
+  return m_PortEnumerator->listPorts();
 }
 
 int OptoForceArrayDriver::GetFoundPortsCount()
 {
-  return m_PortEnumerator->getSize(true);
+  return m_PortEnumerator->getSize();
 }
 
 /*
@@ -0,0 +1,156 @@
+/**
+ * @file   optoforce_calibration.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Conversion of batches of raw sensor counts into calibrated values.
+ *        Vectorized implementations are selected at runtime, according to the cpu.
+ */
+
+#include "optoforce/optoforce_calibration.hpp"
+
+// the vectorized kernels rely on gcc / clang target attributes
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OPTOFORCE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static void calibrateCountsScalar(const int * raw, size_t raw_stride, size_t nb_samples,
+                                  const float * factor, size_t nb_axes,
+                                  float * const * output,
+                                  size_t first)
+{
+  for (size_t axis = 0; axis < nb_axes; ++axis)
+  {
+    const int * in = raw + axis;
+    float * out = output[axis];
+    float f = factor[axis];
+    for (size_t i = first; i < nb_samples; ++i)
+      out[i] = in[i * raw_stride] * f;
+  }
+}
+
+#ifdef OPTOFORCE_X86_KERNELS
+
+// 4 samples per iteration, the counts being spread in memory they are loaded one by one.
+__attribute__((target("sse2")))
+static void calibrateCountsSSE2(const int * raw, size_t raw_stride, size_t nb_samples,
+                                const float * factor, size_t nb_axes,
+                                float * const * output)
+{
+  size_t nb_blocks = nb_samples / 4;
+
+  for (size_t axis = 0; axis < nb_axes; ++axis)
+  {
+    const int * in = raw + axis;
+    float * out = output[axis];
+    __m128 f = _mm_set1_ps(factor[axis]);
+
+    for (size_t b = 0; b < nb_blocks; ++b)
+    {
+      const int * s = in + 4 * b * raw_stride;
+      __m128i counts = _mm_set_epi32(s[3 * raw_stride], s[2 * raw_stride], s[raw_stride], s[0]);
+      _mm_storeu_ps(out + 4 * b, _mm_mul_ps(_mm_cvtepi32_ps(counts), f));
+    }
+  }
+  calibrateCountsScalar(raw, raw_stride, nb_samples, factor, nb_axes, output, nb_blocks * 4);
+}
+
+// 8 samples per iteration, the counts of an axis being gathered in a single instruction.
+__attribute__((target("avx2")))
+static void calibrateCountsAVX2(const int * raw, size_t raw_stride, size_t nb_samples,
+                                const float * factor, size_t nb_axes,
+                                float * const * output)
+{
+  size_t nb_blocks = nb_samples / 8;
+  int stride = static_cast<int>(raw_stride);
+  __m256i offsets = _mm256_set_epi32(7 * stride, 6 * stride, 5 * stride, 4 * stride,
+                                     3 * stride, 2 * stride, stride, 0);
+
+  for (size_t axis = 0; axis < nb_axes; ++axis)
+  {
+    const int * in = raw + axis;
+    float * out = output[axis];
+    __m256 f = _mm256_set1_ps(factor[axis]);
+
+    for (size_t b = 0; b < nb_blocks; ++b)
+    {
+      __m256i counts = _mm256_i32gather_epi32(in + 8 * b * raw_stride, offsets, 4);
+      _mm256_storeu_ps(out + 8 * b, _mm256_mul_ps(_mm256_cvtepi32_ps(counts), f));
+    }
+  }
+  calibrateCountsScalar(raw, raw_stride, nb_samples, factor, nb_axes, output, nb_blocks * 8);
+}
+
+#endif // OPTOFORCE_X86_KERNELS
+
+bool isCalibrationKernelSupported(calibration_kernel kernel)
+{
+  switch (kernel)
+  {
+    case kernel_scalar:
+      return true;
+#ifdef OPTOFORCE_X86_KERNELS
+    case kernel_sse2:
+      return __builtin_cpu_supports("sse2");
+    case kernel_avx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+calibration_kernel getCalibrationKernel()
+{
+  // the cpu does not change while running, the detection is done once
+  static const calibration_kernel kernel =
+    isCalibrationKernelSupported(kernel_avx2) ? kernel_avx2 :
+    isCalibrationKernelSupported(kernel_sse2) ? kernel_sse2 : kernel_scalar;
+  return kernel;
+}
+
+const char * getCalibrationKernelName(calibration_kernel kernel)
+{
+  switch (kernel)
+  {
+    case kernel_scalar:
+      return "scalar";
+    case kernel_sse2:
+      return "sse2";
+    case kernel_avx2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+void calibrateCounts(calibration_kernel kernel,
+                     const int * raw, size_t raw_stride, size_t nb_samples,
+                     const float * factor, size_t nb_axes,
+                     float * const * output)
+{
+  switch (kernel)
+  {
+#ifdef OPTOFORCE_X86_KERNELS
+    case kernel_sse2:
+      calibrateCountsSSE2(raw, raw_stride, nb_samples, factor, nb_axes, output);
+      return;
+    case kernel_avx2:
+      calibrateCountsAVX2(raw, raw_stride, nb_samples, factor, nb_axes, output);
+      return;
+#endif
+    default:
+      calibrateCountsScalar(raw, raw_stride, nb_samples, factor, nb_axes, output, 0);
+      return;
+  }
+}
+
+void calibrateCounts(const int * raw, size_t raw_stride, size_t nb_samples,
+                     const float * factor, size_t nb_axes,
+                     float * const * output)
+{
+  calibrateCounts(getCalibrationKernel(), raw, raw_stride, nb_samples, factor, nb_axes, output);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file   optoforce_clock_model.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Online estimation of the sample clock of a device, from the arrival
+ *        instants of the batches read, to stamp each sample as soon as it is read.
+ */
+
+#include "optoforce/optoforce_clock_model.hpp"
+#include <algorithm>
+
+// expected spread of the arrival instants, in s: the covariances are relative to it
+static const double ARRIVAL_NOISE = 1e-3;
+// uncertainty of the first arrival taken as origin, in s
+static const double OFFSET_PRIOR = 10e-3;
+// relative uncertainty of the nominal period
+static const double PERIOD_PRIOR = 0.01;
+// increase of the lowest delay per update, so that it follows a slower transfer, in s
+static const double MIN_RESIDUAL_RELAX = 1e-7;
+
+ClockModel::ClockModel(double nominal_period, double forgetting)
+  : forgetting_(forgetting)
+{
+  reset(nominal_period);
+}
+
+void ClockModel::reset(double nominal_period)
+{
+  is_started_ = false;
+  origin_index_ = 0;
+  offset_ = 0.0;
+  period_ = nominal_period;
+  p_[0][0] = (OFFSET_PRIOR / ARRIVAL_NOISE) * (OFFSET_PRIOR / ARRIVAL_NOISE);
+  p_[1][1] = (PERIOD_PRIOR * nominal_period / ARRIVAL_NOISE) * (PERIOD_PRIOR * nominal_period / ARRIVAL_NOISE);
+  p_[0][1] = p_[1][0] = 0.0;
+  min_residual_ = 0.0;
+}
+
+void ClockModel::update(unsigned long long last_index, clock::time_point arrival)
+{
+  if (!is_started_)
+  {
+    origin_ = arrival;
+    origin_index_ = last_index;
+    is_started_ = true;
+    return;
+  }
+
+  double x = (double) last_index - (double) origin_index_;
+  double t = boost::chrono::duration<double>(arrival - origin_).count();
+  double residual = t - (offset_ + period_ * x);
+
+  // recursive least squares on the regressor (1, x)
+  double px0 = p_[0][0] + p_[0][1] * x;
+  double px1 = p_[1][0] + p_[1][1] * x;
+  double denominator = forgetting_ + px0 + x * px1;
+  double k0 = px0 / denominator;
+  double k1 = px1 / denominator;
+
+  offset_ += k0 * residual;
+  period_ += k1 * residual;
+
+  p_[0][0] = (p_[0][0] - k0 * px0) / forgetting_;
+  p_[0][1] = (p_[0][1] - k0 * px1) / forgetting_;
+  p_[1][0] = p_[0][1];
+  p_[1][1] = (p_[1][1] - k1 * px1) / forgetting_;
+
+  // the offset is moved to the last index, to keep the regressor small
+  offset_ += period_ * x;
+  p_[0][0] += 2.0 * x * p_[0][1] + x * x * p_[1][1];
+  p_[0][1] += x * p_[1][1];
+  p_[1][0] = p_[0][1];
+  origin_index_ = last_index;
+
+  // delay of this arrival wrt the fitted line, the earliest ones being the reference
+  double fitted_residual = t - offset_;
+  min_residual_ = std::min(fitted_residual, min_residual_ + MIN_RESIDUAL_RELAX);
+}
+
+ClockModel::clock::time_point ClockModel::getTime(unsigned long long index) const
+{
+  double x = (double) index - (double) origin_index_;
+  double t = offset_ + period_ * x + min_residual_;
+  return origin_ + boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(t));
+}
@@ -0,0 +1,161 @@
+/**
+ * @file   optoforce_codec.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Lossless compression of the recorded samples: the calibrated values are
+ *        brought back to the raw sensor counts, stored as zig-zag varint deltas.
+ */
+
+#include "optoforce/optoforce_codec.hpp"
+#include "optoforce/optoforce_recording.hpp"
+#include <cmath>
+#include <cstring>
+
+// largest count handled, beyond the value is stored as is
+static const double MAX_COUNT = 2147483647.0;
+
+static inline uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static inline unsigned char * writeVarint(uint64_t value, unsigned char * output)
+{
+  while (value >= 0x80)
+  {
+    *output++ = (unsigned char) (value | 0x80);
+    value >>= 7;
+  }
+  *output++ = (unsigned char) value;
+  return output;
+}
+
+// NULL if the varint is truncated
+static inline const unsigned char * readVarint(const unsigned char * input, const unsigned char * end, uint64_t & value)
+{
+  value = 0;
+  for (unsigned int shift = 0; (input < end) && (shift < 64); shift += 7)
+  {
+    unsigned char byte = *input++;
+    value |= (uint64_t) (byte & 0x7f) << shift;
+    if (byte < 0x80)
+      return input;
+  }
+  return NULL;
+}
+
+// values compared bit to bit, so that -0 and the NaN payloads are kept
+static inline bool isSameFloat(float a, float b)
+{
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+SampleCodec::SampleCodec() : nb_axes_(6)
+{
+  float calibration[6] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  setCalibration(6, calibration);
+}
+
+void SampleCodec::setCalibration(size_t nb_axes, const float * calibration)
+{
+  nb_axes_ = (nb_axes == 3) ? 3 : 6;
+  for (size_t k = 0; k < 6; ++k)
+  {
+    calibration_[k] = calibration[k];
+    // same computation as OptoForceDriver::setCalibration
+    scale_[k] = 1.0 / calibration[k];
+  }
+  reset();
+}
+
+void SampleCodec::reset()
+{
+  previous_time_ = 0;
+  previous_delta_ = 0;
+  for (size_t k = 0; k < 6; ++k)
+    previous_counts_[k] = 0;
+}
+
+SampleEncoder::SampleEncoder() : nb_escaped_(0)
+{
+}
+
+unsigned char * SampleEncoder::encode(const RecordingSample & sample, unsigned char * output)
+{
+  // the values are expected to be calibrated counts, the unused axes 0
+  int64_t counts[6];
+  bool is_escaped = false;
+  for (size_t k = 0; k < nb_axes_; ++k)
+  {
+    double count = std::floor(sample.wrench[k] * calibration_[k] + 0.5);
+    if (!(std::fabs(count) <= MAX_COUNT) || !isSameFloat((float) (int) count * scale_[k], sample.wrench[k]))
+    {
+      is_escaped = true;
+      break;
+    }
+    counts[k] = (int64_t) count;
+  }
+  for (size_t k = nb_axes_; (k < 6) && !is_escaped; ++k)
+    is_escaped = !isSameFloat(sample.wrench[k], 0.0f);
+
+  int64_t delta = sample.time_ns - previous_time_;
+  output = writeVarint((zigzag(delta - previous_delta_) << 1) | (is_escaped ? 1 : 0), output);
+  previous_time_ = sample.time_ns;
+  previous_delta_ = delta;
+
+  if (is_escaped)
+  {
+    std::memcpy(output, sample.wrench, sizeof(sample.wrench));
+    ++nb_escaped_;
+    return output + sizeof(sample.wrench);
+  }
+
+  for (size_t k = 0; k < nb_axes_; ++k)
+  {
+    output = writeVarint(zigzag(counts[k] - previous_counts_[k]), output);
+    previous_counts_[k] = counts[k];
+  }
+  return output;
+}
+
+const unsigned char * SampleDecoder::decode(const unsigned char * input, const unsigned char * end,
+                                            RecordingSample & sample)
+{
+  uint64_t tag;
+  if ((input = readVarint(input, end, tag)) == NULL)
+    return NULL;
+
+  int64_t delta = previous_delta_ + unzigzag(tag >> 1);
+  sample.time_ns = previous_time_ + delta;
+  previous_time_ = sample.time_ns;
+  previous_delta_ = delta;
+
+  if (tag & 1)
+  {
+    if (end - input < (ptrdiff_t) sizeof(sample.wrench))
+      return NULL;
+    std::memcpy(sample.wrench, input, sizeof(sample.wrench));
+    return input + sizeof(sample.wrench);
+  }
+
+  for (size_t k = 0; k < nb_axes_; ++k)
+  {
+    uint64_t code;
+    if ((input = readVarint(input, end, code)) == NULL)
+      return NULL;
+    previous_counts_[k] += unzigzag(code);
+    sample.wrench[k] = (float) (int) previous_counts_[k] * scale_[k];
+  }
+  for (size_t k = nb_axes_; k < 6; ++k)
+    sample.wrench[k] = 0.0f;
+  return input;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file   optoforce_csv.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Csv recording files, formatted with a fixed precision into large buffers,
+ *        without going through the iostream formatting and its locale.
+ */
+
+#include "optoforce/optoforce_csv.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const double POWERS_OF_10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+static const unsigned long long INTEGER_POWERS_OF_10[] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+                                                          1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL};
+// beyond, the scaled value does not fit the integer conversion
+static const double MAX_SCALED_VALUE = 1e18;
+
+// "00" to "99", to write the digits two by two
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// write the decimal digits of an integer, at least nb_digits of them (left padded with 0)
+static char * formatInteger(unsigned long long value, unsigned int nb_digits, char * output)
+{
+  char digits[24];
+  char * end = digits + sizeof(digits);
+  char * start = end;
+  while (value >= 100)
+  {
+    unsigned int pair = (unsigned int) (value % 100) * 2;
+    value /= 100;
+    *--start = DIGIT_PAIRS[pair + 1];
+    *--start = DIGIT_PAIRS[pair];
+  }
+  if (value >= 10)
+  {
+    unsigned int pair = (unsigned int) value * 2;
+    *--start = DIGIT_PAIRS[pair + 1];
+    *--start = DIGIT_PAIRS[pair];
+  }
+  else
+    *--start = (char) ('0' + value);
+
+  while ((unsigned int) (end - start) < nb_digits)
+    *--start = '0';
+
+  std::memcpy(output, start, end - start);
+  return output + (end - start);
+}
+
+char * formatFixed(double value, unsigned int decimals, char * output)
+{
+  decimals = std::min(decimals, 9u);
+
+  if (value != value)
+  {
+    std::memcpy(output, "nan", 3);
+    return output + 3;
+  }
+
+  double scaled = std::fabs(value) * POWERS_OF_10[decimals];
+  if (!(scaled < MAX_SCALED_VALUE))
+  {
+    // rare enough not to matter: the C library handles the large and infinite values
+    int nb_chars = std::snprintf(output, 32, "%.*e", decimals, value);
+    return output + std::max(nb_chars, 0);
+  }
+
+  unsigned long long rounded = (unsigned long long) (scaled + 0.5);
+  if ((value < 0.0) && (rounded != 0))
+    *output++ = '-';
+
+  output = formatInteger(rounded / INTEGER_POWERS_OF_10[decimals], 1, output);
+  if (decimals > 0)
+  {
+    *output++ = '.';
+    output = formatInteger(rounded % INTEGER_POWERS_OF_10[decimals], decimals, output);
+  }
+  return output;
+}
+
+CsvWriter::CsvWriter(size_t buffer_size)
+  : buffer_(std::max(buffer_size, 14 * MAX_VALUE_SIZE)),
+    buffer_fill_(0),
+    nb_values_(6),
+    max_row_size_(7 * MAX_VALUE_SIZE),
+    time_decimals_(3),
+    value_decimals_(4)
+{
+}
+
+CsvWriter::~CsvWriter()
+{
+  close();
+}
+
+void CsvWriter::setPrecision(unsigned int time_decimals, unsigned int value_decimals)
+{
+  time_decimals_ = std::min(time_decimals, 9u);
+  value_decimals_ = std::min(value_decimals, 9u);
+}
+
+bool CsvWriter::open(const std::string & filename, size_t nb_axes)
+{
+  static const char * AXES[] = {"f_x", "f_y", "f_z", "t_x", "t_y", "t_z"};
+  return open(filename, std::vector<std::string>(AXES, AXES + ((nb_axes == 3) ? 3 : 6)));
+}
+
+bool CsvWriter::open(const std::string & filename, const std::vector<std::string> & columns)
+{
+  close();
+
+  nb_values_ = columns.size();
+  max_row_size_ = (nb_values_ + 1) * MAX_VALUE_SIZE;
+  if (buffer_.size() < 2 * max_row_size_)
+    buffer_.resize(2 * max_row_size_);
+  buffer_fill_ = 0;
+  file_.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_.is_open())
+    return false;
+
+  // '#' is for Gnuplot
+  std::string header = "#t_ms;";
+  for (size_t k = 0; k < columns.size(); ++k)
+    header += columns[k] + ";";
+  header += "\n";
+  if (header.size() > buffer_.size())
+    buffer_.resize(header.size() + 2 * max_row_size_);
+  std::memcpy(&buffer_[0], header.data(), header.size());
+  buffer_fill_ = header.size();
+  return true;
+}
+
+void CsvWriter::append(double time_ms, const float * values)
+{
+  if (buffer_.size() - buffer_fill_ < max_row_size_)
+    flush();
+
+  char * output = &buffer_[buffer_fill_];
+  char * start = output;
+  output = formatFixed(time_ms, time_decimals_, output);
+  *output++ = ';';
+  for (size_t k = 0; k < nb_values_; ++k)
+  {
+    output = formatFixed(values[k], value_decimals_, output);
+    *output++ = ';';
+  }
+  *output++ = '\n';
+  buffer_fill_ += output - start;
+}
+
+void CsvWriter::append(double time_ms, unsigned int index, const float * values)
+{
+  if (buffer_.size() - buffer_fill_ < max_row_size_)
+    flush();
+
+  char * output = &buffer_[buffer_fill_];
+  char * start = output;
+  output = formatFixed(time_ms, time_decimals_, output);
+  *output++ = ';';
+  output = formatFixed(index, 0, output);
+  *output++ = ';';
+  for (size_t k = 1; k < nb_values_; ++k)
+  {
+    output = formatFixed(values[k - 1], value_decimals_, output);
+    *output++ = ';';
+  }
+  *output++ = '\n';
+  buffer_fill_ += output - start;
+}
+
+void CsvWriter::append(const StampedSample * samples, size_t nb_samples,
+                       boost::chrono::high_resolution_clock::time_point time_zero)
+{
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    boost::chrono::nanoseconds rel_time = samples[i].acq_time - time_zero;
+    append(rel_time.count() * 1e-6, &samples[i].wrench.fx);
+  }
+}
+
+void CsvWriter::append(const RecordingSample * records, size_t nb_records)
+{
+  for (size_t i = 0; i < nb_records; ++i)
+    append(records[i].time_ns * 1e-6, records[i].wrench);
+}
+
+bool CsvWriter::flush()
+{
+  if (!isOpen())
+    return false;
+  if (buffer_fill_ > 0)
+    file_.write(&buffer_[0], buffer_fill_);
+  buffer_fill_ = 0;
+  file_.flush();
+  return !file_.fail();
+}
+
+bool CsvWriter::close()
+{
+  if (!isOpen())
+    return true;
+  bool is_ok = flush();
+  file_.close();
+  return is_ok && !file_.fail();
+}
@@ -13,14 +13,23 @@
 #include <iostream>
 #include <string>
 #include "optoforce/optoforce_driver.hpp"
-#include "omd/optopackage.h"
-#include "omd/optopackage6d.h"
+#include "optoforce/optoforce_omd_backend.hpp"
+#include "optoforce/optoforce_calibration.hpp"
 #include <cmath>
 #include <limits>
+#include <algorithm>
 
-OptoForceDriver::OptoForceDriver()
+// initial room for the samples read at once (1s of a 1kHz sensor)
+static const size_t PENDING_RESERVE = 1000;
+// samples kept at most per channel, when a channel is not read (10s of a 1kHz sensor)
+static const size_t PENDING_MAX = 10000;
+
+OptoForceDriver::OptoForceDriver(OptoForceDaq * daq) : daq_(daq), nb_overflows_(0)
 {
-  daq_ = new OptoDAQ();
+  // per default, the Optoforce library is used
+  if (daq_ == NULL)
+    daq_ = new OmdDaq();
+  resetAllocationStats();
 }
 
 OptoForceDriver::~OptoForceDriver()
@@ -48,6 +57,7 @@ bool OptoForceDriver::openDevice(const OPort & p_Port)
   if (isOpen())
   {
     port_ = p_Port;
+    nb_overflows_ = 0;
 
     // we check the sensor type
     opto_version optoVersion = daq_->getVersion();
@@ -60,6 +70,21 @@ bool OptoForceDriver::openDevice(const OPort & p_Port)
       factor_.resize(6);
     for (size_t i = 0; i < factor_.size(); ++i)
       factor_[i] = 1.0;
+    calibration_.assign(factor_.size(), 1.0f);
+
+    // a 3D daq may handle several sensors, a 6D one is seen as a single channel
+    size_t nb_channels = 1;
+    if (is_3D_sensor_ && daq_->getSensorSize() > 1)
+      nb_channels = daq_->getSensorSize();
+
+    // samples of a previous connection are not relevant anymore
+    pending_.assign(nb_channels, PendingSamples());
+    for (size_t i = 0; i < nb_channels; ++i)
+    {
+      pending_[i].begin = 0;
+      for (size_t axis = 0; axis < factor_.size(); ++axis)
+        pending_[i].axis[axis].reserve(PENDING_RESERVE);
+    }
 
     return true;
   }
@@ -76,85 +101,251 @@ void OptoForceDriver::closeDevice()
 }
 
 /*
- * This function reads data from our DAQ. The p_iSensorIndex tells the API
- * which sensor data we want to read (e.g. if we have a 4 channel DAQ then
- * we can read the 3th sensor's data with p_iSensorIndex = 2).
- * if we have a 6D sensor the p_iSensorIndex is ignored.
- * val: returned vector
- *      returned vector is basically a list. A list of vectors with Force Data
- *      First vector in the list represents oldest data in time
+ * Reads the daq only once all the samples previously read on that channel
+ * have been delivered, so that a caller with a small array does not lose any data.
+ * A single read provides the samples of all the channels of the daq:
+ * the calibrated samples of each channel are stored in pending_, whose storage
+ * is kept from one read to the other: no allocation once the largest batch has been seen.
+ * The whole batch is calibrated at once, axis after axis (see calibrateCounts).
  */
-bool OptoForceDriver::getData(std::vector< std::vector<float> > & val, int p_iSensorIndex )
+int OptoForceDriver::fetchData(size_t channel)
 {
-  // Here we can do anything with our Device (e.g. read data)
-  if (!isOpen())
+  if (channel >= pending_.size())
   {
-    return false;
+    std::cerr << "Invalid sensor index " << channel << std::endl;
+    return -3;
   }
-  val.clear();
 
-  // depending on the type, we may read either the first format or the second one
-  OptoPackage package3d;
-  OptoPackage6D *package6d = NULL;
-  int iSize;
+  if (pending_[channel].size() > 0)
+    return pending_[channel].size();
 
-  if (is_3D_sensor_)
-  {
-    // We have a 3D sensor
-    // The 3th parameter set to false clears the DAQ's internal buffer.
-    iSize = daq_->read(package3d, p_iSensorIndex, false);
-  }
-  else
-  {
-    // We have a 6D sensor
-    // Read last Data available on the Buffer
-    iSize = daq_->readAll6D(package6d, false);
-  }
+  // Read all data available on the Buffer, for all the channels.
+  // The DAQ's internal buffer is cleared.
+  RawCounts counts;
+  int iSize = daq_->readAll(counts);
 
   if (iSize < 0)
   {
     if (iSize == -1)
+    {
       std::cerr << "Buffer is full" << std::endl;
+      ++nb_overflows_;
+    }
     else if (iSize == -2)
       std::cerr << "DAQ is Closed" << std::endl;
 
     // Something went wrong, please read the online documentation about error codes. (http://www.optoforce.com/software/API/apidoc/)
+    return iSize;
+  }
+
+  size_t nb_axes = factor_.size();
+  for (size_t ch = 0; ch < pending_.size(); ++ch)
+  {
+    PendingSamples & pending = pending_[ch];
+
+    // what was delivered is dropped, what other channels did not read yet is kept
+    // a channel that is never read should not grow forever: oldest samples are dropped
+    size_t nb_kept = pending.size();
+    if (nb_kept + iSize > PENDING_MAX)
+      nb_kept -= std::min(nb_kept, nb_kept + iSize - PENDING_MAX);
+    size_t nb_dropped = pending.axis[0].size() - nb_kept;
+
+    float * output[6];
+    for (size_t axis = 0; axis < nb_axes; ++axis)
+    {
+      std::vector<float> & values = pending.axis[axis];
+      size_t capacity = values.capacity();
+
+      values.erase(values.begin(), values.begin() + nb_dropped);
+      values.resize(nb_kept + iSize);
+      output[axis] = values.data() + nb_kept;
+
+      if (values.capacity() != capacity)
+      {
+        ++alloc_stats_.nb_allocations;
+        alloc_stats_.nb_bytes += values.capacity() * sizeof(float);
+      }
+    }
+    pending.begin = 0;
+
+    if (iSize == 0)
+      continue;
+
+    calibrateCounts(counts.data + ch * counts.channel_stride, counts.sample_stride, iSize,
+                    &factor_[0], nb_axes, output);
+  }
+  return pending_[channel].size();
+}
+
+/*
+ * Interleaves the pending values of the channel into the caller array.
+ * For a 3D sensor, the torque entries are set to 0.
+ */
+void OptoForceDriver::deliverData(size_t channel, Wrench6 * samples, size_t nb_samples)
+{
+  PendingSamples & pending = pending_[channel];
+  bool has_torques = (factor_.size() == 6);
+
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    size_t k = pending.begin + i;
+    samples[i].fx = pending.axis[0][k];
+    samples[i].fy = pending.axis[1][k];
+    samples[i].fz = pending.axis[2][k];
+    samples[i].tx = has_torques ? pending.axis[3][k] : 0.0f;
+    samples[i].ty = has_torques ? pending.axis[4][k] : 0.0f;
+    samples[i].tz = has_torques ? pending.axis[5][k] : 0.0f;
+  }
+  pending.begin += nb_samples;
+}
+
+void OptoForceDriver::deliverData(size_t channel, Force3 * samples, size_t nb_samples)
+{
+  PendingSamples & pending = pending_[channel];
+
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    size_t k = pending.begin + i;
+    samples[i].fx = pending.axis[0][k];
+    samples[i].fy = pending.axis[1][k];
+    samples[i].fz = pending.axis[2][k];
+  }
+  pending.begin += nb_samples;
+}
+
+OptoForceDriver::AllocationStats OptoForceDriver::getAllocationStats() const
+{
+  AllocationStats stats = alloc_stats_;
+
+  // the staging buffers are handled by the daq
+  unsigned long nb_allocations, nb_bytes;
+  daq_->getStagingAllocations(nb_allocations, nb_bytes);
+  stats.nb_allocations += nb_allocations - daq_nb_allocations_start_;
+  stats.nb_bytes += nb_bytes - daq_nb_bytes_start_;
+
+  stats.duration = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - alloc_stats_start_).count();
+  if (stats.duration > 0.0)
+  {
+    stats.allocations_per_second = stats.nb_allocations / stats.duration;
+    stats.bytes_per_second = stats.nb_bytes / stats.duration;
+  }
+  return stats;
+}
+
+void OptoForceDriver::resetAllocationStats()
+{
+  alloc_stats_.nb_allocations = 0;
+  alloc_stats_.nb_bytes = 0;
+  alloc_stats_.duration = 0.0;
+  alloc_stats_.allocations_per_second = 0.0;
+  alloc_stats_.bytes_per_second = 0.0;
+  alloc_stats_start_ = boost::chrono::steady_clock::now();
+  daq_->getStagingAllocations(daq_nb_allocations_start_, daq_nb_bytes_start_);
+}
+
+int OptoForceDriver::getData(Wrench6 * samples, int capacity, int p_iSensorIndex)
+{
+  if (!isOpen())
+  {
+    return -2;
+  }
+
+  // a 6D sensor has a single channel
+  size_t channel = is_3D_sensor_ ? p_iSensorIndex : 0;
+  int iSize = fetchData(channel);
+  if (iSize <= 0)
+    return iSize;
+
+  int nb_copied = std::min(iSize, capacity);
+  deliverData(channel, samples, nb_copied);
+  return nb_copied;
+}
+
+int OptoForceDriver::getData(Force3 * samples, int capacity, int p_iSensorIndex)
+{
+  if (!isOpen())
+  {
+    return -2;
+  }
+
+  // a 6D sensor has a single channel
+  size_t channel = is_3D_sensor_ ? p_iSensorIndex : 0;
+  int iSize = fetchData(channel);
+  if (iSize <= 0)
+    return iSize;
+
+  int nb_copied = std::min(iSize, capacity);
+  deliverData(channel, samples, nb_copied);
+  return nb_copied;
+}
+
+/*
+ * A single read of the daq is needed for all the channels,
+ * the following channels are then served from pending_.
+ */
+int OptoForceDriver::getDataAllChannels(Force3 * samples, int capacity, int * nb_samples)
+{
+  if (!isOpen())
+  {
+    return -2;
+  }
+
+  int nb_total = 0;
+  for (size_t ch = 0; ch < pending_.size(); ++ch)
+  {
+    int nb_read = getData(samples + ch * capacity, capacity, ch);
+    if (nb_read < 0)
+      return nb_read;
+    nb_samples[ch] = nb_read;
+    nb_total += nb_read;
+  }
+  return nb_total;
+}
+
+int OptoForceDriver::getNumberChannels() const
+{
+  return pending_.size();
+}
+
+/*
+ * This function reads data from our DAQ. The p_iSensorIndex tells the API
+ * which sensor data we want to read (e.g. if we have a 4 channel DAQ then
+ * we can read the 3th sensor's data with p_iSensorIndex = 2).
+ * if we have a 6D sensor the p_iSensorIndex is ignored.
+ * val: returned vector
+ *      returned vector is basically a list. A list of vectors with Force Data
+ *      First vector in the list represents oldest data in time
+ * Kept for compatibility, the getData on Wrench6 avoids the allocations.
+ */
+bool OptoForceDriver::getData(std::vector< std::vector<float> > & val, int p_iSensorIndex )
+{
+  // Here we can do anything with our Device (e.g. read data)
+  if (!isOpen())
+  {
     return false;
   }
+  val.clear();
 
-  if (iSize == 0)
+  // a 6D sensor has a single channel
+  size_t channel = is_3D_sensor_ ? p_iSensorIndex : 0;
+  int iSize = fetchData(channel);
+  if (iSize <= 0)
   {
     //std::cout << "No new data could be read! (3D)" << std::endl << std::flush;
     return false;
   }
 
-  if (iSize > 0)
+  PendingSamples & pending = pending_[channel];
+  val.resize(iSize);
+  for (int i = 0; i < iSize; i++)
   {
-    for (int i = 0; i < iSize; i++)
-    {
-      std::vector<float> data;
-      data.clear();
+    std::vector<float> & sample = val[i];
 
-      if (is_3D_sensor_)
-      {
-        data.push_back(package3d.x * factor_[0]);
-        data.push_back(package3d.y * factor_[1]);
-        data.push_back(package3d.z * factor_[2]);
-      }
-      else
-      {
-        data.push_back(package6d[i].Fx * factor_[0]);
-        data.push_back(package6d[i].Fy * factor_[1]);
-        data.push_back(package6d[i].Fz * factor_[2]);
-        data.push_back(package6d[i].Tx * factor_[3]);
-        data.push_back(package6d[i].Ty * factor_[4]);
-        data.push_back(package6d[i].Tz * factor_[5]);
-      }
-      val.push_back(data);
-    }
+    sample.resize(factor_.size());
+    for (size_t axis = 0; axis < factor_.size(); ++axis)
+      sample[axis] = pending.axis[axis][pending.begin + i];
   }
-  if (package6d != NULL)
-    delete[] package6d;
+  pending.begin += iSize;
   return true;
 }
 
@@ -175,53 +366,38 @@ bool OptoForceDriver::getData(std::vector<float> & val, int p_iSensorIndex )
   }
   val.clear();
 
-  // depending on the type, we may read either the first format or the second one
-  OptoPackage package3d;
-  OptoPackage6D package6d;
-  int iSize;
-  
-  if (is_3D_sensor_) 
+  // a 6D sensor has a single channel
+  size_t channel = is_3D_sensor_ ? p_iSensorIndex : 0;
+  if (channel >= pending_.size())
   {
-    // We have a 3D sensor
-    // The 3th parameter set to false clears the DAQ's internal buffer.
-    iSize = daq_->read(package3d, p_iSensorIndex, false);
-  }
-  else
-  {
-    // We have a 6D sensor
-    // Read last Data available on the Buffer
-    iSize = daq_->read6D(package6d, false);
+    std::cerr << "Invalid sensor index " << channel << std::endl;
+    return false;
   }
-  
-  if (iSize < 0) 
+
+  // only the latest value is of interest: the older ones are skipped,
+  // and the DAQ's internal buffer is cleared.
+  PendingSamples & pending = pending_[channel];
+  pending.begin = pending.axis[0].size();
+
+  int iSize = fetchData(channel);
+  if (iSize < 0)
   {
     // Something went wrong, please read the online documentation about error codes. (http://www.optoforce.com/software/API/apidoc/)
     return false;
   }
-  
-  if (iSize == 0) 
+
+  if (iSize == 0)
   {
     std::cout << "No new data could be read! (3D)" << std::endl << std::flush;
     return false;
   }
 
   // now we can assume the value is > 0
-  if (is_3D_sensor_) 
-  {
-    val.push_back(package3d.x * factor_[0]);
-    val.push_back(package3d.y * factor_[1]);
-    val.push_back(package3d.z * factor_[2]);
-  }
-  else
-  {
-    val.push_back(package6d.Fx * factor_[0]);
-    val.push_back(package6d.Fy * factor_[1]);
-    val.push_back(package6d.Fz * factor_[2]);
-    val.push_back(package6d.Tx * factor_[3]);
-    val.push_back(package6d.Ty * factor_[4]);
-    val.push_back(package6d.Tz * factor_[5]);
-  }
-  
+  size_t last = pending.axis[0].size() - 1;
+  for (size_t axis = 0; axis < factor_.size(); ++axis)
+    val.push_back(pending.axis[axis][last]);
+  pending.begin = pending.axis[0].size();
+
   return true;
 }
 
@@ -266,9 +442,15 @@ bool OptoForceDriver::setCalibration(const std::vector<float> & factor)
     factor_[i] = 1.0 / factor[i];
     //std::cout << "factor: " << factor_[i] << std::endl;
   }
+  calibration_ = factor;
   return true;
 }
 
+std::vector<float> OptoForceDriver::getCalibration() const
+{
+  return calibration_;
+}
+
 bool OptoForceDriver::setFiltering(const sensor_filter filter)
 {
   //std::cout << "[OptoForceDriver::setFiltering] filter: " << filter << std::endl;
@@ -308,6 +490,32 @@ bool OptoForceDriver::setFrequency(const sensor_speed freq)
   return true;
 }
 
+double OptoForceDriver::getSampleFrequency()
+{
+  if (!isOpen())
+  {
+    return 0.0;
+  }
+
+  switch (daq_->getConfig().speed)
+  {
+    case speed_1000hz:
+      return 1000.0;
+    case speed_333hz:
+      return 1000.0 / 3.0;
+    case speed_100hz:
+      return 100.0;
+    case speed_30hz:
+      return 30.0;
+  }
+  return 0.0;
+}
+
+unsigned long OptoForceDriver::getNumberOverflows() const
+{
+  return nb_overflows_;
+}
+
 bool OptoForceDriver::setZeroAll()
 {
   if (!isOpen())
@@ -0,0 +1,145 @@
+/**
+ * @file   optoforce_merge.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Single csv file gathering the samples of several devices, given in time order.
+ *
+ */
+
+#include "optoforce/optoforce_merge.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+static const char * AXES[] = {"f_x", "f_y", "f_z", "t_x", "t_y", "t_z"};
+
+MergedCsvWriter::MergedCsvWriter() : mode_(merge_events),
+                                     period_ns_(1000000),
+                                     tick_ns_(0),
+                                     is_started_(false),
+                                     nb_rows_(0)
+{
+}
+
+void MergedCsvWriter::setPrecision(unsigned int time_decimals, unsigned int value_decimals)
+{
+  csv_.setPrecision(time_decimals, value_decimals);
+}
+
+bool MergedCsvWriter::open(const std::string & filename, const std::vector<std::string> & serial_numbers,
+                           const std::vector<size_t> & nb_axes, merge_output mode, int64_t period_ns)
+{
+  close();
+
+  if ((mode == merge_none) || (nb_axes.size() != serial_numbers.size()) ||
+      ((mode != merge_events) && (period_ns <= 0)))
+    return false;
+
+  mode_ = mode;
+  period_ns_ = period_ns;
+  nb_axes_.resize(nb_axes.size());
+  for (size_t i = 0; i < nb_axes.size(); ++i)
+    nb_axes_[i] = (nb_axes[i] == 3) ? 3 : 6;
+  is_started_ = false;
+  last_.resize(nb_axes_.size());
+  has_last_.assign(nb_axes_.size(), false);
+  nearest_.resize(nb_axes_.size());
+  has_nearest_.assign(nb_axes_.size(), false);
+  nb_rows_ = 0;
+
+  std::vector<std::string> columns;
+  if (mode_ == merge_events)
+  {
+    // the device index, then all axes, whatever the sensor
+    columns.push_back("device");
+    columns.insert(columns.end(), AXES, AXES + 6);
+  }
+  else
+  {
+    for (size_t i = 0; i < serial_numbers.size(); ++i)
+      for (size_t k = 0; k < nb_axes_[i]; ++k)
+        columns.push_back(serial_numbers[i] + "_" + AXES[k]);
+  }
+  row_.resize(columns.size());
+  return csv_.open(filename, columns);
+}
+
+void MergedCsvWriter::append(size_t device, int64_t time_ns, const float * wrench)
+{
+  if (mode_ == merge_events)
+  {
+    csv_.append(time_ns * 1e-6, (unsigned int) device, wrench);
+    ++nb_rows_;
+    return;
+  }
+
+  if (is_started_)
+  {
+    // the samples come in time order: the ticks before this one are final
+    if (mode_ == merge_hold_last)
+    {
+      while (time_ns > tick_ns_)
+        writeTick();
+    }
+    else
+    {
+      int64_t half_period_ns = period_ns_ / 2;
+      while (time_ns >= tick_ns_ + half_period_ns)
+        writeTick();
+      if ((time_ns >= tick_ns_ - half_period_ns) &&
+          (!has_nearest_[device] ||
+           (std::llabs(time_ns - tick_ns_) < std::llabs(nearest_[device].time_ns - tick_ns_))))
+      {
+        nearest_[device].time_ns = time_ns;
+        std::copy(wrench, wrench + 6, nearest_[device].wrench);
+        has_nearest_[device] = true;
+      }
+    }
+  }
+
+  last_[device].time_ns = time_ns;
+  std::copy(wrench, wrench + 6, last_[device].wrench);
+  has_last_[device] = true;
+
+  // the timeline starts at the first tick where every device has a value
+  if (!is_started_ && (std::find(has_last_.begin(), has_last_.end(), false) == has_last_.end()))
+  {
+    is_started_ = true;
+    tick_ns_ = (time_ns / period_ns_) * period_ns_;
+    if (tick_ns_ < time_ns)
+      tick_ns_ += period_ns_;
+    if ((mode_ == merge_nearest) && (tick_ns_ - time_ns < period_ns_ / 2))
+    {
+      nearest_[device] = last_[device];
+      has_nearest_[device] = true;
+    }
+  }
+}
+
+void MergedCsvWriter::writeTick()
+{
+  float * values = &row_[0];
+  for (size_t i = 0; i < nb_axes_.size(); ++i)
+  {
+    const RecordingSample & sample = has_nearest_[i] ? nearest_[i] : last_[i];
+    values = std::copy(sample.wrench, sample.wrench + nb_axes_[i], values);
+  }
+  csv_.append(tick_ns_ * 1e-6, &row_[0]);
+  ++nb_rows_;
+
+  has_nearest_.assign(has_nearest_.size(), false);
+  tick_ns_ += period_ns_;
+}
+
+bool MergedCsvWriter::flush()
+{
+  return csv_.flush();
+}
+
+bool MergedCsvWriter::close()
+{
+  return csv_.close();
+}
@@ -0,0 +1,197 @@
+/**
+ * @file   optoforce_omd_backend.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Backend relying on the Optoforce library (OptoDAQ, OptoPorts).
+ *        This is the one used by default by the drivers.
+ */
+
+#include "optoforce/optoforce_omd_backend.hpp"
+#include "omd/optopackage.h"
+#include "omd/optopackage6d.h"
+
+OmdDaq::OmdDaq() : is_3D_sensor_(true),
+                   package3d_buffer_(NULL),
+                   package6d_buffer_(NULL),
+                   package3d_buffer_size_(0),
+                   package6d_buffer_size_(0),
+                   nb_allocations_(0),
+                   nb_bytes_(0)
+{
+  daq_ = new OptoDAQ();
+}
+
+OmdDaq::~OmdDaq()
+{
+  close();
+  delete daq_;
+
+  // staging buffers are kept until the end, and released here
+  if (package3d_buffer_ != NULL)
+    delete[] package3d_buffer_;
+  if (package6d_buffer_ != NULL)
+    delete[] package6d_buffer_;
+}
+
+bool OmdDaq::open(const OPort & port)
+{
+  daq_->open(port);
+  if (!daq_->isOpen())
+    return false;
+
+  // sensor type deduced from DAQ's version number
+  opto_version optoVersion = daq_->getVersion();
+  is_3D_sensor_ = (optoVersion != _95 && optoVersion != _64);
+  return true;
+}
+
+void OmdDaq::close()
+{
+  if (daq_->isOpen())
+    daq_->close();
+}
+
+bool OmdDaq::isOpen()
+{
+  return daq_->isOpen();
+}
+
+opto_version OmdDaq::getVersion()
+{
+  return daq_->getVersion();
+}
+
+int OmdDaq::getSensorSize()
+{
+  return daq_->getSensorSize();
+}
+
+SensorConfig OmdDaq::getConfig()
+{
+  return daq_->getConfig();
+}
+
+bool OmdDaq::sendConfig(const SensorConfig & config)
+{
+  return daq_->sendConfig(config);
+}
+
+bool OmdDaq::zero(int number)
+{
+  return daq_->zero(number);
+}
+
+void OmdDaq::zeroAll()
+{
+  daq_->zeroAll();
+}
+
+/*
+ * The staging buffers given to the daq are the ones of the previous read.
+ * The OMD library reallocates them in place to the number of samples read,
+ * so that no allocation is needed once the largest batch has been seen.
+ * Note: it releases the buffer when no sample is available.
+ */
+int OmdDaq::readAll(RawCounts & counts)
+{
+  int iSize;
+
+  if (is_3D_sensor_)
+  {
+    // Read all data available on the Buffer, for all the channels, channel after channel.
+    // The 2nd parameter set to false clears the DAQ's internal buffer.
+    const OptoPackage * previous = package3d_buffer_;
+    size_t nb_channels = (daq_->getSensorSize() > 1) ? daq_->getSensorSize() : 1;
+    iSize = daq_->readAll(package3d_buffer_, false);
+    trackStagingBuffer(previous, package3d_buffer_size_, package3d_buffer_,
+                       (iSize > 0) ? iSize * nb_channels : 0, sizeof(OptoPackage));
+
+    if (iSize > 0)
+    {
+      counts.data = &package3d_buffer_[0].x;
+      counts.sample_stride = sizeof(OptoPackage) / sizeof(int);
+      counts.channel_stride = iSize * counts.sample_stride;
+    }
+  }
+  else
+  {
+    // Read all data available on the Buffer
+    const OptoPackage6D * previous = package6d_buffer_;
+    iSize = daq_->readAll6D(package6d_buffer_, false);
+    trackStagingBuffer(previous, package6d_buffer_size_, package6d_buffer_,
+                       (iSize > 0) ? iSize : 0, sizeof(OptoPackage6D));
+
+    if (iSize > 0)
+    {
+      counts.data = &package6d_buffer_[0].Fx;
+      counts.sample_stride = sizeof(OptoPackage6D) / sizeof(int);
+      counts.channel_stride = 0;
+    }
+  }
+  return iSize;
+}
+
+/*
+ * A (re)allocation is counted when the buffer moved, or when it grew in place.
+ * A buffer released by the library is reallocated at next non-empty read,
+ * and counted then.
+ */
+void OmdDaq::trackStagingBuffer(const void * previous, size_t & size,
+                                const void * current, size_t new_size,
+                                size_t item_size)
+{
+  if ((current != NULL) && ((current != previous) || (new_size > size)))
+  {
+    ++nb_allocations_;
+    nb_bytes_ += new_size * item_size;
+  }
+  size = (current != NULL) ? new_size : 0;
+}
+
+void OmdDaq::getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const
+{
+  nb_allocations = nb_allocations_;
+  nb_bytes = nb_bytes_;
+}
+
+OmdPortEnumerator::OmdPortEnumerator() : ports_(new OptoPorts())
+{
+}
+
+OmdPortEnumerator::~OmdPortEnumerator()
+{
+  delete ports_;
+}
+
+int OmdPortEnumerator::getSize()
+{
+  return ports_->getSize(true);
+}
+
+std::vector<OPort> OmdPortEnumerator::listPorts()
+{
+  std::vector<OPort> result;
+  int iSize = ports_->getSize(true);
+  if (iSize > 0)
+  {
+    OPort * portList = ports_->listPorts(true);
+    iSize = ports_->getLastSize(); // this is the exact number of ports in portList after calling listPorts
+    for (int i = 0; i < iSize; ++i)
+      result.push_back(portList[i]);
+  }
+  return result;
+}
+
+OptoForcePortEnumerator * OmdBackend::createPortEnumerator()
+{
+  return new OmdPortEnumerator();
+}
+
+OptoForceDaq * OmdBackend::createDaq()
+{
+  return new OmdDaq();
+}
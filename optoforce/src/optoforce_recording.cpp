@@ -0,0 +1,544 @@
+/**
+ * @file   optoforce_recording.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Binary recording files: a header describing the device, followed by
+ *        fixed-size records, compressed blocks or column chunks, written by large blocks as the samples are acquired.
+ */
+
+#include "optoforce/optoforce_recording.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// write a whole buffer, retrying on partial writes
+static bool writeAll(int fd, const void * data, size_t size)
+{
+  const char * bytes = static_cast<const char *>(data);
+  while (size > 0)
+  {
+    ssize_t nb_written = ::write(fd, bytes, size);
+    if (nb_written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    bytes += nb_written;
+    size -= nb_written;
+  }
+  return true;
+}
+
+// read a whole buffer, false if the file ends before
+static bool readAll(int fd, void * data, size_t size)
+{
+  char * bytes = static_cast<char *>(data);
+  while (size > 0)
+  {
+    ssize_t nb_read = ::read(fd, bytes, size);
+    if (nb_read < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (nb_read == 0)
+      return false;
+    bytes += nb_read;
+    size -= nb_read;
+  }
+  return true;
+}
+
+void initRecordingHeader(RecordingHeader & header)
+{
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  header.header_size = sizeof(RecordingHeader);
+  header.record_size = sizeof(RecordingSample);
+  header.nb_axes = 6;
+  for (size_t i = 0; i < 6; ++i)
+    header.calibration[i] = 1.0f;
+}
+
+void readChunkColumns(const unsigned char * columns, std::vector<RecordingSample> & records)
+{
+  size_t nb_records = records.size();
+  for (size_t i = 0; i < nb_records; ++i)
+    std::memcpy(&records[i].time_ns, columns + i * sizeof(int64_t), sizeof(int64_t));
+  columns += nb_records * sizeof(int64_t);
+  for (size_t k = 0; k < 6; ++k)
+  {
+    for (size_t i = 0; i < nb_records; ++i)
+      std::memcpy(&records[i].wrench[k], columns + (k * nb_records + i) * sizeof(float), sizeof(float));
+  }
+}
+
+bool writeRecordingManifest(const std::string & filename, const RecordingHeader & header,
+                            const std::vector<RecordingSegment> & segments)
+{
+  // written aside and renamed, so that a reader never sees a partial manifest
+  std::string temporary = filename + ".tmp";
+  std::ofstream file(temporary.c_str());
+  if (!file)
+  {
+    std::cerr << "[writeRecordingManifest] could not create " << temporary << std::endl;
+    return false;
+  }
+
+  file << "# optoforce recording of " << header.serial_number
+       << ", started at " << header.start_time_ns << " ns since epoch" << std::endl;
+  file << "# file;first_time_ms;last_time_ms;nb_samples;nb_bytes" << std::endl;
+  file.setf(std::ios::fixed);
+  file.precision(3);
+  for (size_t i = 0; i < segments.size(); ++i)
+  {
+    file << segments[i].filename << ";"
+         << segments[i].first_time_ns * 1e-6 << ";"
+         << segments[i].last_time_ns * 1e-6 << ";"
+         << segments[i].nb_records << ";"
+         << segments[i].nb_bytes << std::endl;
+  }
+  file.close();
+  if (!file || (std::rename(temporary.c_str(), filename.c_str()) != 0))
+  {
+    std::cerr << "[writeRecordingManifest] could not write " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool readRecordingManifest(const std::string & filename, std::vector<RecordingSegment> & segments)
+{
+  std::ifstream file(filename.c_str());
+  if (!file)
+  {
+    std::cerr << "[readRecordingManifest] could not open " << filename << std::endl;
+    return false;
+  }
+
+  segments.clear();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || (line[0] == '#'))
+      continue;
+
+    RecordingSegment segment;
+    size_t separator = line.find(';');
+    double first_time_ms, last_time_ms;
+    if ((separator == std::string::npos) ||
+        (std::sscanf(line.c_str() + separator + 1, "%lf;%lf;%llu;%llu", &first_time_ms, &last_time_ms,
+                     &segment.nb_records, &segment.nb_bytes) != 4))
+    {
+      std::cerr << "[readRecordingManifest] unexpected line in " << filename << ": " << line << std::endl;
+      return false;
+    }
+    segment.filename = line.substr(0, separator);
+    segment.first_time_ns = (int64_t) std::floor(first_time_ms * 1e6 + 0.5);
+    segment.last_time_ns = (int64_t) std::floor(last_time_ms * 1e6 + 0.5);
+    segments.push_back(segment);
+  }
+  return true;
+}
+
+RecordingWriter::RecordingWriter(size_t block_size)
+  : block_(std::max(block_size, (size_t) 1)),
+    block_fill_(0),
+    fd_(-1),
+    nb_records_(0),
+    nb_bytes_(0),
+    encoding_(encoding_records)
+{
+}
+
+RecordingWriter::~RecordingWriter()
+{
+  close();
+}
+
+bool RecordingWriter::open(const std::string & filename, const RecordingHeader & header)
+{
+  close();
+
+  fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+  {
+    std::cerr << "[RecordingWriter::open] could not create " << filename << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  RecordingHeader file_header = header;
+  std::memcpy(file_header.magic, RECORDING_MAGIC, sizeof(file_header.magic));
+  file_header.version = RECORDING_VERSION;
+  file_header.header_size = sizeof(RecordingHeader);
+  file_header.record_size = sizeof(RecordingSample);
+  file_header.serial_number[sizeof(file_header.serial_number) - 1] = '\0';
+  file_header.nb_records = 0;
+  if ((file_header.encoding != encoding_delta_varint) && (file_header.encoding != encoding_columnar))
+    file_header.encoding = encoding_records;
+
+  block_fill_ = 0;
+  nb_records_ = 0;
+  encoding_ = file_header.encoding;
+  if (encoding_ == encoding_delta_varint)
+  {
+    encoder_.setCalibration(file_header.nb_axes, file_header.calibration);
+    encoded_.resize(sizeof(RecordingBlock) + block_.size() * SampleCodec::MAX_ENCODED_SIZE);
+  }
+  else if (encoding_ == encoding_columnar)
+    encoded_.resize(sizeof(RecordingChunk) + block_.size() * sizeof(RecordingSample));
+  nb_bytes_ = 0;
+  if (!write(&file_header, sizeof(file_header)))
+  {
+    std::cerr << "[RecordingWriter::open] could not write the header of " << filename << std::endl;
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+bool RecordingWriter::append(const RecordingSample * records, size_t nb_records)
+{
+  if (!isOpen())
+    return false;
+
+  while (nb_records > 0)
+  {
+    // large appends bypass the block, once it is written
+    if ((block_fill_ == 0) && (nb_records >= block_.size()) && (encoding_ == encoding_records))
+    {
+      size_t nb_direct = nb_records - nb_records % block_.size();
+      if (!write(records, nb_direct * sizeof(RecordingSample)))
+        return false;
+      records += nb_direct;
+      nb_records -= nb_direct;
+      nb_records_ += nb_direct;
+      continue;
+    }
+
+    size_t nb_copied = std::min(nb_records, block_.size() - block_fill_);
+    std::copy(records, records + nb_copied, block_.begin() + block_fill_);
+    block_fill_ += nb_copied;
+    records += nb_copied;
+    nb_records -= nb_copied;
+    nb_records_ += nb_copied;
+
+    if ((block_fill_ == block_.size()) && !flush())
+      return false;
+  }
+  return true;
+}
+
+bool RecordingWriter::append(const StampedSample * samples, size_t nb_samples,
+                             boost::chrono::high_resolution_clock::time_point time_zero)
+{
+  if (!isOpen())
+    return false;
+
+  for (size_t i = 0; i < nb_samples; ++i)
+  {
+    RecordingSample & record = block_[block_fill_];
+    record.time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(samples[i].acq_time - time_zero).count();
+    const float * wrench = &samples[i].wrench.fx;
+    std::copy(wrench, wrench + 6, record.wrench);
+    ++block_fill_;
+    ++nb_records_;
+
+    if ((block_fill_ == block_.size()) && !flush())
+      return false;
+  }
+  return true;
+}
+
+bool RecordingWriter::flush()
+{
+  if (!isOpen())
+    return false;
+  if (block_fill_ == 0)
+    return true;
+
+  if (encoding_ == encoding_records)
+  {
+    bool is_ok = write(&block_[0], block_fill_ * sizeof(RecordingSample));
+    block_fill_ = 0;
+    return is_ok;
+  }
+  if (encoding_ == encoding_columnar)
+  {
+    size_t nb_bytes = fillChunk();
+    block_fill_ = 0;
+    return write(&encoded_[0], nb_bytes);
+  }
+
+  // each block is coded on its own, so that it can be decoded without the previous ones
+  encoder_.reset();
+  unsigned char * start = &encoded_[0] + sizeof(RecordingBlock);
+  unsigned char * output = start;
+  for (size_t i = 0; i < block_fill_; ++i)
+    output = encoder_.encode(block_[i], output);
+
+  RecordingBlock block;
+  block.nb_records = block_fill_;
+  block.nb_bytes = output - start;
+  std::memcpy(&encoded_[0], &block, sizeof(block));
+  block_fill_ = 0;
+  return write(&encoded_[0], output - &encoded_[0]);
+}
+
+size_t RecordingWriter::fillChunk()
+{
+  RecordingChunk chunk;
+  std::memset(&chunk, 0, sizeof(chunk));
+  chunk.block.nb_records = block_fill_;
+  chunk.block.nb_bytes = sizeof(chunk) - sizeof(chunk.block) + block_fill_ * sizeof(RecordingSample);
+  chunk.first_time_ns = block_[0].time_ns;
+  chunk.last_time_ns = block_[block_fill_ - 1].time_ns;
+
+  unsigned char * output = &encoded_[0] + sizeof(chunk);
+  for (size_t i = 0; i < block_fill_; ++i)
+    std::memcpy(output + i * sizeof(int64_t), &block_[i].time_ns, sizeof(int64_t));
+  output += block_fill_ * sizeof(int64_t);
+
+  for (size_t k = 0; k < 6; ++k)
+  {
+    float * column = reinterpret_cast<float *>(output + k * block_fill_ * sizeof(float));
+    float min = block_[0].wrench[k];
+    float max = min;
+    double sum = 0.0;
+    for (size_t i = 0; i < block_fill_; ++i)
+    {
+      float value = block_[i].wrench[k];
+      column[i] = value;
+      min = std::min(min, value);
+      max = std::max(max, value);
+      sum += value;
+    }
+    chunk.min[k] = min;
+    chunk.max[k] = max;
+    chunk.mean[k] = (float) (sum / block_fill_);
+  }
+
+  std::memcpy(&encoded_[0], &chunk, sizeof(chunk));
+  return sizeof(chunk) + block_fill_ * sizeof(RecordingSample);
+}
+
+bool RecordingWriter::write(const void * data, size_t size)
+{
+  if (!writeAll(fd_, data, size))
+    return false;
+  nb_bytes_ += size;
+  return true;
+}
+
+bool RecordingWriter::preallocate(unsigned long long nb_bytes)
+{
+  if (!isOpen())
+    return false;
+  // the size of the file is kept, so that readers still see the records written only
+  if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, nb_bytes) != 0)
+  {
+    std::cerr << "[RecordingWriter::preallocate] could not reserve " << nb_bytes << " bytes: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool RecordingWriter::close()
+{
+  if (!isOpen())
+    return true;
+
+  bool is_ok = flush();
+  // the space reserved beyond the data is released
+  is_ok = is_ok && (::ftruncate(fd_, nb_bytes_) == 0);
+
+  // the number of records tells readers the file is complete
+  uint64_t nb_records = nb_records_;
+  is_ok = is_ok && (::pwrite(fd_, &nb_records, sizeof(nb_records),
+                             offsetof(RecordingHeader, nb_records)) == (ssize_t) sizeof(nb_records));
+  is_ok = (::close(fd_) == 0) && is_ok;
+  fd_ = -1;
+  return is_ok;
+}
+
+RecordingReader::RecordingReader() : fd_(-1), nb_records_(0), nb_read_(0), decoded_read_(0)
+{
+  initRecordingHeader(header_);
+}
+
+RecordingReader::~RecordingReader()
+{
+  close();
+}
+
+bool RecordingReader::open(const std::string & filename)
+{
+  close();
+
+  fd_ = ::open(filename.c_str(), O_RDONLY);
+  if (fd_ < 0)
+  {
+    std::cerr << "[RecordingReader::open] could not open " << filename << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  bool is_ok = readAll(fd_, &header_, sizeof(header_)) &&
+    (std::memcmp(header_.magic, RECORDING_MAGIC, sizeof(header_.magic)) == 0);
+  if (!is_ok)
+    std::cerr << "[RecordingReader::open] " << filename << " is not an optoforce recording" << std::endl;
+  else if ((header_.version != RECORDING_VERSION) || (header_.record_size != sizeof(RecordingSample)) ||
+           (header_.header_size < sizeof(RecordingHeader)) || (header_.encoding > encoding_columnar))
+  {
+    std::cerr << "[RecordingReader::open] unsupported recording version " << header_.version << std::endl;
+    is_ok = false;
+  }
+
+  struct stat file_stat;
+  is_ok = is_ok && (fstat(fd_, &file_stat) == 0) &&
+    (lseek(fd_, header_.header_size, SEEK_SET) == (off_t) header_.header_size);
+  if (!is_ok)
+  {
+    close();
+    return false;
+  }
+
+  header_.serial_number[sizeof(header_.serial_number) - 1] = '\0';
+  nb_read_ = 0;
+  decoded_.clear();
+  decoded_read_ = 0;
+
+  if (header_.encoding != encoding_records)
+  {
+    decoder_.setCalibration(header_.nb_axes, header_.calibration);
+    // an interrupted recording has no count: the complete blocks are kept
+    nb_records_ = header_.nb_records;
+    if (nb_records_ == 0)
+    {
+      nb_records_ = countBlockRecords();
+      is_ok = (lseek(fd_, header_.header_size, SEEK_SET) == (off_t) header_.header_size);
+    }
+    if (!is_ok)
+      close();
+    return is_ok;
+  }
+
+  // an interrupted recording has no count: the complete records are kept
+  unsigned long long nb_stored = (file_stat.st_size - header_.header_size) / header_.record_size;
+  nb_records_ = (header_.nb_records > 0) ? std::min((unsigned long long) header_.nb_records, nb_stored) : nb_stored;
+  return true;
+}
+
+void RecordingReader::close()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  nb_records_ = 0;
+  nb_read_ = 0;
+}
+
+unsigned long long RecordingReader::countBlockRecords()
+{
+  unsigned long long nb_records = 0;
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0)
+    return 0;
+
+  off_t position = header_.header_size;
+  RecordingBlock block;
+  while (readAll(fd_, &block, sizeof(block)))
+  {
+    position += sizeof(block) + block.nb_bytes;
+    if (position > file_stat.st_size)
+      break;
+    nb_records += block.nb_records;
+    if (lseek(fd_, position, SEEK_SET) != position)
+      break;
+  }
+  return nb_records;
+}
+
+bool RecordingReader::readBlock()
+{
+  RecordingBlock block;
+  if (!readAll(fd_, &block, sizeof(block)))
+    return false;
+
+  encoded_.resize(block.nb_bytes);
+  decoded_.resize(block.nb_records);
+  decoded_read_ = 0;
+  if ((block.nb_bytes > 0) && !readAll(fd_, &encoded_[0], block.nb_bytes))
+    return false;
+
+  if (header_.encoding == encoding_columnar)
+  {
+    if (block.nb_bytes < sizeof(RecordingChunk) - sizeof(RecordingBlock) + block.nb_records * sizeof(RecordingSample))
+    {
+      std::cerr << "[RecordingReader::readBlock] corrupted chunk" << std::endl;
+      decoded_.clear();
+      return false;
+    }
+    readChunkColumns(&encoded_[0] + sizeof(RecordingChunk) - sizeof(RecordingBlock), decoded_);
+    return true;
+  }
+
+  decoder_.reset();
+  const unsigned char * input = encoded_.empty() ? NULL : &encoded_[0];
+  const unsigned char * end = input + block.nb_bytes;
+  for (size_t i = 0; i < decoded_.size(); ++i)
+  {
+    if ((input = decoder_.decode(input, end, decoded_[i])) == NULL)
+    {
+      std::cerr << "[RecordingReader::readBlock] corrupted block" << std::endl;
+      decoded_.resize(i);
+      return i > 0;
+    }
+  }
+  return true;
+}
+
+size_t RecordingReader::read(RecordingSample * records, size_t max_records)
+{
+  if (fd_ < 0)
+    return 0;
+
+  if (header_.encoding != encoding_records)
+  {
+    size_t nb_records = 0;
+    while ((nb_records < max_records) && (nb_read_ < nb_records_))
+    {
+      if ((decoded_read_ == decoded_.size()) && !readBlock())
+        break;
+      size_t nb_copied = (size_t) std::min((unsigned long long) std::min(max_records - nb_records,
+                                                                         decoded_.size() - decoded_read_),
+                                           nb_records_ - nb_read_);
+      std::copy(decoded_.begin() + decoded_read_, decoded_.begin() + decoded_read_ + nb_copied, records + nb_records);
+      decoded_read_ += nb_copied;
+      nb_records += nb_copied;
+      nb_read_ += nb_copied;
+    }
+    return nb_records;
+  }
+
+  size_t nb_records = (size_t) std::min((unsigned long long) max_records, nb_records_ - nb_read_);
+  if ((nb_records == 0) || !readAll(fd_, records, nb_records * sizeof(RecordingSample)))
+    return 0;
+  nb_read_ += nb_records;
+  return nb_records;
+}
@@ -0,0 +1,389 @@
+/**
+ * @file   optoforce_recording_map.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Memory-mapped access to a binary recording, with a sparse time index
+ *        to get the samples of a time window without scanning the file,
+ *        and the statistics of the column chunks to skip the ones out of a query.
+ */
+
+#include "optoforce/optoforce_recording_map.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// records per index entry for an uncompressed recording (compressed ones are indexed per block)
+static const unsigned long long INDEX_STRIDE = 4096;
+
+// order of the records by time
+static bool isRecordBefore(const RecordingSample & record, int64_t time_ns)
+{
+  return record.time_ns < time_ns;
+}
+
+RecordingMap::RecordingMap()
+  : data_(NULL),
+    size_(0),
+    records_(NULL),
+    nb_records_(0),
+    decoded_block_(0)
+{
+  initRecordingHeader(header_);
+}
+
+RecordingMap::~RecordingMap()
+{
+  close();
+}
+
+bool RecordingMap::open(const std::string & filename)
+{
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "[RecordingMap::open] could not open " << filename << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat file_stat;
+  bool is_ok = (fstat(fd, &file_stat) == 0) && (file_stat.st_size >= (off_t) sizeof(RecordingHeader));
+  if (is_ok)
+  {
+    size_ = file_stat.st_size;
+    void * data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      std::cerr << "[RecordingMap::open] could not map " << filename << ": " << std::strerror(errno) << std::endl;
+      is_ok = false;
+    }
+    else
+      data_ = static_cast<const unsigned char *>(data);
+  }
+  // the mapping stays valid once the descriptor is closed
+  ::close(fd);
+
+  if (is_ok)
+  {
+    std::memcpy(&header_, data_, sizeof(header_));
+    is_ok = (std::memcmp(header_.magic, RECORDING_MAGIC, sizeof(header_.magic)) == 0);
+  }
+  if (!is_ok)
+    std::cerr << "[RecordingMap::open] " << filename << " is not an optoforce recording" << std::endl;
+  // records are accessed in place: they have to be aligned in the mapping
+  else if ((header_.version != RECORDING_VERSION) || (header_.record_size != sizeof(RecordingSample)) ||
+           (header_.header_size < sizeof(RecordingHeader)) || (header_.header_size > size_) ||
+           (header_.header_size % sizeof(int64_t) != 0) || (header_.encoding > encoding_columnar))
+  {
+    std::cerr << "[RecordingMap::open] unsupported recording version " << header_.version << std::endl;
+    is_ok = false;
+  }
+  if (!is_ok)
+  {
+    close();
+    return false;
+  }
+  header_.serial_number[sizeof(header_.serial_number) - 1] = '\0';
+
+  if (header_.encoding == encoding_records)
+  {
+    // an interrupted recording has no count: the complete records are kept
+    unsigned long long nb_stored = (size_ - header_.header_size) / header_.record_size;
+    nb_records_ = (header_.nb_records > 0) ? std::min((unsigned long long) header_.nb_records, nb_stored) : nb_stored;
+    records_ = reinterpret_cast<const RecordingSample *>(data_ + header_.header_size);
+
+    index_.reserve(nb_records_ / INDEX_STRIDE + 1);
+    for (unsigned long long i = 0; i < nb_records_; i += INDEX_STRIDE)
+    {
+      IndexEntry entry;
+      entry.time_ns = records_[i].time_ns;
+      entry.record = i;
+      entry.offset = header_.header_size + i * sizeof(RecordingSample);
+      index_.push_back(entry);
+    }
+    decoded_block_ = index_.size();
+    return true;
+  }
+
+  // the blocks are coded on their own: only the first sample of each one is decoded,
+  // the chunks giving it in their header
+  decoder_.setCalibration(header_.nb_axes, header_.calibration);
+  unsigned long long nb_records = 0;
+  size_t position = header_.header_size;
+  while (size_ - position >= sizeof(RecordingBlock))
+  {
+    RecordingBlock block;
+    std::memcpy(&block, data_ + position, sizeof(block));
+    if (size_ - position - sizeof(block) < block.nb_bytes)
+      break;
+
+    IndexEntry entry;
+    RecordingSample first;
+    const unsigned char * input = data_ + position + sizeof(block);
+    bool is_valid = (block.nb_records > 0);
+    if (header_.encoding == encoding_columnar)
+    {
+      // the chunks are not to be shorter than their columns
+      if (block.nb_bytes < sizeof(RecordingChunk) - sizeof(RecordingBlock) + block.nb_records * sizeof(RecordingSample))
+        break;
+      first.time_ns = reinterpret_cast<const RecordingChunk *>(data_ + position)->first_time_ns;
+    }
+    else if (is_valid)
+    {
+      decoder_.reset();
+      is_valid = (decoder_.decode(input, input + block.nb_bytes, first) != NULL);
+    }
+    if (is_valid)
+    {
+      entry.time_ns = first.time_ns;
+      entry.record = nb_records;
+      entry.offset = position;
+      index_.push_back(entry);
+      nb_records += block.nb_records;
+    }
+    position += sizeof(block) + block.nb_bytes;
+  }
+  nb_records_ = (header_.nb_records > 0) ? std::min((unsigned long long) header_.nb_records, nb_records) : nb_records;
+  decoded_block_ = index_.size();
+  return true;
+}
+
+void RecordingMap::close()
+{
+  if (data_ != NULL)
+    munmap(const_cast<unsigned char *>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+  records_ = NULL;
+  nb_records_ = 0;
+  index_.clear();
+  decoded_.clear();
+  decoded_block_ = 0;
+}
+
+size_t RecordingMap::findBlock(int64_t time_ns) const
+{
+  // last block starting at or before the time: the first record after it is there, or starts the next block
+  size_t lower = 0;
+  size_t upper = index_.size();
+  while (lower < upper)
+  {
+    size_t middle = lower + (upper - lower) / 2;
+    if (index_[middle].time_ns <= time_ns)
+      lower = middle + 1;
+    else
+      upper = middle;
+  }
+  return (lower > 0) ? lower - 1 : 0;
+}
+
+const RecordingSample * RecordingMap::decodeBlock(size_t block)
+{
+  if (block == decoded_block_)
+    return decoded_.empty() ? NULL : &decoded_[0];
+
+  const IndexEntry & entry = index_[block];
+  RecordingBlock header;
+  std::memcpy(&header, data_ + entry.offset, sizeof(header));
+  const unsigned char * input = data_ + entry.offset + sizeof(header);
+  const unsigned char * end = input + header.nb_bytes;
+
+  decoded_.resize(header.nb_records);
+  decoded_block_ = block;
+  decoder_.reset();
+  for (size_t i = 0; i < decoded_.size(); ++i)
+  {
+    if ((input = decoder_.decode(input, end, decoded_[i])) == NULL)
+    {
+      std::cerr << "[RecordingMap::decodeBlock] corrupted block" << std::endl;
+      decoded_.resize(i);
+      break;
+    }
+  }
+  return decoded_.empty() ? NULL : &decoded_[0];
+}
+
+unsigned long long RecordingMap::findRecord(size_t block, int64_t time_ns)
+{
+  unsigned long long first = index_[block].record;
+  unsigned long long last = (block + 1 < index_.size()) ? index_[block + 1].record : nb_records_;
+  last = std::min(last, nb_records_);
+  if (first >= last)
+    return last;
+
+  if (records_ != NULL)
+    return std::lower_bound(records_ + first, records_ + last, time_ns, isRecordBefore) - records_;
+
+  // the time column of a chunk is searched in place
+  const int64_t * times = getChunkTimes(block);
+  if (times != NULL)
+    return first + (std::lower_bound(times, times + (last - first), time_ns) - times);
+
+  const RecordingSample * records = decodeBlock(block);
+  size_t nb_decoded = std::min((unsigned long long) decoded_.size(), last - first);
+  if (records == NULL)
+    return last;
+  size_t position = std::lower_bound(records, records + nb_decoded, time_ns, isRecordBefore) - records;
+  // past the records of the block: the next one starts there
+  return (position < nb_decoded) ? first + position : last;
+}
+
+void RecordingMap::findWindow(int64_t start_ns, int64_t end_ns,
+                              unsigned long long & first, unsigned long long & last)
+{
+  first = last = 0;
+  if (index_.empty() || (end_ns <= start_ns))
+    return;
+
+  first = findRecord(findBlock(start_ns), start_ns);
+  last = std::max(first, findRecord(findBlock(end_ns), end_ns));
+}
+
+size_t RecordingMap::readWindow(int64_t start_ns, int64_t end_ns, std::vector<RecordingSample> & records)
+{
+  unsigned long long first, last;
+  findWindow(start_ns, end_ns, first, last);
+  records.clear();
+  if (first == last)
+    return 0;
+
+  if (records_ != NULL)
+  {
+    records.assign(records_ + first, records_ + last);
+    return records.size();
+  }
+
+  records.reserve(last - first);
+  // block of the first record: the last one starting at or before it
+  size_t lower = 0;
+  size_t upper = index_.size();
+  while (lower < upper)
+  {
+    size_t middle = lower + (upper - lower) / 2;
+    if (index_[middle].record <= first)
+      lower = middle + 1;
+    else
+      upper = middle;
+  }
+  size_t block = lower - 1;
+
+  for (unsigned long long position = first; (position < last) && (block < index_.size()); ++block)
+  {
+    // only the rows of the window are gathered from the columns of a chunk
+    const RecordingChunk * chunk = getChunk(block);
+    if (chunk != NULL)
+    {
+      unsigned long long block_first = index_[block].record;
+      unsigned long long block_last = std::min(block_first + chunk->block.nb_records, last);
+      const int64_t * times = getChunkTimes(block);
+      for (; position < block_last; ++position)
+      {
+        RecordingSample record;
+        record.time_ns = times[position - block_first];
+        for (size_t k = 0; k < 6; ++k)
+          record.wrench[k] = getChunkColumn(block, k)[position - block_first];
+        records.push_back(record);
+      }
+      continue;
+    }
+
+    const RecordingSample * decoded = decodeBlock(block);
+    unsigned long long block_first = index_[block].record;
+    // records lost in a corrupted block are skipped
+    position = std::max(position, block_first);
+    unsigned long long block_last = std::min(block_first + decoded_.size(), last);
+    if ((decoded == NULL) || (block_last <= position))
+      continue;
+    records.insert(records.end(), decoded + (position - block_first), decoded + (block_last - block_first));
+    position = block_last;
+  }
+  return records.size();
+}
+
+size_t RecordingMap::getNumberChunks() const
+{
+  return (header_.encoding == encoding_columnar) ? index_.size() : 0;
+}
+
+const RecordingChunk * RecordingMap::getChunk(size_t chunk) const
+{
+  if (chunk >= getNumberChunks())
+    return NULL;
+  return reinterpret_cast<const RecordingChunk *>(data_ + index_[chunk].offset);
+}
+
+const int64_t * RecordingMap::getChunkTimes(size_t chunk) const
+{
+  if (chunk >= getNumberChunks())
+    return NULL;
+  return reinterpret_cast<const int64_t *>(data_ + index_[chunk].offset + sizeof(RecordingChunk));
+}
+
+const float * RecordingMap::getChunkColumn(size_t chunk, size_t axis) const
+{
+  const RecordingChunk * header = getChunk(chunk);
+  if ((header == NULL) || (axis >= 6))
+    return NULL;
+  const unsigned char * columns = data_ + index_[chunk].offset + sizeof(RecordingChunk);
+  return reinterpret_cast<const float *>(columns + header->block.nb_records * (sizeof(int64_t) + axis * sizeof(float)));
+}
+
+size_t RecordingMap::findAbove(size_t axis, float threshold, std::vector<RecordingSample> & records)
+{
+  records.clear();
+  if (axis >= 6)
+    return 0;
+
+  size_t nb_read = 0;
+  for (size_t block = 0; block < index_.size(); ++block)
+  {
+    unsigned long long first = index_[block].record;
+    if (first >= nb_records_)
+      break;
+    unsigned long long last = (block + 1 < index_.size()) ? index_[block + 1].record : nb_records_;
+    last = std::min(last, nb_records_);
+
+    const RecordingChunk * chunk = getChunk(block);
+    if (chunk != NULL)
+    {
+      // only the column of the axis is read, in the chunks where the threshold is exceeded
+      if ((chunk->max[axis] <= threshold) && (chunk->min[axis] >= -threshold))
+        continue;
+      ++nb_read;
+      const float * column = getChunkColumn(block, axis);
+      for (size_t i = 0; i < last - first; ++i)
+      {
+        if (std::fabs(column[i]) <= threshold)
+          continue;
+        RecordingSample record;
+        record.time_ns = getChunkTimes(block)[i];
+        for (size_t k = 0; k < 6; ++k)
+          record.wrench[k] = getChunkColumn(block, k)[i];
+        records.push_back(record);
+      }
+      continue;
+    }
+
+    // the other layouts have no statistics: all the samples are read
+    ++nb_read;
+    const RecordingSample * block_records = (records_ != NULL) ? records_ + first : decodeBlock(block);
+    size_t nb_block = (records_ != NULL) ? last - first : std::min((size_t) (last - first), decoded_.size());
+    for (size_t i = 0; (block_records != NULL) && (i < nb_block); ++i)
+    {
+      if (std::fabs(block_records[i].wrench[axis]) > threshold)
+        records.push_back(block_records[i]);
+    }
+  }
+  return nb_read;
+}
@@ -0,0 +1,506 @@
+/**
+ * @file   optoforce_replay_backend.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Replay of binary recordings as Optoforce daq, to run the drivers on real force data
+ *        without any sensor. Each sample is delivered at its recorded instant,
+ *        possibly accelerated, or as fast as the daq is read.
+ */
+
+#include "optoforce/optoforce_replay_backend.hpp"
+#include "optoforce/optoforce_simulated_backend.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+// records read from the file at once
+static const size_t READ_AHEAD = 4096;
+
+ReplayDeviceConfig::ReplayDeviceConfig() : time_scale(1.0),
+                                           burst_size(1),
+                                           buffer_size(4096),
+                                           is_loop(false),
+                                           read_delay(0.0)
+{
+}
+
+// sensor speed closest to a sample frequency
+static sensor_speed getSpeed(double frequency)
+{
+  if (frequency > 600.0)
+    return speed_1000hz;
+  if (frequency > 200.0)
+    return speed_333hz;
+  if (frequency > 60.0)
+    return speed_100hz;
+  return speed_30hz;
+}
+
+/*!
+  \class ReplayDevice
+  \brief state of a replayed daq, shared between the backend and the daq handler
+ */
+class ReplayDevice
+{
+public:
+  ReplayDevice(const ReplayDeviceConfig & config, const RecordingHeader & header, const OPort & port);
+
+  const ReplayDeviceConfig & getConfig() const { return config_; }
+  const RecordingHeader & getHeader() const { return header_; }
+  const OPort & getPort() const { return port_; }
+  int getNumberAxes() const { return header_.is_3D_sensor ? 3 : 6; }
+
+  //! open the device, replaying from the beginning, false if already opened
+  bool open();
+  void close();
+  bool isOpen() const;
+  /*!
+    \brief read the samples delivered since the previous read
+    \param counts receives the counts
+    \return number of samples, -1 if the buffer is full, -2 if closed
+   */
+  int read(std::vector<int> & counts);
+  SensorConfig getSensorConfig() const;
+  bool setSensorConfig(const SensorConfig & sensor_config);
+  //! set the zero on the last sample delivered
+  void zero();
+  ReplayDeviceStats getStats() const;
+
+private:
+  /*!
+    \brief read the recording ahead, starting over at its end if looping
+    \param nb_needed number of records wanted after records_read_
+   */
+  void fill(size_t nb_needed);
+
+  //! replay parameters
+  ReplayDeviceConfig config_;
+  //! header of the recording
+  RecordingHeader header_;
+  //! port seen by the enumerator
+  OPort port_;
+  //! current configuration
+  SensorConfig sensor_config_;
+  //! whether a daq handler has opened it
+  bool is_open_;
+  //! recording read
+  RecordingReader reader_;
+  //! records read ahead, their time being the replay one (from the replay start)
+  std::vector<RecordingSample> records_;
+  //! number of records in records_
+  size_t records_fill_;
+  //! number of records of records_ delivered
+  size_t records_read_;
+  //! number of records read from the file since its last opening
+  unsigned long long nb_loaded_;
+  //! time of the first record of the file, in ns
+  int64_t first_time_ns_;
+  //! replay time of the first record of the current pass, in ns
+  int64_t loop_offset_ns_;
+  //! replay time of the last record read ahead, in ns
+  int64_t last_time_ns_;
+  //! nominal sample period, separating the last sample of a pass and the first one of the next pass
+  int64_t period_ns_;
+  //! whether the first read was done, starting the replay
+  bool is_started_;
+  //! instant of the replay start
+  boost::chrono::steady_clock::time_point start_time_;
+  //! raw counts of the last sample delivered
+  std::vector<int> last_counts_;
+  //! zero offset of each axis
+  std::vector<int> offsets_;
+  //! counters since opening
+  ReplayDeviceStats stats_;
+  //! devices may be handled and inspected by different threads
+  mutable boost::mutex mutex_;
+};
+
+ReplayDevice::ReplayDevice(const ReplayDeviceConfig & config, const RecordingHeader & header, const OPort & port)
+  : config_(config), header_(header), port_(port), is_open_(false),
+    records_fill_(0), records_read_(0), nb_loaded_(0),
+    first_time_ns_(0), loop_offset_ns_(0), last_time_ns_(0), is_started_(false)
+{
+  config_.burst_size = std::max(1, config_.burst_size);
+  config_.buffer_size = std::max(1, config_.buffer_size);
+  if (config_.time_scale < 0.0)
+    config_.time_scale = 0.0;
+  records_.resize(std::max(READ_AHEAD, (size_t) config_.burst_size * 2));
+  period_ns_ = (header_.sample_frequency > 0.0) ? (int64_t) (1e9 / header_.sample_frequency) : 1000000;
+
+  sensor_config_.mode = mode_comp;
+  sensor_config_.filter = no_filter;
+  sensor_config_.speed = getSpeed(header_.sample_frequency);
+  sensor_config_.state = sensor_ok;
+  last_counts_.assign(getNumberAxes(), 0);
+  offsets_.assign(getNumberAxes(), 0);
+  std::memset(&stats_, 0, sizeof(stats_));
+}
+
+bool ReplayDevice::open()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (is_open_ || !reader_.open(config_.filename))
+    return false;
+
+  is_open_ = true;
+  records_fill_ = 0;
+  records_read_ = 0;
+  nb_loaded_ = 0;
+  loop_offset_ns_ = 0;
+  last_time_ns_ = 0;
+  std::memset(&stats_, 0, sizeof(stats_));
+  fill(1);
+  is_started_ = false;
+  return true;
+}
+
+void ReplayDevice::close()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  is_open_ = false;
+  reader_.close();
+}
+
+bool ReplayDevice::isOpen() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return is_open_;
+}
+
+void ReplayDevice::fill(size_t nb_needed)
+{
+  while ((records_fill_ - records_read_ < nb_needed) && !stats_.is_finished)
+  {
+    if (records_read_ > 0)
+    {
+      std::copy(records_.begin() + records_read_, records_.begin() + records_fill_, records_.begin());
+      records_fill_ -= records_read_;
+      records_read_ = 0;
+    }
+
+    size_t nb_records = reader_.read(&records_[records_fill_], records_.size() - records_fill_);
+    if (nb_records == 0)
+    {
+      // an empty recording is not looped over
+      if (!config_.is_loop || (nb_loaded_ == 0) || !reader_.open(config_.filename))
+      {
+        stats_.is_finished = true;
+        break;
+      }
+      loop_offset_ns_ = last_time_ns_ + period_ns_;
+      nb_loaded_ = 0;
+      ++stats_.nb_loops;
+      continue;
+    }
+
+    // the first record of the file sets the time origin of all the passes
+    if ((nb_loaded_ == 0) && (stats_.nb_loops == 0))
+      first_time_ns_ = records_[records_fill_].time_ns;
+    for (size_t i = records_fill_; i < records_fill_ + nb_records; ++i)
+      records_[i].time_ns = records_[i].time_ns - first_time_ns_ + loop_offset_ns_;
+    records_fill_ += nb_records;
+    nb_loaded_ += nb_records;
+    last_time_ns_ = records_[records_fill_ - 1].time_ns;
+  }
+}
+
+/*
+ * A burst is delivered once the recorded instant of its last sample is reached.
+ * When replaying as fast as read, each read delivers up to a buffer of samples.
+ * The replay starts with the first read, delivering at most a burst: the samples
+ * dropped by the drivers to flush the daq buffer are not taken from the recording.
+ */
+int ReplayDevice::read(std::vector<int> & counts)
+{
+  // transfer time, during which the other devices can be read
+  if (config_.read_delay > 0.0)
+    boost::this_thread::sleep_for(boost::chrono::nanoseconds((long long) (config_.read_delay * 1e9)));
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!is_open_)
+    return -2;
+  ++stats_.nb_reads;
+
+  size_t burst = config_.burst_size;
+  size_t buffer_size = config_.buffer_size;
+  bool is_real_time = (config_.time_scale > 0.0);
+  int64_t elapsed_ns = std::numeric_limits<int64_t>::max();
+  size_t max_delivered = is_real_time ? std::numeric_limits<size_t>::max() : buffer_size;
+  if (!is_started_)
+  {
+    is_started_ = true;
+    start_time_ = boost::chrono::steady_clock::now();
+    max_delivered = burst;
+  }
+  if (is_real_time)
+    elapsed_ns = (int64_t) (boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start_time_).count()
+                            * config_.time_scale * 1e9);
+
+  int nb_axes = getNumberAxes();
+  size_t nb_delivered = 0;
+  counts.clear();
+  while (true)
+  {
+    fill(burst);
+    // the end of the recording may leave a shorter burst
+    size_t nb_burst = std::min(burst, records_fill_ - records_read_);
+    if ((nb_burst == 0) || (records_[records_read_ + nb_burst - 1].time_ns > elapsed_ns))
+      break;
+    if ((nb_delivered > 0) && (nb_delivered + nb_burst > max_delivered))
+      break;
+
+    // beyond the buffer, the samples are lost: they are not converted
+    for (size_t i = 0; i < nb_burst; ++i, ++nb_delivered)
+    {
+      if (nb_delivered >= buffer_size)
+        continue;
+      const RecordingSample & record = records_[records_read_ + i];
+      for (int axis = 0; axis < nb_axes; ++axis)
+      {
+        last_counts_[axis] = (int) std::floor(record.wrench[axis] * (double) header_.calibration[axis] + 0.5);
+        counts.push_back(last_counts_[axis] - offsets_[axis]);
+      }
+    }
+    records_read_ += nb_burst;
+  }
+
+  if (nb_delivered > buffer_size)
+  {
+    // as the Optoforce library, the content is lost and the error reported
+    stats_.nb_lost += nb_delivered;
+    counts.clear();
+    return -1;
+  }
+  stats_.nb_read += nb_delivered;
+  return nb_delivered;
+}
+
+SensorConfig ReplayDevice::getSensorConfig() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return sensor_config_;
+}
+
+bool ReplayDevice::setSensorConfig(const SensorConfig & sensor_config)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!is_open_)
+    return false;
+  // accepted, the samples keeping their recorded instants
+  sensor_config_ = sensor_config;
+  return true;
+}
+
+void ReplayDevice::zero()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  offsets_ = last_counts_;
+}
+
+ReplayDeviceStats ReplayDevice::getStats() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return stats_;
+}
+
+ReplayDaq::ReplayDaq(const std::vector< boost::shared_ptr<ReplayDevice> > & devices)
+  : devices_(devices), nb_allocations_(0), nb_bytes_(0)
+{
+}
+
+ReplayDaq::~ReplayDaq()
+{
+  close();
+}
+
+bool ReplayDaq::open(const OPort & port)
+{
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (std::strncmp(devices_[i]->getPort().name, port.name, sizeof(port.name)) == 0)
+    {
+      if (!devices_[i]->open())
+        return false;
+      device_ = devices_[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void ReplayDaq::close()
+{
+  if (device_)
+    device_->close();
+  device_.reset();
+}
+
+bool ReplayDaq::isOpen()
+{
+  return device_ && device_->isOpen();
+}
+
+opto_version ReplayDaq::getVersion()
+{
+  if (!device_)
+    return undefined_version;
+  return device_->getHeader().is_3D_sensor ? _66 : _95;
+}
+
+int ReplayDaq::getSensorSize()
+{
+  return device_ ? 1 : 0;
+}
+
+SensorConfig ReplayDaq::getConfig()
+{
+  if (!device_)
+    return SensorConfig();
+  return device_->getSensorConfig();
+}
+
+bool ReplayDaq::sendConfig(const SensorConfig & config)
+{
+  if (!device_)
+    return false;
+  return device_->setSensorConfig(config);
+}
+
+bool ReplayDaq::zero(int number)
+{
+  if (!device_ || (number != 0))
+    return false;
+  device_->zero();
+  return true;
+}
+
+void ReplayDaq::zeroAll()
+{
+  if (device_)
+    device_->zero();
+}
+
+int ReplayDaq::readAll(RawCounts & counts)
+{
+  if (!device_)
+    return -2;
+
+  size_t capacity = counts_.capacity();
+  int iSize = device_->read(counts_);
+  if (counts_.capacity() != capacity)
+  {
+    ++nb_allocations_;
+    nb_bytes_ += counts_.capacity() * sizeof(int);
+  }
+
+  if (iSize > 0)
+  {
+    counts.data = &counts_[0];
+    counts.sample_stride = device_->getNumberAxes();
+    counts.channel_stride = iSize * counts.sample_stride;
+  }
+  return iSize;
+}
+
+void ReplayDaq::getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const
+{
+  nb_allocations = nb_allocations_;
+  nb_bytes = nb_bytes_;
+}
+
+ReplayBackend::ReplayBackend()
+{
+}
+
+ReplayBackend::~ReplayBackend()
+{
+}
+
+bool ReplayBackend::addDevice(const ReplayDeviceConfig & config)
+{
+  RecordingReader reader;
+  if (!reader.open(config.filename))
+  {
+    std::cerr << "[ReplayBackend::addDevice] could not replay " << config.filename << std::endl;
+    return false;
+  }
+  RecordingHeader header = reader.getHeader();
+  reader.close();
+
+  // a recording replayed several times gets a serial number per daq
+  int index = devices_.size();
+  std::string serial_number = config.serial_number.empty() ? std::string(header.serial_number) : config.serial_number;
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (serial_number == devices_[i]->getPort().serialNumber)
+    {
+      char text[16];
+      std::snprintf(text, sizeof(text), "_%d", index);
+      serial_number += text;
+      break;
+    }
+  }
+
+  OPort port;
+  std::snprintf(port.name, sizeof(port.name), "replay%d", index);
+  std::snprintf(port.deviceName, sizeof(port.deviceName), "replayed %s",
+                header.is_3D_sensor ? "3D" : "6D");
+  std::snprintf(port.serialNumber, sizeof(port.serialNumber), "%s", serial_number.c_str());
+
+  devices_.push_back(boost::shared_ptr<ReplayDevice>(new ReplayDevice(config, header, port)));
+  return true;
+}
+
+int ReplayBackend::getNumberDevices() const
+{
+  return devices_.size();
+}
+
+bool ReplayBackend::getRecordingHeader(const std::string & serial_number, RecordingHeader & header) const
+{
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (serial_number == devices_[i]->getPort().serialNumber)
+    {
+      header = devices_[i]->getHeader();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReplayBackend::getDeviceStats(const std::string & serial_number, ReplayDeviceStats & stats) const
+{
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (serial_number == devices_[i]->getPort().serialNumber)
+    {
+      stats = devices_[i]->getStats();
+      return true;
+    }
+  }
+  return false;
+}
+
+OptoForcePortEnumerator * ReplayBackend::createPortEnumerator()
+{
+  std::vector<OPort> ports;
+  for (size_t i = 0; i < devices_.size(); ++i)
+    ports.push_back(devices_[i]->getPort());
+  return new SimulatedPortEnumerator(ports);
+}
+
+OptoForceDaq * ReplayBackend::createDaq()
+{
+  return new ReplayDaq(devices_);
+}
@@ -0,0 +1,174 @@
+/**
+ * @file   optoforce_scheduler.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Periodic wakeups on absolute deadlines, so that the period does not drift
+ *        with the loop runtime, with statistics on the wakeup lateness.
+ *        A wait can be interrupted from another thread, to handle a request at once.
+ */
+
+#include "optoforce/optoforce_scheduler.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static const long long NS_PER_S = 1000000000LL;
+
+// current instant of the monotonic clock, in ns
+static long long getMonotonicTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * NS_PER_S + now.tv_nsec;
+}
+
+SchedulerStats::SchedulerStats() : nb_wakeups(0),
+                                   nb_missed(0),
+                                   mean_lateness(0),
+                                   max_lateness(0)
+{
+}
+
+void SchedulerStats::merge(const SchedulerStats & other)
+{
+  unsigned long nb_total = nb_wakeups + other.nb_wakeups;
+  if (nb_total > 0)
+  {
+    mean_lateness = boost::chrono::nanoseconds((mean_lateness.count() * (long long) nb_wakeups +
+                                                other.mean_lateness.count() * (long long) other.nb_wakeups)
+                                               / (long long) nb_total);
+  }
+  nb_wakeups = nb_total;
+  nb_missed += other.nb_missed;
+  max_lateness = std::max(max_lateness, other.max_lateness);
+}
+
+DeadlineScheduler::DeadlineScheduler(double frequency)
+  : period_ns_((long long) (NS_PER_S / std::max(frequency, 1e-3))),
+    deadline_ns_(0),
+    lateness_sum_ns_(0),
+    timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    interrupt_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+  period_ns_ = std::max(period_ns_, 1LL);
+  if ((timer_fd_ < 0) || (interrupt_fd_ < 0))
+    std::cerr << "[DeadlineScheduler::DeadlineScheduler] no timerfd or eventfd: the waits can not be interrupted" << std::endl;
+}
+
+DeadlineScheduler::~DeadlineScheduler()
+{
+  if (timer_fd_ >= 0)
+    close(timer_fd_);
+  if (interrupt_fd_ >= 0)
+    close(interrupt_fd_);
+}
+
+void DeadlineScheduler::start()
+{
+  // an interruption sent after the previous loop stopped waiting is not for this one
+  uint64_t nb_interrupts;
+  if ((interrupt_fd_ >= 0) && (read(interrupt_fd_, &nb_interrupts, sizeof(nb_interrupts)) < 0) && (errno != EAGAIN))
+    std::cerr << "[DeadlineScheduler::start] could not clear the interruptions" << std::endl;
+  deadline_ns_ = getMonotonicTime() + period_ns_;
+}
+
+bool DeadlineScheduler::wait()
+{
+  long long now = getMonotonicTime();
+  unsigned long nb_missed = 0;
+
+  // the loop overran: the deadlines passed are dropped
+  if (now > deadline_ns_)
+  {
+    long long nb_periods = (now - deadline_ns_) / period_ns_ + 1;
+    nb_missed = nb_periods;
+    deadline_ns_ += nb_periods * period_ns_;
+  }
+
+  struct timespec deadline;
+  deadline.tv_sec = deadline_ns_ / NS_PER_S;
+  deadline.tv_nsec = deadline_ns_ % NS_PER_S;
+
+  // the timer expires on the absolute deadline, unless the interruption comes first
+  struct itimerspec timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_nsec = 0;
+  timer.it_value = deadline;
+  bool is_timer_set = (timer_fd_ >= 0) && (interrupt_fd_ >= 0) &&
+                      (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &timer, NULL) == 0);
+
+  struct pollfd fds[2];
+  fds[0].fd = timer_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = interrupt_fd_;
+  fds[1].events = POLLIN;
+  uint64_t nb_events;
+  while (is_timer_set)
+  {
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    int nb_ready = poll(fds, 2, -1);
+    if ((nb_ready < 0) && (errno != EINTR))
+      is_timer_set = false;
+    if (nb_ready <= 0)
+      continue;
+    if ((fds[1].revents & POLLIN) && (read(interrupt_fd_, &nb_events, sizeof(nb_events)) == sizeof(nb_events)))
+    {
+      // not a wakeup: only the deadlines skipped are counted
+      boost::mutex::scoped_lock lock(mutex_);
+      stats_.nb_missed += nb_missed;
+      return false;
+    }
+    if ((fds[0].revents & POLLIN) && (read(timer_fd_, &nb_events, sizeof(nb_events)) == sizeof(nb_events)))
+      break;
+  }
+  // without timer, the wait is not interruptible
+  if (!is_timer_set)
+  {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+      ;
+  }
+
+  long long lateness = std::max(getMonotonicTime() - deadline_ns_, 0LL);
+  deadline_ns_ += period_ns_;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  ++stats_.nb_wakeups;
+  stats_.nb_missed += nb_missed;
+  lateness_sum_ns_ += lateness;
+  stats_.max_lateness = std::max(stats_.max_lateness, boost::chrono::nanoseconds(lateness));
+  return true;
+}
+
+void DeadlineScheduler::interrupt()
+{
+  uint64_t one = 1;
+  if ((interrupt_fd_ >= 0) && (write(interrupt_fd_, &one, sizeof(one)) != sizeof(one)))
+    std::cerr << "[DeadlineScheduler::interrupt] could not signal the wait" << std::endl;
+}
+
+SchedulerStats DeadlineScheduler::getStats() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  SchedulerStats stats = stats_;
+  if (stats.nb_wakeups > 0)
+    stats.mean_lateness = boost::chrono::nanoseconds(lateness_sum_ns_ / (long long) stats.nb_wakeups);
+  return stats;
+}
+
+void DeadlineScheduler::resetStats()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  stats_ = SchedulerStats();
+  lateness_sum_ns_ = 0;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file   optoforce_shm.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Publication of the live samples of a device in POSIX shared memory.
+ *
+ */
+
+#include "optoforce/optoforce_shm.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a sample overwritten while being read is read again, at most this number of times
+static const int MAX_READ_ATTEMPTS = 16;
+
+static int64_t toNanoseconds(boost::chrono::high_resolution_clock::time_point time)
+{
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::string getShmName(const std::string & serial_number)
+{
+  return "/optoforce_" + serial_number;
+}
+
+ShmPublisher::ShmPublisher() : header_(NULL), slots_(NULL), size_(0)
+{
+}
+
+ShmPublisher::~ShmPublisher()
+{
+  close();
+}
+
+bool ShmPublisher::open(const std::string & serial_number, uint32_t nb_axes, double sample_frequency,
+                        uint32_t history_size)
+{
+  close();
+
+  // the segment of a former acquisition is replaced: its readers keep it until they detach
+  name_ = getShmName(serial_number);
+  shm_unlink(name_.c_str());
+  int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    std::cerr << "[ShmPublisher::open] could not create " << name_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  // the slot being overwritten is not read: one is left for read
+  history_size = std::max(history_size, (uint32_t) 2);
+  size_t size = sizeof(ShmHeader) + history_size * sizeof(ShmSlot);
+  void * data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    std::cerr << "[ShmPublisher::open] could not map " << name_ << ": " << std::strerror(errno) << std::endl;
+    shm_unlink(name_.c_str());
+    return false;
+  }
+
+  // the segment is zeroed by ftruncate: only the non zero fields are set
+  header_ = static_cast<ShmHeader *>(data);
+  slots_ = reinterpret_cast<ShmSlot *>(header_ + 1);
+  size_ = size;
+  header_->version = SHM_VERSION;
+  header_->history_size = history_size;
+  serial_number.copy(header_->serial_number, sizeof(header_->serial_number) - 1);
+  header_->nb_axes = (nb_axes == 3) ? 3 : 6;
+  header_->publisher_pid = getpid();
+  header_->sample_frequency = sample_frequency;
+  new (&header_->nb_published) boost::atomic<uint64_t>(0);
+  for (uint32_t i = 0; i < history_size; ++i)
+    new (&slots_[i].sequence) boost::atomic<uint64_t>(0);
+
+  // readers only accept the segment once it is complete
+  boost::atomic_thread_fence(boost::memory_order_release);
+  std::memcpy(header_->magic, SHM_MAGIC, sizeof(header_->magic));
+  return true;
+}
+
+void ShmPublisher::close()
+{
+  if (header_ == NULL)
+    return;
+  munmap(header_, size_);
+  shm_unlink(name_.c_str());
+  header_ = NULL;
+  slots_ = NULL;
+}
+
+void ShmPublisher::publish(const StampedSample * samples, size_t nb_samples)
+{
+  if ((header_ == NULL) || (nb_samples == 0))
+    return;
+
+  int64_t publish_time_ns = toNanoseconds(boost::chrono::high_resolution_clock::now());
+  uint64_t index = header_->nb_published.load(boost::memory_order_relaxed);
+  for (size_t i = 0; i < nb_samples; ++i, ++index)
+  {
+    // the slot is marked as being written, so that readers retry rather than wait
+    ShmSlot & slot = slots_[index % header_->history_size];
+    slot.sequence.store(2 * index + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+
+    slot.sample.index = index;
+    slot.sample.acq_time_ns = toNanoseconds(samples[i].acq_time);
+    slot.sample.publish_time_ns = publish_time_ns;
+    const float * wrench = &samples[i].wrench.fx;
+    std::copy(wrench, wrench + 6, slot.sample.wrench);
+
+    slot.sequence.store(2 * index + 2, boost::memory_order_release);
+  }
+  header_->nb_published.store(index, boost::memory_order_release);
+}
+
+ShmSubscriber::ShmSubscriber() : header_(NULL), slots_(NULL), size_(0)
+{
+}
+
+ShmSubscriber::~ShmSubscriber()
+{
+  detach();
+}
+
+bool ShmSubscriber::attach(const std::string & serial_number)
+{
+  detach();
+
+  std::string name = getShmName(serial_number);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    std::cerr << "[ShmSubscriber::attach] no acquisition publishing " << serial_number << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat file_stat;
+  void * data = MAP_FAILED;
+  if ((fstat(fd, &file_stat) == 0) && (file_stat.st_size >= (off_t) sizeof(ShmHeader)))
+    data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    std::cerr << "[ShmSubscriber::attach] could not map " << name << std::endl;
+    return false;
+  }
+
+  const ShmHeader * header = static_cast<const ShmHeader *>(data);
+  bool is_ok = (std::memcmp(header->magic, SHM_MAGIC, sizeof(header->magic)) == 0);
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  if (!is_ok || (header->version != SHM_VERSION) || (header->history_size == 0) ||
+      ((size_t) file_stat.st_size < sizeof(ShmHeader) + header->history_size * sizeof(ShmSlot)))
+  {
+    std::cerr << "[ShmSubscriber::attach] " << name << " is not ready, or of another version" << std::endl;
+    munmap(data, file_stat.st_size);
+    return false;
+  }
+
+  header_ = header;
+  slots_ = reinterpret_cast<const ShmSlot *>(header_ + 1);
+  size_ = file_stat.st_size;
+  return true;
+}
+
+void ShmSubscriber::detach()
+{
+  if (header_ == NULL)
+    return;
+  munmap(const_cast<ShmHeader *>(header_), size_);
+  header_ = NULL;
+  slots_ = NULL;
+}
+
+std::string ShmSubscriber::getSerialNumber() const
+{
+  if (header_ == NULL)
+    return "";
+  return std::string(header_->serial_number, strnlen(header_->serial_number, sizeof(header_->serial_number)));
+}
+
+uint64_t ShmSubscriber::getNumberPublished() const
+{
+  if (header_ == NULL)
+    return 0;
+  return header_->nb_published.load(boost::memory_order_acquire);
+}
+
+bool ShmSubscriber::readSlot(uint64_t index, ShmSample & sample) const
+{
+  const ShmSlot & slot = slots_[index % header_->history_size];
+  uint64_t sequence = slot.sequence.load(boost::memory_order_acquire);
+  if (sequence != 2 * index + 2)
+    return false;
+  std::memcpy(&sample, &slot.sample, sizeof(sample));
+  // the copy is valid if the writer did not start on the slot meanwhile
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  return slot.sequence.load(boost::memory_order_relaxed) == sequence;
+}
+
+bool ShmSubscriber::getLatest(ShmSample & sample) const
+{
+  for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt)
+  {
+    uint64_t nb_published = getNumberPublished();
+    if (nb_published == 0)
+      return false;
+    if (readSlot(nb_published - 1, sample))
+      return true;
+  }
+  return false;
+}
+
+size_t ShmSubscriber::read(uint64_t & next_index, ShmSample * samples, size_t max_samples) const
+{
+  if (header_ == NULL)
+    return 0;
+
+  // the oldest slot may be the one being overwritten
+  uint64_t nb_published = getNumberPublished();
+  uint64_t nb_kept = header_->history_size - 1;
+  if (nb_published > nb_kept)
+    next_index = std::max(next_index, nb_published - nb_kept);
+
+  size_t nb_read = 0;
+  while ((nb_read < max_samples) && (next_index < nb_published))
+  {
+    if (readSlot(next_index, samples[nb_read]))
+    {
+      ++nb_read;
+      ++next_index;
+      continue;
+    }
+    // overwritten while reading: the reader is too slow, and jumps to the samples still kept
+    nb_published = getNumberPublished();
+    if (nb_published > nb_kept)
+      next_index = std::max(next_index + 1, nb_published - nb_kept);
+  }
+  return nb_read;
+}
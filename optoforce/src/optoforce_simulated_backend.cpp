@@ -0,0 +1,528 @@
+/**
+ * @file   optoforce_simulated_backend.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief In-process simulation of Optoforce daq, to run the drivers without any sensor.
+ *        The samples are generated according to the time elapsed, with the configured rate,
+ *        delivery pattern and buffer capacity.
+ */
+
+#include "optoforce/optoforce_simulated_backend.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+// amplitude of the generated signals, in counts
+static const double SIGNAL_AMPLITUDE = 1000.0;
+// amplitude of the noise added to the signals, in counts
+static const int NOISE_AMPLITUDE = 5;
+
+SimulatedDeviceConfig::SimulatedDeviceConfig() : is_3D_sensor(false),
+                                                 nb_channels(1),
+                                                 speed(speed_1000hz),
+                                                 burst_size(1),
+                                                 jitter(0.0),
+                                                 buffer_size(4096),
+                                                 overflow(overflow_error),
+                                                 signal(signal_sine),
+                                                 seed(0),
+                                                 time_scale(1.0),
+                                                 read_delay(0.0)
+{
+}
+
+// sample rate corresponding to a sensor speed, in Hz
+static double getRate(sensor_speed speed)
+{
+  switch (speed)
+  {
+    case speed_1000hz:
+      return 1000.0;
+    case speed_333hz:
+      return 1000.0 / 3.0;
+    case speed_100hz:
+      return 100.0;
+    case speed_30hz:
+      return 30.0;
+  }
+  return 1000.0;
+}
+
+// reproducible pseudo-random value (splitmix64), so that a burst always gets the same delay
+static unsigned long long hashValue(unsigned long long x)
+{
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// reproducible pseudo-random value in [0, 1)
+static double uniformValue(unsigned int seed, unsigned long long index)
+{
+  return (hashValue(((unsigned long long) seed << 40) ^ index) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*!
+  \class SimulatedDevice
+  \brief state of a simulated daq, shared between the backend and the daq handler
+ */
+class SimulatedDevice
+{
+public:
+  SimulatedDevice(const SimulatedDeviceConfig & config, const OPort & port);
+
+  const SimulatedDeviceConfig & getConfig() const { return config_; }
+  const OPort & getPort() const { return port_; }
+  int getNumberAxes() const { return config_.is_3D_sensor ? 3 : 6; }
+
+  //! open the device, false if already opened
+  bool open();
+  void close();
+  bool isOpen() const;
+  /*!
+    \brief read the samples delivered since the previous read
+    \param counts receives the counts, channel after channel
+    \return number of samples per channel, -1 if the buffer is full, -2 if closed
+   */
+  int read(std::vector<int> & counts);
+  SensorConfig getSensorConfig() const;
+  bool setSensorConfig(const SensorConfig & sensor_config);
+  //! set the zero of a channel, all of them if negative
+  void zero(int channel);
+  SimulatedDeviceStats getStats() const;
+
+private:
+  //! update the number of samples delivered, according to the time elapsed
+  void deliver(boost::chrono::steady_clock::time_point now);
+  //! counts of a sample, without the zero offset
+  void getValue(unsigned long index, int channel, int * counts) const;
+
+  //! characteristics of the device
+  SimulatedDeviceConfig config_;
+  //! port seen by the enumerator
+  OPort port_;
+  //! current configuration
+  SensorConfig sensor_config_;
+  //! whether a daq handler has opened it
+  bool is_open_;
+  //! current sample rate, in Hz, time scale included
+  double rate_;
+  //! instant from which the samples are generated at the current rate
+  boost::chrono::steady_clock::time_point anchor_time_;
+  //! index of the first sample generated at the current rate
+  unsigned long anchor_index_;
+  //! number of samples delivered since opening
+  unsigned long delivered_;
+  //! number of samples read or lost since opening
+  unsigned long consumed_;
+  //! zero offset of each channel and axis
+  std::vector<int> offsets_;
+  //! counters since opening
+  SimulatedDeviceStats stats_;
+  //! sum of the latencies measured, in s
+  double latency_sum_;
+  //! number of latencies measured
+  unsigned long nb_latencies_;
+  //! devices may be handled and inspected by different threads
+  mutable boost::mutex mutex_;
+};
+
+SimulatedDevice::SimulatedDevice(const SimulatedDeviceConfig & config, const OPort & port)
+  : config_(config), port_(port), is_open_(false)
+{
+  if (config_.is_3D_sensor)
+    config_.nb_channels = std::max(1, config_.nb_channels);
+  else
+    config_.nb_channels = 1;
+  config_.burst_size = std::max(1, config_.burst_size);
+  config_.buffer_size = std::max(1, config_.buffer_size);
+  config_.jitter = std::max(0.0, config_.jitter);
+  if (config_.time_scale <= 0.0)
+    config_.time_scale = 1.0;
+
+  sensor_config_.mode = mode_comp;
+  sensor_config_.filter = no_filter;
+  sensor_config_.speed = config_.speed;
+  sensor_config_.state = sensor_ok;
+  offsets_.assign(config_.nb_channels * getNumberAxes(), 0);
+}
+
+bool SimulatedDevice::open()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (is_open_)
+    return false;
+
+  is_open_ = true;
+  rate_ = getRate(sensor_config_.speed) * config_.time_scale;
+  anchor_time_ = boost::chrono::steady_clock::now();
+  anchor_index_ = 0;
+  delivered_ = 0;
+  consumed_ = 0;
+  std::memset(&stats_, 0, sizeof(stats_));
+  latency_sum_ = 0.0;
+  nb_latencies_ = 0;
+  return true;
+}
+
+void SimulatedDevice::close()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  is_open_ = false;
+}
+
+bool SimulatedDevice::isOpen() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return is_open_;
+}
+
+/*
+ * A burst is delivered once its last sample is generated, plus its own random delay.
+ * Bursts are delivered in order: a late one holds the following ones.
+ */
+void SimulatedDevice::deliver(boost::chrono::steady_clock::time_point now)
+{
+  unsigned long burst = config_.burst_size;
+  double elapsed = boost::chrono::duration<double>(now - anchor_time_).count();
+
+  // bursts older than the maximum delay are surely delivered (avoids looping over long pauses)
+  double sure = elapsed - config_.jitter;
+  if (sure > 0.0)
+  {
+    unsigned long generated = anchor_index_ + (unsigned long) (sure * rate_);
+    unsigned long sure_delivered = anchor_index_ + (generated - anchor_index_) / burst * burst;
+    delivered_ = std::max(delivered_, sure_delivered);
+  }
+
+  while (true)
+  {
+    unsigned long end = delivered_ + burst;
+    double delay = config_.jitter * uniformValue(config_.seed, delivered_ / burst);
+    if ((end - anchor_index_) / rate_ + delay > elapsed)
+      break;
+    delivered_ = end;
+  }
+}
+
+void SimulatedDevice::getValue(unsigned long index, int channel, int * counts) const
+{
+  double t = index / rate_;
+  for (int axis = 0; axis < getNumberAxes(); ++axis)
+  {
+    // exact in the float forces, as long as the scale factors are 1
+    if (config_.signal == signal_counter)
+    {
+      counts[axis] = (int) (index % 65536) * 64 + channel * 8 + axis;
+      continue;
+    }
+
+    // one sine per axis, with its own frequency, shifted per channel
+    double signal = SIGNAL_AMPLITUDE * std::sin(2.0 * M_PI * 0.5 * (axis + 1) * t + channel);
+    int noise = (int) (hashValue(((unsigned long long) config_.seed << 40) ^ (index * 64 + channel * 8 + axis))
+                       % (2 * NOISE_AMPLITUDE + 1)) - NOISE_AMPLITUDE;
+    counts[axis] = (int) signal + noise;
+  }
+}
+
+int SimulatedDevice::read(std::vector<int> & counts)
+{
+  // transfer time, during which the other devices can be read
+  if (config_.read_delay > 0.0)
+    boost::this_thread::sleep_for(boost::chrono::nanoseconds((long long) (config_.read_delay * 1e9)));
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!is_open_)
+    return -2;
+
+  boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+  deliver(now);
+  ++stats_.nb_reads;
+  stats_.nb_delivered = delivered_;
+
+  unsigned long nb_pending = delivered_ - consumed_;
+  if (nb_pending > (unsigned long) config_.buffer_size)
+  {
+    if (config_.overflow == overflow_error)
+    {
+      // as the Optoforce library, the content is lost and the error reported
+      stats_.nb_lost += nb_pending;
+      consumed_ = delivered_;
+      return -1;
+    }
+    stats_.nb_lost += nb_pending - config_.buffer_size;
+    consumed_ = delivered_ - config_.buffer_size;
+    nb_pending = config_.buffer_size;
+  }
+
+  // time the oldest sample read has waited since its generation
+  if ((nb_pending > 0) && (consumed_ >= anchor_index_))
+  {
+    double generation = (consumed_ - anchor_index_ + 1) / rate_;
+    double latency = boost::chrono::duration<double>(now - anchor_time_).count() - generation;
+    latency_sum_ += latency;
+    ++nb_latencies_;
+    stats_.max_latency = std::max(stats_.max_latency, latency);
+  }
+
+  int nb_axes = getNumberAxes();
+  counts.resize(nb_pending * config_.nb_channels * nb_axes);
+  for (int channel = 0; channel < config_.nb_channels; ++channel)
+  {
+    for (unsigned long i = 0; i < nb_pending; ++i)
+    {
+      int * sample = &counts[(channel * nb_pending + i) * nb_axes];
+      getValue(consumed_ + i, channel, sample);
+      for (int axis = 0; axis < nb_axes; ++axis)
+        sample[axis] -= offsets_[channel * nb_axes + axis];
+    }
+  }
+  consumed_ = delivered_;
+  stats_.nb_read += nb_pending;
+  return nb_pending;
+}
+
+SensorConfig SimulatedDevice::getSensorConfig() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return sensor_config_;
+}
+
+bool SimulatedDevice::setSensorConfig(const SensorConfig & sensor_config)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!is_open_)
+    return false;
+
+  if (sensor_config.speed != sensor_config_.speed)
+  {
+    // samples generated so far keep their timing, next ones follow the new rate
+    boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+    deliver(now);
+    anchor_time_ = now;
+    anchor_index_ = delivered_;
+    rate_ = getRate(sensor_config.speed) * config_.time_scale;
+  }
+  sensor_config_ = sensor_config;
+  return true;
+}
+
+void SimulatedDevice::zero(int channel)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  int nb_axes = getNumberAxes();
+  unsigned long last = (delivered_ > 0) ? delivered_ - 1 : 0;
+
+  for (int c = 0; c < config_.nb_channels; ++c)
+  {
+    if ((channel < 0) || (channel == c))
+      getValue(last, c, &offsets_[c * nb_axes]);
+  }
+}
+
+SimulatedDeviceStats SimulatedDevice::getStats() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  SimulatedDeviceStats stats = stats_;
+  stats.mean_latency = nb_latencies_ ? latency_sum_ / nb_latencies_ : 0.0;
+  return stats;
+}
+
+SimulatedDaq::SimulatedDaq(const std::vector< boost::shared_ptr<SimulatedDevice> > & devices)
+  : devices_(devices), nb_allocations_(0), nb_bytes_(0)
+{
+}
+
+SimulatedDaq::~SimulatedDaq()
+{
+  close();
+}
+
+bool SimulatedDaq::open(const OPort & port)
+{
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (std::strncmp(devices_[i]->getPort().name, port.name, sizeof(port.name)) == 0)
+    {
+      if (!devices_[i]->open())
+        return false;
+      device_ = devices_[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void SimulatedDaq::close()
+{
+  if (device_)
+    device_->close();
+  device_.reset();
+}
+
+bool SimulatedDaq::isOpen()
+{
+  return device_ && device_->isOpen();
+}
+
+opto_version SimulatedDaq::getVersion()
+{
+  if (!device_)
+    return undefined_version;
+  return device_->getConfig().is_3D_sensor ? _66 : _95;
+}
+
+int SimulatedDaq::getSensorSize()
+{
+  if (!device_)
+    return 0;
+  return device_->getConfig().nb_channels;
+}
+
+SensorConfig SimulatedDaq::getConfig()
+{
+  if (!device_)
+    return SensorConfig();
+  return device_->getSensorConfig();
+}
+
+bool SimulatedDaq::sendConfig(const SensorConfig & config)
+{
+  if (!device_)
+    return false;
+  return device_->setSensorConfig(config);
+}
+
+bool SimulatedDaq::zero(int number)
+{
+  if (!device_ || (number < 0) || (number >= device_->getConfig().nb_channels))
+    return false;
+  device_->zero(number);
+  return true;
+}
+
+void SimulatedDaq::zeroAll()
+{
+  if (device_)
+    device_->zero(-1);
+}
+
+int SimulatedDaq::readAll(RawCounts & counts)
+{
+  if (!device_)
+    return -2;
+
+  size_t capacity = counts_.capacity();
+  int iSize = device_->read(counts_);
+  if (counts_.capacity() != capacity)
+  {
+    ++nb_allocations_;
+    nb_bytes_ += counts_.capacity() * sizeof(int);
+  }
+
+  if (iSize > 0)
+  {
+    counts.data = &counts_[0];
+    counts.sample_stride = device_->getNumberAxes();
+    counts.channel_stride = iSize * counts.sample_stride;
+  }
+  return iSize;
+}
+
+void SimulatedDaq::getStagingAllocations(unsigned long & nb_allocations, unsigned long & nb_bytes) const
+{
+  nb_allocations = nb_allocations_;
+  nb_bytes = nb_bytes_;
+}
+
+SimulatedPortEnumerator::SimulatedPortEnumerator(const std::vector<OPort> & ports)
+  : ports_(ports)
+{
+}
+
+int SimulatedPortEnumerator::getSize()
+{
+  return ports_.size();
+}
+
+std::vector<OPort> SimulatedPortEnumerator::listPorts()
+{
+  return ports_;
+}
+
+SimulatedBackend::SimulatedBackend()
+{
+}
+
+SimulatedBackend::SimulatedBackend(const std::vector<SimulatedDeviceConfig> & configs)
+{
+  for (size_t i = 0; i < configs.size(); ++i)
+    addDevice(configs[i]);
+}
+
+SimulatedBackend::~SimulatedBackend()
+{
+}
+
+void SimulatedBackend::addDevice(const SimulatedDeviceConfig & config)
+{
+  int index = devices_.size();
+  SimulatedDeviceConfig device_config = config;
+  char text[25];
+
+  // each device gets its own serial number and seed, if not provided
+  if (device_config.serial_number.empty())
+  {
+    std::snprintf(text, sizeof(text), "SIM%03d", index);
+    device_config.serial_number = text;
+  }
+  if (device_config.seed == 0)
+    device_config.seed = index + 1;
+
+  OPort port;
+  std::snprintf(port.name, sizeof(port.name), "sim%d", index);
+  std::snprintf(port.deviceName, sizeof(port.deviceName), "simulated %s",
+                device_config.is_3D_sensor ? "3D" : "6D");
+  std::snprintf(port.serialNumber, sizeof(port.serialNumber), "%s",
+                device_config.serial_number.c_str());
+
+  devices_.push_back(boost::shared_ptr<SimulatedDevice>(new SimulatedDevice(device_config, port)));
+}
+
+int SimulatedBackend::getNumberDevices() const
+{
+  return devices_.size();
+}
+
+bool SimulatedBackend::getDeviceStats(const std::string & serial_number, SimulatedDeviceStats & stats) const
+{
+  for (size_t i = 0; i < devices_.size(); ++i)
+  {
+    if (devices_[i]->getConfig().serial_number == serial_number)
+    {
+      stats = devices_[i]->getStats();
+      return true;
+    }
+  }
+  return false;
+}
+
+OptoForcePortEnumerator * SimulatedBackend::createPortEnumerator()
+{
+  std::vector<OPort> ports;
+  for (size_t i = 0; i < devices_.size(); ++i)
+    ports.push_back(devices_[i]->getPort());
+  return new SimulatedPortEnumerator(ports);
+}
+
+OptoForceDaq * SimulatedBackend::createDaq()
+{
+  return new SimulatedDaq(devices_);
+}
@@ -0,0 +1,594 @@
+/**
+ * @file   optoforce_stream.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Streaming of the samples read by the acquisition to the clients of a socket.
+ *
+ */
+
+#include "optoforce/optoforce_stream.hpp"
+#include "optoforce/optoforce_acquisition.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+
+// number of samples moved at once from the subscription to the clients
+static const size_t DISPATCH_SIZE = 4096;
+// longest wait of the server thread, for the stop requests
+static const int64_t SERVER_WAIT_NS = 100000000;
+// longest wait of the client for the server description
+static const int HELLO_TIMEOUT_MS = 1000;
+// longest time given to the clients, on stop, to take the frames left
+static const int64_t FLUSH_TIMEOUT_NS = 1000000000;
+
+struct StreamServer::Client
+{
+  explicit Client(int fd, size_t queue_size)
+    : fd(fd), queue(queue_size), queue_head(0), queue_count(0), nb_dropped(0), output_offset(0), is_closed(false) {}
+
+  //! connected socket
+  int fd;
+  //! samples waiting for a frame, as a circular buffer
+  std::vector<StreamSample> queue;
+  //! oldest sample of queue
+  size_t queue_head;
+  //! number of samples in queue
+  size_t queue_count;
+  //! samples dropped since the previous frame
+  unsigned long nb_dropped;
+  //! bytes being sent, the description of the devices then the frames
+  std::vector<char> output;
+  //! bytes of output already sent
+  size_t output_offset;
+  //! whether the connection is to be closed
+  bool is_closed;
+};
+
+static int64_t getTimeNs()
+{
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+    boost::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Address of an endpoint "tcp:[<host>:]<port>" or "unix:<path>".
+ * Without host, a server listens on all interfaces and a client connects to the local host.
+ */
+static bool getEndpointAddress(const std::string & endpoint, bool is_server,
+                               sockaddr_storage & address, socklen_t & address_size, std::string & unix_path)
+{
+  std::memset(&address, 0, sizeof(address));
+  if (endpoint.compare(0, 5, "unix:") == 0)
+  {
+    unix_path = endpoint.substr(5);
+    sockaddr_un * unix_address = reinterpret_cast<sockaddr_un *>(&address);
+    if (unix_path.empty() || (unix_path.size() >= sizeof(unix_address->sun_path)))
+      return false;
+    unix_address->sun_family = AF_UNIX;
+    unix_path.copy(unix_address->sun_path, unix_path.size());
+    address_size = sizeof(sockaddr_un);
+    return true;
+  }
+  if (endpoint.compare(0, 4, "tcp:") != 0)
+    return false;
+
+  std::string host_port = endpoint.substr(4);
+  size_t separator = host_port.rfind(':');
+  std::string host = (separator == std::string::npos) ? "" : host_port.substr(0, separator);
+  std::string port = (separator == std::string::npos) ? host_port : host_port.substr(separator + 1);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = is_server ? AI_PASSIVE : 0;
+  addrinfo * result = NULL;
+  if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result) != 0)
+    return false;
+  std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+  address_size = result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+static void setNonBlocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+StreamServer::StreamServer() : acquisition_(NULL),
+                               subscription_(-1),
+                               listen_fd_(-1),
+                               wakeup_fd_(-1),
+                               is_stop_request_(false)
+{
+  std::memset(&stats_, 0, sizeof(stats_));
+}
+
+StreamServer::~StreamServer()
+{
+  stop();
+}
+
+bool StreamServer::start(OptoforceAcquisition & acquisition, const std::string & endpoint,
+                         const StreamServerConfig & config)
+{
+  stop();
+
+  sockaddr_storage address;
+  socklen_t address_size;
+  std::string unix_path;
+  if (!getEndpointAddress(endpoint, true, address, address_size, unix_path))
+  {
+    std::cerr << "[StreamServer::start] invalid endpoint " << endpoint << std::endl;
+    return false;
+  }
+
+  listen_fd_ = socket(address.ss_family, SOCK_STREAM, 0);
+  int reuse = 1;
+  // only the socket of a former server is replaced, not a file given by mistake
+  struct stat unix_stat;
+  if ((address.ss_family == AF_UNIX) && (lstat(unix_path.c_str(), &unix_stat) == 0) && S_ISSOCK(unix_stat.st_mode))
+    unlink(unix_path.c_str());
+  else if (address.ss_family != AF_UNIX)
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if ((listen_fd_ < 0) || (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), address_size) != 0) ||
+      (listen(listen_fd_, 16) != 0))
+  {
+    std::cerr << "[StreamServer::start] could not listen on " << endpoint << ": " << std::strerror(errno) << std::endl;
+    if (listen_fd_ >= 0)
+      close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  setNonBlocking(listen_fd_);
+  unix_path_ = unix_path;
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK);
+
+  config_ = config;
+  config_.batch_size = std::max(config_.batch_size, (size_t) 1);
+  config_.queue_size = std::max(config_.queue_size, config_.batch_size);
+  acquisition_ = &acquisition;
+  acquisition.getSerialNumbers(serial_numbers_);
+  indexes_.assign(serial_numbers_.size(), 0);
+  input_.reset(new SpscRing<StreamSample>(std::max(config_.queue_size, DISPATCH_SIZE)));
+  received_.resize(DISPATCH_SIZE);
+  std::memset(&stats_, 0, sizeof(stats_));
+  is_stop_request_ = false;
+
+  thread_.reset(new boost::thread(boost::bind(&StreamServer::serverThread, this)));
+  subscription_ = acquisition.subscribe(boost::bind(&StreamServer::onBatch, this, _1), -1, dispatch_executor);
+  return true;
+}
+
+void StreamServer::stop()
+{
+  if (!thread_)
+    return;
+
+  // the subscription delivers its last samples before the server thread ends
+  acquisition_->unsubscribe(subscription_);
+  subscription_ = -1;
+  is_stop_request_ = true;
+  uint64_t value = 1;
+  if (write(wakeup_fd_, &value, sizeof(value)) != sizeof(value))
+    std::cerr << "[StreamServer::stop] could not wake the server thread up" << std::endl;
+  thread_->join();
+  thread_.reset();
+
+  close(listen_fd_);
+  close(wakeup_fd_);
+  listen_fd_ = wakeup_fd_ = -1;
+  if (!unix_path_.empty())
+    unlink(unix_path_.c_str());
+  unix_path_.clear();
+}
+
+StreamServerStats StreamServer::getStats()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return stats_;
+}
+
+void StreamServer::onBatch(const SampleBatch & batch)
+{
+  if (batch.device >= indexes_.size())
+    return;
+
+  // the samples that do not fit are lost for all clients, their indexes telling it
+  uint32_t & index = indexes_[batch.device];
+  index += batch.nb_missed;
+  converted_.resize(batch.nb_samples);
+  for (size_t i = 0; i < batch.nb_samples; ++i, ++index)
+  {
+    StreamSample & sample = converted_[i];
+    sample.device = batch.device;
+    sample.index = index;
+    sample.acq_time_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      batch.samples[i].acq_time.time_since_epoch()).count();
+    const float * wrench = &batch.samples[i].wrench.fx;
+    std::copy(wrench, wrench + 6, sample.wrench);
+  }
+  size_t nb_pushed = converted_.empty() ? 0 : input_->push(&converted_[0], converted_.size());
+  if (nb_pushed < converted_.size())
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stats_.nb_dropped += converted_.size() - nb_pushed;
+  }
+
+  uint64_t value = 1;
+  if (write(wakeup_fd_, &value, sizeof(value)) != sizeof(value))
+  {
+    // the counter is saturated: the server thread is already woken up
+  }
+}
+
+void StreamServer::dispatchSamples(std::vector< boost::shared_ptr<Client> > & clients)
+{
+  size_t nb_received;
+  unsigned long long nb_dropped = 0;
+  unsigned long nb_evicted = 0;
+  while ((nb_received = input_->pop(&received_[0], received_.size())) > 0)
+  {
+    for (size_t c = 0; c < clients.size(); ++c)
+    {
+      Client & client = *clients[c];
+      for (size_t i = 0; (i < nb_received) && !client.is_closed; ++i)
+      {
+        if (client.queue_count == client.queue.size())
+        {
+          if (config_.overflow == stream_disconnect)
+          {
+            client.is_closed = true;
+            ++nb_evicted;
+            break;
+          }
+          client.queue_head = (client.queue_head + 1) % client.queue.size();
+          --client.queue_count;
+          ++client.nb_dropped;
+          ++nb_dropped;
+        }
+        client.queue[(client.queue_head + client.queue_count) % client.queue.size()] = received_[i];
+        ++client.queue_count;
+      }
+    }
+  }
+
+  if (nb_dropped || nb_evicted)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stats_.nb_dropped += nb_dropped;
+    stats_.nb_evicted += nb_evicted;
+  }
+}
+
+void StreamServer::buildFrame(Client & client, int64_t now_ns, bool is_flush)
+{
+  // the previous frame is still being sent
+  if ((client.output_offset < client.output.size()) || (client.queue_count == 0))
+    return;
+  // a partial frame waits, as long as its oldest sample is within the latency budget
+  if (!is_flush && (client.queue_count < config_.batch_size) &&
+      (now_ns - client.queue[client.queue_head].acq_time_ns < config_.max_latency_ns))
+    return;
+
+  StreamFrameHeader header;
+  header.marker = STREAM_FRAME_MARKER;
+  header.nb_samples = std::min(client.queue_count, config_.batch_size);
+  header.nb_dropped = client.nb_dropped;
+  header.reserved = 0;
+  header.send_time_ns = now_ns;
+
+  client.output.resize(sizeof(header) + header.nb_samples * sizeof(StreamSample));
+  client.output_offset = 0;
+  std::memcpy(&client.output[0], &header, sizeof(header));
+  StreamSample * samples = reinterpret_cast<StreamSample *>(&client.output[sizeof(header)]);
+  for (size_t i = 0; i < header.nb_samples; ++i)
+    samples[i] = client.queue[(client.queue_head + i) % client.queue.size()];
+  client.queue_head = (client.queue_head + header.nb_samples) % client.queue.size();
+  client.queue_count -= header.nb_samples;
+  client.nb_dropped = 0;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  stats_.nb_sent += header.nb_samples;
+}
+
+void StreamServer::sendFrames(Client & client, int64_t now_ns, bool is_flush)
+{
+  while (!client.is_closed)
+  {
+    buildFrame(client, now_ns, is_flush);
+    if (client.output_offset == client.output.size())
+      break;
+    ssize_t nb_sent = send(client.fd, &client.output[client.output_offset],
+                           client.output.size() - client.output_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nb_sent < 0)
+    {
+      client.is_closed = (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR);
+      break;
+    }
+    client.output_offset += nb_sent;
+    if (client.output_offset < client.output.size())
+      break;
+  }
+}
+
+void StreamServer::flushClients(std::vector< boost::shared_ptr<Client> > & clients)
+{
+  dispatchSamples(clients);
+
+  std::vector<pollfd> fds;
+  std::vector<Client *> pending;
+  int64_t end_ns = getTimeNs() + FLUSH_TIMEOUT_NS;
+  while (true)
+  {
+    fds.clear();
+    pending.clear();
+    for (size_t c = 0; c < clients.size(); ++c)
+    {
+      Client & client = *clients[c];
+      sendFrames(client, getTimeNs(), true);
+      if (client.is_closed || ((client.output_offset == client.output.size()) && (client.queue_count == 0)))
+        continue;
+      pollfd fd;
+      fd.fd = client.fd;
+      fd.events = POLLOUT;
+      fd.revents = 0;
+      fds.push_back(fd);
+      pending.push_back(&client);
+    }
+    int64_t wait_ns = end_ns - getTimeNs();
+    if (fds.empty() || (wait_ns <= 0))
+      break;
+
+    // the clients that do not take their frames in time lose them
+    timespec timeout;
+    timeout.tv_sec = wait_ns / 1000000000;
+    timeout.tv_nsec = wait_ns % 1000000000;
+    if (ppoll(&fds[0], fds.size(), &timeout, NULL) < 0)
+      break;
+    for (size_t c = 0; c < fds.size(); ++c)
+      if (fds[c].revents & (POLLERR | POLLHUP | POLLNVAL))
+        pending[c]->is_closed = true;
+  }
+}
+
+void StreamServer::serverThread()
+{
+  std::vector< boost::shared_ptr<Client> > clients;
+  std::vector<pollfd> fds;
+
+  while (!is_stop_request_.load())
+  {
+    dispatchSamples(clients);
+
+    // frames are built and sent as far as the sockets take them, without waiting
+    int64_t now_ns = getTimeNs();
+    int64_t wait_ns = SERVER_WAIT_NS;
+    for (size_t c = 0; c < clients.size(); ++c)
+    {
+      Client & client = *clients[c];
+      sendFrames(client, now_ns, false);
+      // the server wakes up when the oldest sample queued exhausts its latency budget
+      if (!client.is_closed && (client.queue_count > 0) && (client.output_offset == client.output.size()))
+        wait_ns = std::min(wait_ns, std::max(client.queue[client.queue_head].acq_time_ns + config_.max_latency_ns - now_ns,
+                                             (int64_t) 0));
+    }
+
+    for (size_t c = 0; c < clients.size(); )
+    {
+      if (clients[c]->is_closed)
+      {
+        close(clients[c]->fd);
+        clients.erase(clients.begin() + c);
+      }
+      else
+        ++c;
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stats_.nb_clients = clients.size();
+    }
+
+    fds.resize(2 + clients.size());
+    fds[0].fd = listen_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeup_fd_;
+    fds[1].events = POLLIN;
+    for (size_t c = 0; c < clients.size(); ++c)
+    {
+      fds[2 + c].fd = clients[c]->fd;
+      fds[2 + c].events = POLLIN | ((clients[c]->output_offset < clients[c]->output.size()) ? POLLOUT : 0);
+    }
+    timespec timeout;
+    timeout.tv_sec = wait_ns / 1000000000;
+    timeout.tv_nsec = wait_ns % 1000000000;
+    if (ppoll(&fds[0], fds.size(), &timeout, NULL) <= 0)
+      continue;
+
+    if (fds[1].revents & POLLIN)
+    {
+      uint64_t value;
+      if (read(wakeup_fd_, &value, sizeof(value)) != sizeof(value))
+      {
+        // another wakeup was consumed meanwhile
+      }
+    }
+
+    // the clients only send to close the connection
+    for (size_t c = 0; c < clients.size(); ++c)
+    {
+      if (fds[2 + c].revents & (POLLERR | POLLHUP | POLLNVAL))
+        clients[c]->is_closed = true;
+      else if (fds[2 + c].revents & POLLIN)
+      {
+        char buffer[256];
+        ssize_t nb_read = recv(clients[c]->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if ((nb_read == 0) || ((nb_read < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+          clients[c]->is_closed = true;
+      }
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      int fd;
+      while ((fd = accept(listen_fd_, NULL, NULL)) >= 0)
+      {
+        setNonBlocking(fd);
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        if (config_.send_buffer_size > 0)
+          setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config_.send_buffer_size, sizeof(config_.send_buffer_size));
+
+        // the client first gets the description of the devices
+        boost::shared_ptr<Client> client(new Client(fd, config_.queue_size));
+        StreamHello hello;
+        std::memcpy(hello.magic, STREAM_MAGIC, sizeof(hello.magic));
+        hello.version = STREAM_VERSION;
+        hello.nb_devices = serial_numbers_.size();
+        client->output.assign(reinterpret_cast<char *>(&hello), reinterpret_cast<char *>(&hello) + sizeof(hello));
+        for (size_t i = 0; i < serial_numbers_.size(); ++i)
+        {
+          char serial_number[32] = {0};
+          serial_numbers_[i].copy(serial_number, sizeof(serial_number) - 1);
+          client->output.insert(client->output.end(), serial_number, serial_number + sizeof(serial_number));
+        }
+        clients.push_back(client);
+
+        boost::mutex::scoped_lock lock(mutex_);
+        ++stats_.nb_accepted;
+      }
+    }
+  }
+
+  // the subscription ended before the stop request: input_ holds the last samples
+  flushClients(clients);
+  for (size_t c = 0; c < clients.size(); ++c)
+    close(clients[c]->fd);
+  boost::mutex::scoped_lock lock(mutex_);
+  stats_.nb_clients = 0;
+}
+
+StreamClient::StreamClient() : fd_(-1)
+{
+}
+
+StreamClient::~StreamClient()
+{
+  disconnect();
+}
+
+bool StreamClient::connect(const std::string & endpoint)
+{
+  disconnect();
+
+  sockaddr_storage address;
+  socklen_t address_size;
+  std::string unix_path;
+  if (!getEndpointAddress(endpoint, false, address, address_size, unix_path))
+  {
+    std::cerr << "[StreamClient::connect] invalid endpoint " << endpoint << std::endl;
+    return false;
+  }
+
+  fd_ = socket(address.ss_family, SOCK_STREAM, 0);
+  if ((fd_ < 0) || (::connect(fd_, reinterpret_cast<sockaddr *>(&address), address_size) != 0))
+  {
+    std::cerr << "[StreamClient::connect] could not connect to " << endpoint << ": " << std::strerror(errno) << std::endl;
+    disconnect();
+    return false;
+  }
+  int no_delay = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+  StreamHello hello;
+  if (!readAll(&hello, sizeof(hello), HELLO_TIMEOUT_MS) ||
+      (std::memcmp(hello.magic, STREAM_MAGIC, sizeof(hello.magic)) != 0) || (hello.version != STREAM_VERSION))
+  {
+    std::cerr << "[StreamClient::connect] " << endpoint << " is not a compatible stream" << std::endl;
+    disconnect();
+    return false;
+  }
+  serial_numbers_.clear();
+  for (uint32_t i = 0; i < hello.nb_devices; ++i)
+  {
+    char serial_number[32];
+    if (!readAll(serial_number, sizeof(serial_number), HELLO_TIMEOUT_MS))
+    {
+      disconnect();
+      return false;
+    }
+    serial_numbers_.push_back(std::string(serial_number, strnlen(serial_number, sizeof(serial_number))));
+  }
+  return true;
+}
+
+void StreamClient::disconnect()
+{
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+}
+
+bool StreamClient::readAll(void * data, size_t nb_bytes, int timeout_ms)
+{
+  if (fd_ < 0)
+    return false;
+  if (timeout_ms >= 0)
+  {
+    pollfd fd = {fd_, POLLIN, 0};
+    if (poll(&fd, 1, timeout_ms) <= 0)
+      return false;
+  }
+
+  char * bytes = static_cast<char *>(data);
+  while (nb_bytes > 0)
+  {
+    ssize_t nb_read = recv(fd_, bytes, nb_bytes, 0);
+    if ((nb_read < 0) && (errno == EINTR))
+      continue;
+    if (nb_read <= 0)
+    {
+      disconnect();
+      return false;
+    }
+    bytes += nb_read;
+    nb_bytes -= nb_read;
+  }
+  return true;
+}
+
+bool StreamClient::receive(std::vector<StreamSample> & samples, unsigned long & nb_dropped, int timeout_ms)
+{
+  StreamFrameHeader header;
+  if (!readAll(&header, sizeof(header), timeout_ms))
+    return false;
+  if (header.marker != STREAM_FRAME_MARKER)
+  {
+    std::cerr << "[StreamClient::receive] corrupted stream, disconnecting" << std::endl;
+    disconnect();
+    return false;
+  }
+
+  samples.resize(header.nb_samples);
+  nb_dropped = header.nb_dropped;
+  return (header.nb_samples == 0) || readAll(&samples[0], header.nb_samples * sizeof(StreamSample), -1);
+}
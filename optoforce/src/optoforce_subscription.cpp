@@ -0,0 +1,127 @@
+/**
+ * @file   optoforce_subscription.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Subscription to the samples read by the acquisition, delivered by batch to a callback.
+ *
+ */
+
+#include "optoforce/optoforce_subscription.hpp"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+
+// largest batch the executor delivers at once
+static const size_t EXECUTOR_BATCH_SIZE = 256;
+
+SampleSubscription::SampleSubscription(const SampleCallback & callback, int device, size_t nb_devices,
+                                       dispatch_mode mode, size_t queue_size, int64_t period_ns)
+  : callback_(callback),
+    device_(device),
+    mode_(mode),
+    period_ns_(period_ns),
+    nb_overruns_(0),
+    nb_missed_(new boost::atomic<unsigned long>[nb_devices]),
+    is_waiting_(false),
+    is_stop_request_(false)
+{
+  for (size_t i = 0; i < nb_devices; ++i)
+    nb_missed_[i] = 0;
+  sem_init(&wakeup_, 0, 0);
+  if (mode_ != dispatch_executor)
+    return;
+
+  for (size_t i = 0; i < nb_devices; ++i)
+    queues_.push_back(boost::shared_ptr< SpscRing<StampedSample> >(
+                        new SpscRing<StampedSample>(isFollowing(i) ? queue_size : 1)));
+  thread_.reset(new boost::thread(boost::bind(&SampleSubscription::executorThread, this)));
+}
+
+SampleSubscription::~SampleSubscription()
+{
+  if (thread_)
+  {
+    is_stop_request_ = true;
+    sem_post(&wakeup_);
+    thread_->join();
+  }
+  sem_destroy(&wakeup_);
+}
+
+void SampleSubscription::deliver(size_t device, const StampedSample * samples, size_t nb_samples)
+{
+  if ((nb_samples == 0) || !isFollowing(device))
+    return;
+
+  if (mode_ == dispatch_inline)
+  {
+    SampleBatch batch = {device, samples, nb_samples, 0};
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    callback_(batch);
+    if ((boost::chrono::steady_clock::now() - start).count() > period_ns_)
+      nb_overruns_.fetch_add(1, boost::memory_order_relaxed);
+    return;
+  }
+
+  if (device >= queues_.size())
+    return;
+  size_t nb_pushed = queues_[device]->push(samples, nb_samples);
+  if (nb_pushed < nb_samples)
+  {
+    nb_missed_[device].fetch_add(nb_samples - nb_pushed, boost::memory_order_relaxed);
+    nb_overruns_.fetch_add(nb_samples - nb_pushed, boost::memory_order_relaxed);
+  }
+  // only one reader posts, once the executor announced it waits
+  if (is_waiting_.load() && is_waiting_.exchange(false))
+    sem_post(&wakeup_);
+}
+
+bool SampleSubscription::deliverQueued(size_t device, std::vector<StampedSample> & samples)
+{
+  unsigned long nb_missed = nb_missed_[device].load(boost::memory_order_relaxed);
+  size_t nb_samples = queues_[device]->pop(&samples[0], samples.size());
+  if ((nb_samples == 0) && (nb_missed == 0))
+    return false;
+
+  nb_missed_[device].fetch_sub(nb_missed, boost::memory_order_relaxed);
+  SampleBatch batch = {device, &samples[0], nb_samples, nb_missed};
+  callback_(batch);
+  return nb_samples > 0;
+}
+
+void SampleSubscription::executorThread()
+{
+  std::vector<StampedSample> samples(EXECUTOR_BATCH_SIZE);
+  while (true)
+  {
+    bool is_stop_request = is_stop_request_.load();
+    bool is_delivered = false;
+    for (size_t i = 0; i < queues_.size(); ++i)
+      while (deliverQueued(i, samples))
+        is_delivered = true;
+    if (is_delivered)
+      continue;
+    // the queues were emptied after the stop request: nothing is left
+    if (is_stop_request)
+      break;
+
+    // the queues are checked again once the readers know the executor waits,
+    // so that a push done meanwhile is not left waiting
+    is_waiting_ = true;
+    bool is_empty = true;
+    for (size_t i = 0; (i < queues_.size()) && is_empty; ++i)
+      is_empty = (queues_[i]->size() == 0);
+    if (!is_empty || is_stop_request_.load())
+    {
+      // a reader may have consumed the wakeup meanwhile: the count is absorbed by the next wait
+      if (!is_waiting_.exchange(false))
+        while (sem_wait(&wakeup_) != 0) {}
+      continue;
+    }
+    while (sem_wait(&wakeup_) != 0) {}
+  }
+}
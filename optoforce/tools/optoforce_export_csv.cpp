@@ -0,0 +1,150 @@
+/**
+ * @file   optoforce_export_csv.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Conversion of a binary recording into the csv files written by former versions.
+ *
+ */
+
+#include <optoforce/optoforce_csv.hpp>
+#include <optoforce/optoforce_recording.hpp>
+#include <optoforce/optoforce_recording_map.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+void usage()
+{
+  std::cout << "optoforce_export_csv [recording] [csv_file] [decimals] [start_ms] [end_ms]" << std::endl;
+  std::cout << "[recording] binary file stored by the acquisition (.opto), or manifest of its segments (.manifest)" << std::endl;
+  std::cout << "[csv_file] file created, by default the recording name with a .csv extension" << std::endl;
+  std::cout << "[decimals] decimals of the forces and torques (4 by default)" << std::endl;
+  std::cout << "[start_ms] [end_ms] only export the samples of this time window, from the recording start" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    usage();
+    return -1;
+  }
+
+  std::string input = argv[1];
+  std::string output;
+  if (argc > 2)
+    output = argv[2];
+  else
+  {
+    size_t extension = input.rfind(".opto");
+    if (extension == std::string::npos)
+      extension = input.rfind(".manifest");
+    output = ((extension != std::string::npos) ? input.substr(0, extension) : input) + ".csv";
+  }
+
+  // a segmented recording is exported whole, segment after segment
+  std::vector<std::string> inputs(1, input);
+  size_t manifest_extension = input.rfind(".manifest");
+  if ((manifest_extension != std::string::npos) && (manifest_extension + 9 == input.size()))
+  {
+    std::vector<RecordingSegment> segments;
+    if (!readRecordingManifest(input, segments) || segments.empty())
+      return -1;
+    std::string directory = input.substr(0, input.rfind('/') + 1);
+    inputs.clear();
+    for (size_t i = 0; i < segments.size(); ++i)
+      inputs.push_back(directory + segments[i].filename);
+    input = inputs[0];
+  }
+
+  // a time window is located through the index of the mapped file, without reading the rest
+  if (argc > 5)
+  {
+    RecordingMap map;
+    if (!map.open(input))
+      return -1;
+
+    RecordingHeader header = map.getHeader();
+    int64_t start_ns = (int64_t) (std::atof(argv[4]) * 1e6);
+    int64_t end_ns = (int64_t) (std::atof(argv[5]) * 1e6);
+    std::vector<RecordingSample> records;
+    map.readWindow(start_ns, end_ns, records);
+    unsigned long long nb_total = map.getNumberRecords();
+    // the window may span several segments
+    std::vector<RecordingSample> segment_records;
+    for (size_t i = 1; i < inputs.size(); ++i)
+    {
+      if (!map.open(inputs[i]))
+        return -1;
+      map.readWindow(start_ns, end_ns, segment_records);
+      records.insert(records.end(), segment_records.begin(), segment_records.end());
+      nb_total += map.getNumberRecords();
+    }
+    std::cout << "Recording of " << header.serial_number
+              << " (" << (header.is_3D_sensor ? "3D" : "6D") << " sensor, "
+              << header.sample_frequency << " Hz): "
+              << records.size() << " samples of " << nb_total << " in the window" << std::endl;
+
+    CsvWriter writer;
+    writer.setPrecision(3, std::atoi(argv[3]));
+    if (!writer.open(output, header.is_3D_sensor ? 3 : 6))
+    {
+      std::cerr << "Could not create " << output << std::endl;
+      return -1;
+    }
+    if (!records.empty())
+      writer.append(&records[0], records.size());
+    if (!writer.close())
+    {
+      std::cerr << "Error while writing " << output << std::endl;
+      return -1;
+    }
+    std::cout << "Written " << output << std::endl;
+    return 0;
+  }
+
+  RecordingReader reader;
+  if (!reader.open(input))
+    return -1;
+
+  const RecordingHeader & header = reader.getHeader();
+  std::cout << "Recording of " << header.serial_number
+            << " (" << (header.is_3D_sensor ? "3D" : "6D") << " sensor, "
+            << header.sample_frequency << " Hz): "
+            << reader.getNumberRecords() << " samples";
+  if (inputs.size() > 1)
+    std::cout << " in the first of " << inputs.size() << " segments";
+  std::cout << std::endl;
+
+  // same layout as the csv written by the acquisition
+  CsvWriter writer;
+  if (argc > 3)
+    writer.setPrecision(3, std::atoi(argv[3]));
+  if (!writer.open(output, header.is_3D_sensor ? 3 : 6))
+  {
+    std::cerr << "Could not create " << output << std::endl;
+    return -1;
+  }
+
+  std::vector<RecordingSample> records(4096);
+  size_t nb_records;
+  for (size_t i = 0; i < inputs.size(); ++i)
+  {
+    if ((i > 0) && !reader.open(inputs[i]))
+      return -1;
+    while ((nb_records = reader.read(&records[0], records.size())) > 0)
+      writer.append(&records[0], nb_records);
+  }
+
+  if (!writer.close())
+  {
+    std::cerr << "Error while writing " << output << std::endl;
+    return -1;
+  }
+  std::cout << "Written " << output << std::endl;
+  return 0;
+}
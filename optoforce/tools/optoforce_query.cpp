@@ -0,0 +1,117 @@
+/**
+ * @file   optoforce_query.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Query of a binary recording on one axis: its statistics, or the time
+ *        intervals where its absolute value exceeds a threshold.
+ *        The chunks of a columnar recording give both without reading the other axes.
+ */
+
+#include <optoforce/optoforce_recording_map.hpp>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+void usage()
+{
+  std::cout << "optoforce_query [recording] [axis] [threshold]" << std::endl;
+  std::cout << "[recording] binary file stored by the acquisition (.opto), columnar for the fastest queries" << std::endl;
+  std::cout << "[axis] f_x, f_y, f_z, t_x, t_y or t_z" << std::endl;
+  std::cout << "[threshold] if set, the intervals where |axis| exceeds it, otherwise the axis statistics" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    usage();
+    return -1;
+  }
+
+  const std::string axis_names[6] = {"f_x", "f_y", "f_z", "t_x", "t_y", "t_z"};
+  size_t axis = std::find(axis_names, axis_names + 6, std::string(argv[2])) - axis_names;
+  if (axis == 6)
+  {
+    std::cerr << "Unknown axis " << argv[2] << std::endl;
+    usage();
+    return -1;
+  }
+
+  RecordingMap map;
+  if (!map.open(argv[1]))
+    return -1;
+
+  const RecordingHeader & header = map.getHeader();
+  size_t nb_chunks = map.getNumberChunks();
+  std::cout << "Recording of " << header.serial_number
+            << " (" << (header.is_3D_sensor ? "3D" : "6D") << " sensor, "
+            << header.sample_frequency << " Hz): "
+            << map.getNumberRecords() << " samples";
+  if (nb_chunks > 0)
+    std::cout << " in " << nb_chunks << " chunks";
+  std::cout << std::endl;
+
+  if (argc < 4)
+  {
+    // the statistics of the chunks are enough, the other layouts are scanned
+    double min = 0.0;
+    double max = 0.0;
+    double sum = 0.0;
+    unsigned long long nb_samples = 0;
+    for (size_t i = 0; i < nb_chunks; ++i)
+    {
+      const RecordingChunk * chunk = map.getChunk(i);
+      min = (nb_samples == 0) ? chunk->min[axis] : std::min(min, (double) chunk->min[axis]);
+      max = (nb_samples == 0) ? chunk->max[axis] : std::max(max, (double) chunk->max[axis]);
+      sum += (double) chunk->mean[axis] * chunk->block.nb_records;
+      nb_samples += chunk->block.nb_records;
+    }
+    if (nb_chunks == 0)
+    {
+      std::vector<RecordingSample> records;
+      map.readWindow(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), records);
+      for (size_t i = 0; i < records.size(); ++i, ++nb_samples)
+      {
+        double value = records[i].wrench[axis];
+        min = (nb_samples == 0) ? value : std::min(min, value);
+        max = (nb_samples == 0) ? value : std::max(max, value);
+        sum += value;
+      }
+    }
+    std::cout << axis_names[axis] << ": min " << min << " max " << max
+              << " mean " << ((nb_samples > 0) ? sum / nb_samples : 0.0) << std::endl;
+    return 0;
+  }
+
+  float threshold = std::atof(argv[3]);
+  std::vector<RecordingSample> records;
+  size_t nb_read = map.findAbove(axis, threshold, records);
+  if (nb_chunks > 0)
+    std::cout << nb_read << " chunks of " << nb_chunks << " read" << std::endl;
+  std::cout << records.size() << " samples with |" << axis_names[axis] << "| > " << threshold << std::endl;
+
+  // consecutive samples are gathered in intervals, a gap being more than 2 sample periods
+  int64_t max_gap = (header.sample_frequency > 0.0) ? (int64_t) (2e9 / header.sample_frequency) : 2000000;
+  for (size_t i = 0; i < records.size(); )
+  {
+    size_t j = i;
+    float peak = records[i].wrench[axis];
+    while ((j + 1 < records.size()) && (records[j + 1].time_ns - records[j].time_ns <= max_gap))
+    {
+      ++j;
+      if (std::fabs(records[j].wrench[axis]) > std::fabs(peak))
+        peak = records[j].wrench[axis];
+    }
+    std::cout << records[i].time_ns * 1e-6 << " ms - " << records[j].time_ns * 1e-6 << " ms: "
+              << j - i + 1 << " samples, peak " << peak << std::endl;
+    i = j + 1;
+  }
+  return 0;
+}
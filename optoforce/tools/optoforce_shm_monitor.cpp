@@ -0,0 +1,75 @@
+/**
+ * @file   optoforce_shm_monitor.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Reader of the samples a running acquisition publishes in shared memory:
+ *        once per second, the samples received and lost, and the latest one.
+ */
+
+#include <optoforce/optoforce_shm.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+void usage()
+{
+  std::cout << "optoforce_shm_monitor [serial] [duration]" << std::endl;
+  std::cout << "[serial] serial number of a device published by the acquisition (setSharedMemoryPublication)" << std::endl;
+  std::cout << "[duration] monitoring time, in s (10 by default)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    usage();
+    return -1;
+  }
+  double duration_s = (argc > 2) ? std::atof(argv[2]) : 10.0;
+
+  ShmSubscriber subscriber;
+  if (!subscriber.attach(argv[1]))
+    return -1;
+  std::cout << "Device " << subscriber.getSerialNumber() << " (" << subscriber.getNumberAxes() << " axes, "
+            << subscriber.getSampleFrequency() << " Hz)" << std::endl;
+
+  typedef boost::chrono::high_resolution_clock Clock;
+  std::vector<ShmSample> samples(SHM_HISTORY_SIZE);
+  uint64_t next_index = subscriber.getNumberPublished();
+  Clock::time_point end = Clock::now() + boost::chrono::nanoseconds((int64_t) (duration_s * 1e9));
+  while (Clock::now() < end)
+  {
+    boost::this_thread::sleep_for(boost::chrono::seconds(1));
+
+    unsigned long nb_received = 0;
+    unsigned long nb_lost = 0;
+    ShmSample latest;
+    size_t nb_read;
+    uint64_t expected_index = next_index;
+    while ((nb_read = subscriber.read(next_index, samples.data(), samples.size())) > 0)
+    {
+      // a jump of the indexes tells the samples overwritten before being read
+      latest = samples[nb_read - 1];
+      nb_lost += latest.index + 1 - expected_index - nb_read;
+      nb_received += nb_read;
+      expected_index = latest.index + 1;
+    }
+    if (nb_received == 0)
+    {
+      std::cout << "no sample" << std::endl;
+      continue;
+    }
+
+    std::cout << nb_received << " samples, " << nb_lost << " lost, latest:";
+    for (size_t k = 0; k < subscriber.getNumberAxes(); ++k)
+      std::cout << " " << latest.wrench[k];
+    std::cout << std::endl;
+  }
+  return 0;
+}
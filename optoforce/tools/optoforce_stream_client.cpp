@@ -0,0 +1,82 @@
+/**
+ * @file   optoforce_stream_client.cpp
+ * @author Anthony Remazeilles <anthony.remazeilles@tecnalia.com>
+ * @date   2016
+ *
+ * Copyright 2016 Tecnalia Research & Innovation.
+ * Distributed under the GNU GPL v3. For full terms see https://www.gnu.org/licenses/gpl.txt
+ *
+ * @brief Client of the streaming server of an acquisition: once per second, the samples
+ *        received and dropped, and their delay since acquisition (on the server host).
+ */
+
+#include <optoforce/optoforce_stream.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <boost/chrono.hpp>
+
+void usage()
+{
+  std::cout << "optoforce_stream_client [endpoint] [duration]" << std::endl;
+  std::cout << "[endpoint] tcp:<host>:<port>, tcp:<port> (local host) or unix:<path>" << std::endl;
+  std::cout << "[duration] monitoring time, in s (10 by default)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    usage();
+    return -1;
+  }
+  double duration_s = (argc > 2) ? std::atof(argv[2]) : 10.0;
+
+  StreamClient client;
+  if (!client.connect(argv[1]))
+    return -1;
+  const std::vector<std::string> & serial_numbers = client.getSerialNumbers();
+  std::cout << "Streaming " << serial_numbers.size() << " devices:";
+  for (size_t i = 0; i < serial_numbers.size(); ++i)
+    std::cout << " " << serial_numbers[i];
+  std::cout << std::endl;
+
+  typedef boost::chrono::high_resolution_clock Clock;
+  std::vector<StreamSample> samples;
+  Clock::time_point end = Clock::now() + boost::chrono::nanoseconds((int64_t) (duration_s * 1e9));
+  Clock::time_point next_report = Clock::now() + boost::chrono::seconds(1);
+  unsigned long nb_received = 0;
+  unsigned long nb_dropped = 0;
+  double delay_sum = 0.0;
+  double max_delay = 0.0;
+  while (client.isConnected() && (Clock::now() < end))
+  {
+    unsigned long nb_frame_dropped;
+    if (client.receive(samples, nb_frame_dropped, 100))
+    {
+      // the delay is only meaningful when the server runs on this host
+      int64_t now_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+      for (size_t i = 0; i < samples.size(); ++i)
+      {
+        double delay = (now_ns - samples[i].acq_time_ns) * 1e-6;
+        delay_sum += delay;
+        max_delay = std::max(max_delay, delay);
+      }
+      nb_received += samples.size();
+      nb_dropped += nb_frame_dropped;
+    }
+
+    if (Clock::now() >= next_report)
+    {
+      std::cout << nb_received << " samples, " << nb_dropped << " dropped, delay mean "
+                << (nb_received ? delay_sum / nb_received : 0.0) << " ms, max " << max_delay << " ms" << std::endl;
+      nb_received = nb_dropped = 0;
+      delay_sum = max_delay = 0.0;
+      next_report += boost::chrono::seconds(1);
+    }
+  }
+  if (!client.isConnected())
+    std::cout << "disconnected by the server" << std::endl;
+  return 0;
+}